@@ -59,4 +59,8 @@ void gw_error(int errnum);
 extern jmp_buf gw_error_jmp;
 extern int gw_errno;
 
+/* When set, gw_error() jumps here with no other effect (used to try an
+ * operation speculatively, as constant folding does) */
+extern jmp_buf *gw_error_catch;
+
 #endif
@@ -3,13 +3,22 @@
 
 #include "types.h"
 
-/* Expression evaluator - recursive descent with precedence climbing */
+/* Expression evaluator - operator precedence with explicit stacks */
 gw_value_t gw_eval(void);       /* evaluate any expression */
 gw_value_t gw_eval_num(void);   /* evaluate, require numeric */
 gw_value_t gw_eval_str(void);   /* evaluate, require string */
 int16_t    gw_eval_int(void);   /* evaluate, require integer result */
 uint16_t   gw_eval_uint16(void);
 
+/* Apply a binary operator token to two values */
+gw_value_t gw_eval_binop(uint8_t op, gw_value_t left, gw_value_t right);
+
+/* Per-line expression cache */
+void gw_eval_set_cache(bool enable);
+void gw_eval_invalidate(void);                  /* drop all compiled forms */
+void gw_eval_free_cache(program_line_t *line);
+void gw_eval_report(void);                      /* --stats */
+
 /* Force type conversions */
 int16_t  gw_to_int(gw_value_t *v);
 float    gw_to_sng(gw_value_t *v);
@@ -2,6 +2,8 @@
 #define GW_GRAPHICS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 void gfx_init(int mode);
 void gfx_shutdown(void);
@@ -9,20 +11,41 @@ void gfx_cls(void);
 bool gfx_active(void);
 int  gfx_get_mode(void);
 
-void gfx_pset(int x, int y, int color);
-int  gfx_point(int x, int y);
-void gfx_line(int x1, int y1, int x2, int y2, int color, int style);
-void gfx_circle(int cx, int cy, int r, int color, double start, double end, double aspect);
-void gfx_paint(int x, int y, int fill_color, int border_color);
+/* Drawing in world coordinates (pixels unless WINDOW is in effect) */
+void gfx_pset(double x, double y, int color);
+int  gfx_point(double x, double y);
+void gfx_line(double x1, double y1, double x2, double y2, int color, int style);
+void gfx_circle(double cx, double cy, double r, int color, double start, double end, double aspect);
+void gfx_paint(double x, double y, int fill_color, int border_color);
 void gfx_draw(const char *cmd);
 
+/* VIEW and WINDOW */
+bool   gfx_view(int x1, int y1, int x2, int y2, bool screen, int fill, int border);
+void   gfx_view_reset(void);
+bool   gfx_window(double x1, double y1, double x2, double y2, bool screen);
+void   gfx_window_reset(void);
+bool   gfx_window_active(void);
+void   gfx_map(double x, double y, int *px, int *py);
+double gfx_pmap(double v, int fn);
+
+/* Graphics GET/PUT blocks */
+int    gfx_block_bpp(void);
+size_t gfx_block_size(int w, int h);
+void   gfx_get_block(int x, int y, int w, int h, uint8_t *data);
+bool   gfx_put_block(int x, int y, const uint8_t *data, size_t len, int op);
+
 void gfx_flush(void);
 
+/* Headless frame output instead of Sixel */
+void gfx_set_output(const char *path);
+void gfx_set_stream(const char *path);
+void gfx_set_frame_skip(int n);
+
 /* Current drawing state */
 void gfx_set_color(int c);
 int  gfx_get_color(void);
-void gfx_get_last(int *x, int *y);
-void gfx_set_last(int x, int y);
+void gfx_get_last(double *x, double *y);
+void gfx_set_last(double x, double y);
 int  gfx_get_width(void);
 int  gfx_get_height(void);
 
@@ -31,4 +54,11 @@ int  gfx_get_height(void);
 #define GFX_BOX   'B'
 #define GFX_BOXF  'F'
 
+/* PUT raster operations */
+#define GFX_PSET   1
+#define GFX_PRESET 2
+#define GFX_AND    3
+#define GFX_OR     4
+#define GFX_XOR    5
+
 #endif
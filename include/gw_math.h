@@ -51,4 +51,15 @@ mbf_double_t gw_ieee_to_mbf_double(double d);
 /* Number formatting for PRINT */
 void gw_format_number(gw_value_t *v, char *buf, int bufsize);
 
+/* Exact, libc-free equivalent of gw_format_number (num_format.c) */
+#define GW_NUM_TEXT_MAX 32
+int gw_num_to_text(const gw_value_t *v, char *out);
+
+/* Scan a number in GW-BASIC syntax from [p, end) (num_scan.c); blanks
+ * inside the number are skipped when blanks is set. dbl is set when
+ * the value is for a DOUBLE variable. Returns the first byte not
+ * consumed. */
+const char *gw_scan_number(const char *p, const char *end, bool blanks,
+                           bool dbl, gw_value_t *out);
+
 #endif
@@ -16,10 +16,12 @@
 /* Tokenizer */
 int  gw_crunch(const char *text, uint8_t *out, int outsize);
 void gw_list_line(uint8_t *tokens, int len, char *out, int outsize);
+int  gw_token_len(const uint8_t *p);
 
 /* PRINT statement */
 void gw_stmt_print(void);
 void gw_print_value(gw_value_t *v);
+void gw_print_zone(void);
 void gw_print_newline(void);
 
 /* LPRINT / LLIST (print.c) */
@@ -41,21 +43,40 @@ void gw_stmt_swap(void);
 
 /* Arrays (arrays.c) */
 void gw_stmt_dim(void);
+array_entry_t *gw_array_find(const char name[2], gw_valtype_t type);
+array_entry_t *gw_array_create(const char name[2], gw_valtype_t type,
+                               int ndims, const int *dims);
 gw_value_t *gw_array_element(const char name[2], gw_valtype_t type);
+array_entry_t *gw_array_get(const char name[2], gw_valtype_t type, int nsubs);
+gw_value_t *gw_array_at(array_entry_t *a, const int *subs, int nsubs);
 void gw_stmt_erase(void);
 void gw_stmt_option(void);
 void gw_arrays_clear(void);
+void gw_array_set_kernels(bool enable);
+bool gw_array_loop(for_entry_t *f);
+
+/* MAT statements (mat.c) */
+void gw_stmt_mat(void);
 
 /* Input (input.c) */
 void gw_stmt_input(void);
 void gw_stmt_line_input(void);
+void gw_input_values(gw_value_t **elems, int n, gw_valtype_t type);
 
 /* DEF FN evaluation (interp.c) */
 gw_value_t gw_eval_fn_call(void);
+gw_value_t gw_fn_invoke(fn_def_t *fn, gw_value_t *arg, bool has_arg);
 
 /* File I/O (fileio.c) */
 file_entry_t *gw_file_get(int num);
 void gw_file_close_all(void);
+void gw_file_flush_all(void);
+void gw_file_set_bufsize(size_t size);
+void gw_file_set_mmap(bool enable);
+void gw_file_set_cache(int records);
+int  gw_file_getc(file_entry_t *f);
+long gw_file_loc(file_entry_t *f);
+long gw_file_lof(file_entry_t *f);
 void gw_stmt_open(void);
 void gw_stmt_close(void);
 void gw_stmt_print_file(void);
@@ -91,6 +112,14 @@ gw_value_t gw_fn_mki(int16_t n);
 gw_value_t gw_fn_mks(float f);
 gw_value_t gw_fn_mkd(double d);
 
+/* Constant folding (fold.c) */
+void gw_fold_set_enabled(bool enable);
+void gw_fold_line(program_line_t *line);
+void gw_unfold_line(program_line_t *line);
+gw_value_t gw_fold_const(const uint8_t *p);
+bool gw_const_value(const uint8_t *p, gw_value_t *out);
+uint8_t *gw_line_text(program_line_t *line);
+
 /* CHAIN (interp.c) */
 void gw_stmt_chain(void);
 
@@ -16,6 +16,7 @@ typedef struct {
     uint16_t cur_line_num;      /* CURLIN - 65535 = direct mode */
     program_line_t *prog_head;  /* first line of program */
     bool trace_on;              /* TRON/TROFF */
+    bool show_stats;            /* --stats: report cache statistics */
 
     /* Tokenizer buffers */
     uint8_t kbuf[300];          /* crunch buffer */
@@ -43,7 +44,9 @@ typedef struct {
     int while_sp;
 
     /* DEF FN */
+#define MAX_FN_DEPTH 512
     fn_def_t fn_defs[26];
+    int fn_depth;               /* FN calls being evaluated */
 
     /* Run state */
     program_line_t *cur_line;
@@ -77,9 +80,19 @@ typedef struct {
     int common_count;
     struct { char name[2]; gw_valtype_t type; } common_vars[64];
 
+    /* Expression evaluator stacks, shared by nested evaluations */
+#define EVAL_STACK_MAX 256
+    gw_value_t eval_vals[EVAL_STACK_MAX];
+    eval_op_t eval_ops[EVAL_STACK_MAX];
+    int eval_vsp, eval_osp;
+
     /* Event trapping */
     timer_trap_t timer_trap;
     event_trap_t key_traps[10];  /* KEY(1)-KEY(10) */
+    event_trap_t play_trap;      /* ON PLAY(n) */
+    bool events_armed;           /* any ON TIMER/KEY/PLAY handler configured */
+    bool key_traps_armed;        /* any ON KEY handler configured */
+    int event_budget;            /* statements left until the next event poll */
 } interp_state_t;
 
 extern interp_state_t gw;
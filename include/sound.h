@@ -1,12 +1,22 @@
 #ifndef GW_SOUND_H
 #define GW_SOUND_H
 
+#include <stdbool.h>
+
 void snd_init(void);
 void snd_shutdown(void);
 void snd_reset(void);
 void snd_beep(void);
-void snd_tone(int freq_hz, int duration_ticks);
-void snd_tone_sync(int freq_hz, int duration_ticks);
+void snd_tone(int freq_hz, double duration_ticks);
 void snd_play(const char *mml);
 
+/* Render to a WAV or raw PCM file instead of the audio device */
+void snd_set_output(const char *path);
+void snd_set_realtime(bool on);
+
+/* Background music (PLAY "MB") */
+int  snd_queued(void);
+void snd_set_play_trap(int n);
+bool snd_play_event(void);
+
 #endif
@@ -199,6 +199,7 @@
 #define XSTMT_PALETTE 0x9E
 #define XSTMT_LCOPY   0x9F
 #define XSTMT_CALLS   0xA0
+#define XSTMT_MAT     0xA1
 
 /* Extended function tokens (prefix 0xFD) */
 #define XFUNC_CVI     0x80
@@ -214,6 +215,8 @@
 #define TOK_INT1       0x0F  /* 1-byte integer 0-255 (uint8_t follows) */
 /* 0x11-0x1A: literal integers 0-9 (no data bytes) */
 #define TOK_CONST_SNG  0x1C  /* single-precision (4 bytes IEEE follow) */
+#define TOK_CONST_FOLD 0x1D  /* folded constant (2-byte pool index follows);
+                                only in executable tokens, never listed */
 #define TOK_CONST_DBL  0x1F  /* double-precision (8 bytes IEEE follow) */
 
 /* Keyword table entry */
@@ -36,6 +36,8 @@ typedef struct program_line {
     uint16_t num;        /* line number 0-65529 */
     uint16_t len;        /* token data length */
     uint8_t *tokens;     /* tokenized line data */
+    uint8_t *source;     /* tokens as entered when folded, else NULL */
+    struct expr_cache *ecache;  /* compiled expressions (eval.c) */
 } program_line_t;
 
 /* Variable entry */
@@ -64,6 +66,14 @@ typedef struct {
     uint16_t line_num;
 } for_entry_t;
 
+/* Pending operation on the expression evaluator's operator stack */
+typedef struct {
+    uint8_t kind;        /* EV_BINOP, EV_NEG, EV_POS, EV_NOT or EV_PAREN */
+    uint8_t op;          /* operator token for EV_BINOP */
+    uint8_t prec;        /* its precedence */
+    bool negate;         /* <>, <= and >=: complement the result */
+} eval_op_t;
+
 /* Event trap mode */
 typedef enum { TRAP_OFF = 0, TRAP_ON = 1, TRAP_STOP = 2 } trap_mode_t;
 
@@ -104,6 +114,7 @@ typedef struct {
     gw_valtype_t param_type, ret_type;
     uint8_t *body_text;
     struct program_line *body_line;
+    int16_t param_slot;  /* gw.vars index of the parameter, checked on use */
 } fn_def_t;
 
 /* File entry for OPEN/CLOSE file table */
@@ -112,6 +123,19 @@ typedef struct {
     int mode;       /* 0=closed, 'I'=input, 'O'=output, 'A'=append, 'R'=random */
     int file_num;
     bool eof_flag;
+    char *io_buf;           /* stdio buffer for sequential files (setvbuf) */
+    char *out_buf;          /* PRINT#/WRITE# staging area (output files) */
+    size_t out_len;         /* bytes staged in out_buf */
+    char *rec_buf;          /* current INPUT# record, grown to fit the line */
+    size_t rec_cap;         /* allocated size of rec_buf */
+    size_t rec_len;         /* bytes in rec_buf, including the line ending */
+    size_t rec_pos;         /* next unconsumed byte of rec_buf */
+    uint8_t *map;           /* random file mapped with --mmap, or NULL */
+    size_t map_cap;         /* bytes mapped (the file is extended to this) */
+    struct record_cache *rcache; /* write-back record cache, or NULL */
+    size_t rnd_size;        /* logical size of a mapped or cached file */
+    size_t rnd_pos;         /* byte position in a mapped or cached file */
+    bool write_pending;     /* last stdio access was a PUT */
     int record_len;         /* record length for random access (default 128) */
     uint8_t *field_buf;     /* FIELD buffer (malloc'd, record_len bytes) */
     int field_count;        /* number of FIELDed variables */
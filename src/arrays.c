@@ -9,7 +9,7 @@
  * Default bounds 0-10 (11 elements) if not DIMmed.
  */
 
-static array_entry_t *find_array(const char name[2], gw_valtype_t type)
+array_entry_t *gw_array_find(const char name[2], gw_valtype_t type)
 {
     for (int i = 0; i < gw.array_count; i++) {
         if (gw.arrays[i].name[0] == name[0] && gw.arrays[i].name[1] == name[1]
@@ -19,8 +19,8 @@ static array_entry_t *find_array(const char name[2], gw_valtype_t type)
     return NULL;
 }
 
-static array_entry_t *create_array(const char name[2], gw_valtype_t type,
-                                   int ndims, const int *dims)
+array_entry_t *gw_array_create(const char name[2], gw_valtype_t type,
+                               int ndims, const int *dims)
 {
     if (gw.array_count >= 64)
         gw_error(ERR_OM);
@@ -47,33 +47,22 @@ static array_entry_t *create_array(const char name[2], gw_valtype_t type,
     return a;
 }
 
-/* Parse subscripts and return pointer to element */
-gw_value_t *gw_array_element(const char name[2], gw_valtype_t type)
+/* Find an array, auto-DIMming it with default bounds 0-10 */
+array_entry_t *gw_array_get(const char name[2], gw_valtype_t type, int nsubs)
 {
-    gw_expect('(');
-
-    int subs[8];
-    int nsubs = 0;
-    for (;;) {
-        if (nsubs >= 8)
-            gw_error(ERR_BS);
-        subs[nsubs++] = gw_eval_int();
-        gw_skip_spaces();
-        if (gw_chrgot() != ',')
-            break;
-        gw_chrget();
-    }
-    gw_expect_rparen();
-
-    array_entry_t *a = find_array(name, type);
+    array_entry_t *a = gw_array_find(name, type);
     if (!a) {
-        /* Auto-DIM with default bounds 0-10 */
         int dims[8];
         for (int i = 0; i < nsubs; i++)
             dims[i] = 10;
-        a = create_array(name, type, nsubs, dims);
+        a = gw_array_create(name, type, nsubs, dims);
     }
+    return a;
+}
 
+/* Element at the given subscripts */
+gw_value_t *gw_array_at(array_entry_t *a, const int *subs, int nsubs)
+{
     if (nsubs != a->ndims)
         gw_error(ERR_BS);
 
@@ -92,6 +81,27 @@ gw_value_t *gw_array_element(const char name[2], gw_valtype_t type)
     return &a->data[index];
 }
 
+/* Parse subscripts and return pointer to element */
+gw_value_t *gw_array_element(const char name[2], gw_valtype_t type)
+{
+    gw_expect('(');
+
+    int subs[8];
+    int nsubs = 0;
+    for (;;) {
+        if (nsubs >= 8)
+            gw_error(ERR_BS);
+        subs[nsubs++] = gw_eval_int();
+        gw_skip_spaces();
+        if (gw_chrgot() != ',')
+            break;
+        gw_chrget();
+    }
+    gw_expect_rparen();
+
+    return gw_array_at(gw_array_get(name, type, nsubs), subs, nsubs);
+}
+
 void gw_stmt_dim(void)
 {
     for (;;) {
@@ -114,10 +124,10 @@ void gw_stmt_dim(void)
         }
         gw_expect_rparen();
 
-        if (find_array(name, type))
+        if (gw_array_find(name, type))
             gw_error(ERR_DD);
 
-        create_array(name, type, ndims, dims);
+        gw_array_create(name, type, ndims, dims);
 
         gw_skip_spaces();
         if (gw_chrgot() != ',')
@@ -132,7 +142,7 @@ void gw_stmt_erase(void)
         char name[2];
         gw_valtype_t type = gw_parse_varname(name);
 
-        array_entry_t *a = find_array(name, type);
+        array_entry_t *a = gw_array_find(name, type);
         if (!a)
             gw_error(ERR_FC);
 
@@ -145,6 +155,7 @@ void gw_stmt_erase(void)
         /* Remove from array by swapping with last */
         int idx = a - gw.arrays;
         gw.arrays[idx] = gw.arrays[--gw.array_count];
+        gw_eval_invalidate();
 
         gw_skip_spaces();
         if (gw_chrgot() != ',')
@@ -183,4 +194,529 @@ void gw_arrays_clear(void)
         free(gw.arrays[i].data);
     }
     gw.array_count = 0;
+    gw_eval_invalidate();
+}
+
+/* ================================================================
+ * FOR loop kernels
+ * ================================================================ */
+
+/*
+ * A FOR loop whose body is one of these statements, over one-dimensional
+ * arrays subscripted by the loop variable, runs here as a native loop
+ * instead of statement by statement:
+ *
+ *     FOR I=a TO b: A(I)=c: NEXT              fill (c a constant, string
+ *                                             literal or other variable)
+ *     FOR I=a TO b: A(I)=B(I): NEXT           copy
+ *     FOR I=a TO b: S=S+A(I): NEXT            sum
+ *     FOR I=a TO b: Y(I)=Y(I)+K*X(I): NEXT    multiply-add (or Y(I)=K*X(I))
+ *     FOR I=a TO b: IF A(I)>M THEN M=A(I)     maximum (< for minimum),
+ *     NEXT                                    NEXT starting the next line
+ *
+ * NEXT may name the loop variable. Each iteration does the interpreter's
+ * arithmetic, conversions and loop variable steps in the same order, so
+ * results are identical. When an iteration would raise an error (a
+ * subscript out of range, an overflow), the kernel stops before it with
+ * the loop variable at that value and the interpreter carries on from
+ * the top of the body, raising the error itself. Loops that do not
+ * match exactly are interpreted as usual.
+ */
+
+enum { LK_FILL, LK_COPY, LK_SUM, LK_MAX, LK_MIN, LK_SCALE };
+enum { OPD_ARRAY, OPD_VAR, OPD_CONST, OPD_STRING };
+
+typedef struct {
+    int kind;
+    char name[2];
+    gw_valtype_t type;
+    const uint8_t *text;    /* constant token or string literal */
+    int len;                /* string literal length */
+} operand_t;
+
+typedef struct {
+    jmp_buf stop;
+    var_entry_t *var;       /* loop variable */
+    int kind;
+    bool accumulate;        /* LK_SCALE: Y(I)=Y(I)+K*X(I) */
+    operand_t dst, src, k;
+    uint8_t *after;         /* text after the NEXT */
+    program_line_t *next_line;  /* line of the NEXT if not the FOR's */
+
+    /* Resolved when the loop starts */
+    array_entry_t *da, *sa;
+    var_entry_t *acc;       /* sum, maximum or minimum */
+    gw_value_t kval;        /* fill value or multiplier */
+
+    /* Loop variable: the value for the next iteration to run */
+    gw_value_t cur;
+    int16_t istep;
+    float fstep;
+    double dstep, lim;
+    bool up;
+} loop_t;
+
+static bool kernels_enabled = true;
+
+void gw_array_set_kernels(bool enable)
+{
+    kernels_enabled = enable;
+}
+
+/* ---------------- Matching ---------------- */
+
+static bool same_name(const char a[2], const char b[2])
+{
+    return a[0] == b[0] && a[1] == b[1];
+}
+
+static bool same_operand(const operand_t *a, const operand_t *b)
+{
+    return a->kind == b->kind && a->type == b->type
+        && same_name(a->name, b->name);
+}
+
+static bool is_loop_var(const loop_t *lp, const operand_t *o)
+{
+    return o->kind == OPD_VAR && o->type == lp->var->type
+        && same_name(o->name, lp->var->name);
+}
+
+static bool match_tok(uint8_t tok)
+{
+    gw_skip_spaces();
+    if (gw_chrgot() != tok)
+        return false;
+    gw_chrget();
+    return true;
+}
+
+static bool at_stmt_end(void)
+{
+    gw_skip_spaces();
+    return gw_chrgot() == ':' || gw_chrgot() == 0;
+}
+
+/* A(I) with I the loop variable, a variable, a numeric constant or a
+ * string literal */
+static bool match_operand(loop_t *lp, operand_t *o)
+{
+    gw_skip_spaces();
+    uint8_t *p = gw.text_ptr;
+    gw_value_t v;
+
+    if (gw_is_letter(*p)) {
+        o->type = gw_parse_varname(o->name);
+        gw_skip_spaces();
+        if (gw_chrgot() != '(') {
+            o->kind = OPD_VAR;
+            return true;
+        }
+        gw_chrget();
+        char name[2];
+        if (!gw_is_letter(gw_chrgot())
+            || gw_parse_varname(name) != lp->var->type
+            || !same_name(name, lp->var->name))
+            return false;
+        o->kind = OPD_ARRAY;
+        return match_tok(')');
+    }
+
+    if (*p == '"') {
+        o->kind = OPD_STRING;
+        o->type = VT_STR;
+        o->text = ++p;
+        while (*p && *p != '"')
+            p++;
+        o->len = (int)(p - o->text);
+        gw.text_ptr = *p ? p + 1 : p;
+        return true;
+    }
+
+    if (gw_const_value(p, &v)) {
+        o->kind = OPD_CONST;
+        o->type = v.type;
+        o->text = p;
+        gw.text_ptr = p + gw_token_len(p);
+        return true;
+    }
+    return false;
+}
+
+/* IF A(I)>M THEN M=A(I), in either order of the comparison */
+static bool match_minmax(loop_t *lp)
+{
+    operand_t a, b, m, e;
+    if (!match_operand(lp, &a))
+        return false;
+    gw_skip_spaces();
+    uint8_t rel = gw_chrgot();
+    if ((rel != TOK_GT && rel != TOK_LT) || !match_tok(rel)
+        || !match_operand(lp, &b) || !match_tok(TOK_THEN))
+        return false;
+
+    bool greater = rel == TOK_GT;
+    if (a.kind == OPD_VAR && b.kind == OPD_ARRAY) {
+        operand_t t = a;
+        a = b;
+        b = t;
+        greater = !greater;
+    }
+    if (a.kind != OPD_ARRAY || b.kind != OPD_VAR || is_loop_var(lp, &b)
+        || a.type == VT_STR || b.type == VT_STR)
+        return false;
+
+    if (!match_operand(lp, &m) || !same_operand(&m, &b)
+        || !match_tok(TOK_EQ) || !match_operand(lp, &e)
+        || !same_operand(&e, &a))
+        return false;
+
+    lp->kind = greater ? LK_MAX : LK_MIN;
+    lp->dst = m;
+    lp->src = a;
+    return true;
+}
+
+/* S=S+A(I) or S=A(I)+S */
+static bool match_sum(loop_t *lp)
+{
+    operand_t a, b;
+    if (lp->dst.type == VT_STR || is_loop_var(lp, &lp->dst)
+        || !match_operand(lp, &a) || !match_tok(TOK_PLUS)
+        || !match_operand(lp, &b))
+        return false;
+    if (a.kind == OPD_ARRAY) {
+        operand_t t = a;
+        a = b;
+        b = t;
+    }
+    if (!same_operand(&a, &lp->dst) || b.kind != OPD_ARRAY
+        || b.type == VT_STR)
+        return false;
+    lp->kind = LK_SUM;
+    lp->src = b;
+    return true;
+}
+
+/* Right-hand side of A(I)=...: c, B(I), K*X(I) or A(I)+K*X(I) */
+static bool match_store(loop_t *lp)
+{
+    operand_t r;
+    if (!match_operand(lp, &r))
+        return false;
+
+    if (at_stmt_end()) {
+        if (r.kind == OPD_ARRAY) {
+            lp->kind = LK_COPY;
+            lp->src = r;
+        } else {
+            if (is_loop_var(lp, &r))
+                return false;
+            lp->kind = LK_FILL;
+            lp->k = r;
+        }
+        return (r.type == VT_STR) == (lp->dst.type == VT_STR);
+    }
+
+    if (same_operand(&r, &lp->dst)) {
+        if (!match_tok(TOK_PLUS) || !match_operand(lp, &r))
+            return false;
+        lp->accumulate = true;
+    }
+
+    /* K*X(I) or X(I)*K */
+    operand_t x;
+    if (!match_tok(TOK_MUL) || !match_operand(lp, &x))
+        return false;
+    if (r.kind == OPD_ARRAY) {
+        operand_t t = r;
+        r = x;
+        x = t;
+    }
+    if (x.kind != OPD_ARRAY || r.kind == OPD_ARRAY || r.kind == OPD_STRING
+        || is_loop_var(lp, &r) || x.type == VT_STR || lp->dst.type == VT_STR
+        || r.type == VT_STR)
+        return false;
+    lp->kind = LK_SCALE;
+    lp->k = r;
+    lp->src = x;
+    return true;
+}
+
+/* The NEXT closing the loop: after a colon, or first on the next line
+ * when the body ends its line */
+static bool match_next(loop_t *lp, bool own_line)
+{
+    gw_skip_spaces();
+    if (gw_chrgot() == ':' && !own_line) {
+        gw.text_ptr++;
+    } else if (gw_chrgot() == 0 && gw.cur_line && gw.cur_line->next
+               && gw.text_ptr >= gw.cur_line->tokens
+               && gw.text_ptr <= gw.cur_line->tokens + gw.cur_line->len) {
+        lp->next_line = gw.cur_line->next;
+        gw.text_ptr = lp->next_line->tokens;
+    } else {
+        return false;
+    }
+
+    if (!match_tok(TOK_NEXT))
+        return false;
+    if (gw_is_letter(gw_chrgot())) {
+        char name[2];
+        if (gw_parse_varname(name) != lp->var->type
+            || !same_name(name, lp->var->name))
+            return false;
+    }
+    if (!at_stmt_end())
+        return false;
+    lp->after = gw.text_ptr;
+    return true;
+}
+
+/* Recognise the body at gw.text_ptr, just after the FOR statement */
+static bool match_loop(loop_t *lp)
+{
+    gw_skip_spaces();
+    if (gw_chrgot() != ':')
+        return false;
+    gw.text_ptr++;
+
+    if (match_tok(TOK_IF))
+        return match_minmax(lp) && match_next(lp, true);
+
+    match_tok(TOK_LET);
+    if (!match_operand(lp, &lp->dst) || lp->dst.kind > OPD_VAR
+        || !match_tok(TOK_EQ))
+        return false;
+    bool ok = lp->dst.kind == OPD_ARRAY ? match_store(lp) : match_sum(lp);
+    return ok && at_stmt_end() && match_next(lp, false);
+}
+
+/* ---------------- Execution ---------------- */
+
+static void stop(loop_t *lp)
+{
+    longjmp(lp->stop, 1);
+}
+
+static array_entry_t *loop_array(const operand_t *o)
+{
+    array_entry_t *a = gw_array_get(o->name, o->type, 1);
+    if (a->ndims != 1)
+        gw_error(ERR_BS);
+    return a;
+}
+
+/* Value of a fill value or multiplier */
+static gw_value_t operand_value(const operand_t *o)
+{
+    gw_value_t v;
+    switch (o->kind) {
+    case OPD_VAR: {
+        var_entry_t *var = gw_var_find_or_create(o->name, o->type);
+        v = var->val;
+        if (v.type == VT_STR && v.sval.data)
+            v.sval = gw_str_copy(&var->val.sval);
+        break;
+    }
+    case OPD_CONST:
+        gw_const_value(o->text, &v);
+        break;
+    default:
+        v.type = VT_STR;
+        v.sval = gw_str_alloc(o->len);
+        memcpy(v.sval.data, o->text, o->len);
+        break;
+    }
+    return v;
+}
+
+/* Store into an array element with the conversion LET does */
+static void store_elem(gw_value_t *e, gw_valtype_t type, gw_value_t *v)
+{
+    switch (type) {
+    case VT_INT: e->ival = gw_to_int(v); break;
+    case VT_SNG: e->fval = gw_to_sng(v); break;
+    case VT_DBL: e->dval = gw_to_dbl(v); break;
+    default:
+        gw_str_free(&e->sval);
+        e->sval = v->sval;
+        break;
+    }
+    e->type = type;
+}
+
+/* Element of a at the current loop variable value */
+static gw_value_t *loop_elem(loop_t *lp, array_entry_t *a)
+{
+    int sub = gw_to_int(&lp->cur) - gw.option_base;
+    if (sub < 0 || sub > a->dims[0] - gw.option_base)
+        gw_error(ERR_BS);
+    return &a->data[sub];
+}
+
+/* Step v as NEXT does; true when the loop is finished */
+static bool loop_next(loop_t *lp, gw_value_t *v)
+{
+    double x;
+    switch (v->type) {
+    case VT_INT:
+        v->ival = gw_int_add(v->ival, lp->istep);
+        x = v->ival;
+        break;
+    case VT_SNG:
+        v->fval += lp->fstep;
+        x = v->fval;
+        break;
+    default:
+        v->dval += lp->dstep;
+        x = v->dval;
+        break;
+    }
+    /* A step too small to move the variable would never finish */
+    if (x == gw_to_dbl(&lp->cur))
+        stop(lp);
+    return lp->up ? x > lp->lim : x < lp->lim;
+}
+
+static void run_loop(loop_t *lp, for_entry_t *f)
+{
+    /* Resolve names in the order the first iteration would */
+    switch (lp->kind) {
+    case LK_FILL:
+        lp->da = loop_array(&lp->dst);
+        lp->kval = operand_value(&lp->k);
+        if (lp->kval.type != VT_STR) {
+            gw_value_t v = lp->kval;
+            store_elem(&lp->kval, lp->da->type, &v);
+        }
+        break;
+    case LK_COPY:
+        lp->da = loop_array(&lp->dst);
+        lp->sa = loop_array(&lp->src);
+        break;
+    case LK_SUM:
+        lp->acc = gw_var_find_or_create(lp->dst.name, lp->dst.type);
+        lp->sa = loop_array(&lp->src);
+        break;
+    case LK_MAX:
+    case LK_MIN:
+        lp->sa = loop_array(&lp->src);
+        lp->acc = gw_var_find_or_create(lp->dst.name, lp->dst.type);
+        break;
+    case LK_SCALE:
+        lp->da = loop_array(&lp->dst);
+        lp->kval = operand_value(&lp->k);
+        lp->sa = loop_array(&lp->src);
+        break;
+    }
+
+    if (lp->var->type == VT_INT)
+        lp->istep = gw_to_int(&f->step);
+    lp->fstep = gw_to_sng(&f->step);
+    lp->dstep = gw_to_dbl(&f->step);
+    lp->lim = gw_to_dbl(&f->limit);
+    lp->up = lp->dstep >= 0;
+
+    gw_valtype_t type = lp->da ? lp->da->type : VT_INT;
+    for (;;) {
+        gw_value_t next = lp->cur;
+        bool done = loop_next(lp, &next);
+
+        switch (lp->kind) {
+        case LK_FILL: {
+            gw_value_t *e = loop_elem(lp, lp->da);
+            if (type == VT_STR) {
+                gw_str_free(&e->sval);
+                e->sval = gw_str_copy(&lp->kval.sval);
+            } else {
+                *e = lp->kval;
+            }
+            break;
+        }
+        case LK_COPY: {
+            gw_value_t *e = loop_elem(lp, lp->da);
+            gw_value_t v = *loop_elem(lp, lp->sa);
+            if (v.type == VT_STR && v.sval.data)
+                v.sval = gw_str_copy(&v.sval);
+            store_elem(e, type, &v);
+            break;
+        }
+        case LK_SUM: {
+            gw_value_t v = gw_eval_binop(TOK_PLUS, lp->acc->val,
+                                         *loop_elem(lp, lp->sa));
+            gw_var_assign(lp->acc, &v);
+            break;
+        }
+        case LK_MAX:
+        case LK_MIN: {
+            gw_value_t *e = loop_elem(lp, lp->sa);
+            gw_value_t c = gw_eval_binop(lp->kind == LK_MAX ? TOK_GT : TOK_LT,
+                                         *e, lp->acc->val);
+            if (c.ival) {
+                gw_value_t v = *e;
+                gw_var_assign(lp->acc, &v);
+            }
+            break;
+        }
+        case LK_SCALE: {
+            gw_value_t *e = loop_elem(lp, lp->da);
+            gw_value_t v = gw_eval_binop(TOK_MUL, lp->kval,
+                                         *loop_elem(lp, lp->sa));
+            if (lp->accumulate)
+                v = gw_eval_binop(TOK_PLUS, *e, v);
+            store_elem(e, type, &v);
+            break;
+        }
+        }
+
+        lp->cur = next;
+        if (done)
+            return;
+    }
+}
+
+/* Run the loop just set up by FOR as a kernel if its body is one of the
+ * forms above. True if it ran to completion, leaving gw.text_ptr after
+ * its NEXT; false to interpret the body from gw.text_ptr as usual. */
+bool gw_array_loop(for_entry_t *f)
+{
+    /* TRON prints each statement and traps are polled between them */
+    if (!kernels_enabled || gw.trace_on || gw.events_armed)
+        return false;
+
+    loop_t lp;
+    memset(&lp, 0, sizeof(lp));
+    lp.var = f->var;
+    lp.cur = f->var->val;
+
+    uint8_t *body = gw.text_ptr;
+    jmp_buf *save_catch = gw_error_catch;
+    gw_error_catch = &lp.stop;
+
+    volatile bool matched = false, done = false;
+    if (setjmp(lp.stop) == 0)
+        matched = match_loop(&lp);
+    gw.text_ptr = body;
+    if (matched && setjmp(lp.stop) == 0) {
+        run_loop(&lp, f);
+        done = true;
+    }
+    gw_error_catch = save_catch;
+
+    if (lp.kval.type == VT_STR)
+        gw_str_free(&lp.kval.sval);
+    if (!matched)
+        return false;
+    f->var->val = lp.cur;
+    if (!done)
+        return false;
+
+    gw.for_sp--;
+    gw.text_ptr = lp.after;
+    if (lp.next_line) {
+        gw.cur_line = lp.next_line;
+        gw.cur_line_num = lp.next_line->num;
+    }
+    return true;
 }
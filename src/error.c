@@ -6,6 +6,7 @@
 #include <stdlib.h>
 
 jmp_buf gw_error_jmp;
+jmp_buf *gw_error_catch;
 int gw_errno = 0;
 
 static const struct { int num; const char *msg; } error_table[] = {
@@ -68,6 +69,14 @@ const char *gw_error_msg(int errnum)
 
 void gw_error(int errnum)
 {
+    if (gw_error_catch)
+        longjmp(*gw_error_catch, errnum);
+
+    /* Abandon any expression being evaluated */
+    gw.eval_vsp = 0;
+    gw.eval_osp = 0;
+    gw.fn_depth = 0;
+
     gw_errno = errnum;
     gw.err_line_num = gw.cur_line_num;
 
@@ -98,6 +107,7 @@ void gw_error(int errnum)
     else
         fputs(buf, stderr);
 
+    gw_file_flush_all();
     gw.running = false;
     longjmp(gw_error_jmp, errnum);
 }
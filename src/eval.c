@@ -1,6 +1,7 @@
 #include "gwbasic.h"
 #include "tui.h"
 #include "graphics.h"
+#include "sound.h"
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
@@ -9,7 +10,9 @@
 
 /*
  * Expression evaluator - reimplements GWEVAL.ASM's FRMEVL.
- * Uses recursive descent with precedence climbing.
+ * Operator precedence parsing with explicit operand and operator stacks
+ * in interp_state_t (like FRMEVL's use of the 8086 stack), so operators
+ * and parentheses do not recurse.
  *
  * Operator precedence (from GWDATA.ASM):
  *   ^          127
@@ -27,11 +30,9 @@
  */
 
 /* Forward declarations */
-static gw_value_t eval_expr(int min_prec);
-static gw_value_t eval_unary(void);
+static gw_value_t eval_expr(void);
 static gw_value_t eval_atom(void);
 static gw_value_t eval_function(uint8_t prefix, uint8_t func_tok);
-static gw_value_t eval_paren(void);
 static gw_value_t eval_number(void);
 static gw_value_t eval_string_literal(void);
 
@@ -58,24 +59,146 @@ static int op_prec(uint8_t tok)
     }
 }
 
-/* Apply a binary operator */
-static gw_value_t apply_binop(uint8_t op, gw_value_t left, gw_value_t right)
+/* ================================================================
+ * Binary operators
+ * ================================================================ */
+
+/* Both operand types in one tag, so each same-type pair dispatches with
+ * a single switch */
+#define TYPE_PAIR(l, r) (((l) << 4) | (r))
+
+/* A NaN or infinity result is an overflow (same test as the gw_f*
+ * helpers, done inline) */
+static inline void check_fp(double r)
+{
+    if (!isfinite(r))
+        gw_error(ERR_OV);
+}
+
+/* \ and MOD, with operands already converted to INTEGER */
+static int16_t int_divmod(uint8_t op, int16_t a, int16_t b)
+{
+    if (op == TOK_IDIV)
+        return gw_int_div(a, b);
+    return gw_int_mod(a, b);
+}
+
+/* INTEGER op INTEGER; false for operators handled by the general path */
+static bool binop_int(uint8_t op, int16_t a, int16_t b, gw_value_t *res)
+{
+    res->type = VT_INT;
+    switch (op) {
+    case TOK_PLUS:
+        if (__builtin_add_overflow(a, b, &res->ival)) gw_error(ERR_OV);
+        return true;
+    case TOK_MINUS:
+        if (__builtin_sub_overflow(a, b, &res->ival)) gw_error(ERR_OV);
+        return true;
+    case TOK_MUL:
+        if (__builtin_mul_overflow(a, b, &res->ival)) gw_error(ERR_OV);
+        return true;
+    case TOK_DIV:
+        /* Integer / integer -> single in GW-BASIC */
+        if (b == 0) gw_error(ERR_DZ);
+        res->type = VT_SNG;
+        res->fval = (float)a / (float)b;
+        return true;
+    case TOK_IDIV:
+    case TOK_MOD:  res->ival = int_divmod(op, a, b); return true;
+    case TOK_GT:   res->ival = a > b ? -1 : 0; return true;
+    case TOK_EQ:   res->ival = a == b ? -1 : 0; return true;
+    case TOK_LT:   res->ival = a < b ? -1 : 0; return true;
+    case TOK_AND:  res->ival = a & b; return true;
+    case TOK_OR:   res->ival = a | b; return true;
+    case TOK_XOR:  res->ival = a ^ b; return true;
+    case TOK_EQV:  res->ival = ~(a ^ b); return true;
+    case TOK_IMP:  res->ival = (~a) | b; return true;
+    default:       return false;
+    }
+}
+
+/* SINGLE op SINGLE. The arithmetic is done in double and rounded to
+ * single; a result beyond the SINGLE range is an overflow. */
+static bool binop_sng(uint8_t op, double a, double b, gw_value_t *res)
+{
+    double r;
+    switch (op) {
+    case TOK_PLUS:  r = a + b; break;
+    case TOK_MINUS: r = a - b; break;
+    case TOK_MUL:   r = a * b; break;
+    case TOK_DIV:
+        if (b == 0.0) gw_error(ERR_DZ);
+        r = a / b;
+        break;
+    case TOK_GT: res->type = VT_INT; res->ival = a > b ? -1 : 0; return true;
+    case TOK_EQ: res->type = VT_INT; res->ival = a == b ? -1 : 0; return true;
+    case TOK_LT: res->type = VT_INT; res->ival = a < b ? -1 : 0; return true;
+    default:     return false;
+    }
+    res->type = VT_SNG;
+    res->fval = (float)r;
+    check_fp(res->fval);
+    return true;
+}
+
+/* DOUBLE op DOUBLE */
+static bool binop_dbl(uint8_t op, double a, double b, gw_value_t *res)
+{
+    double r;
+    switch (op) {
+    case TOK_PLUS:  r = a + b; break;
+    case TOK_MINUS: r = a - b; break;
+    case TOK_MUL:   r = a * b; break;
+    case TOK_DIV:
+        if (b == 0.0) gw_error(ERR_DZ);
+        r = a / b;
+        break;
+    case TOK_GT: res->type = VT_INT; res->ival = a > b ? -1 : 0; return true;
+    case TOK_EQ: res->type = VT_INT; res->ival = a == b ? -1 : 0; return true;
+    case TOK_LT: res->type = VT_INT; res->ival = a < b ? -1 : 0; return true;
+    default:     return false;
+    }
+    check_fp(r);
+    res->type = VT_DBL;
+    res->dval = r;
+    return true;
+}
+
+/* Apply a binary operator. Same-type numeric operands take the kernels
+ * above; strings, mixed types, ^ and the integer-only operators on
+ * floating operands go through the general path. */
+static gw_value_t apply_binop(uint8_t op, gw_value_t *left, gw_value_t *right)
 {
     gw_value_t result;
 
+    switch (TYPE_PAIR(left->type, right->type)) {
+    case TYPE_PAIR(VT_INT, VT_INT):
+        if (binop_int(op, left->ival, right->ival, &result))
+            return result;
+        break;
+    case TYPE_PAIR(VT_SNG, VT_SNG):
+        if (binop_sng(op, left->fval, right->fval, &result))
+            return result;
+        break;
+    case TYPE_PAIR(VT_DBL, VT_DBL):
+        if (binop_dbl(op, left->dval, right->dval, &result))
+            return result;
+        break;
+    }
+
     /* String concatenation */
-    if (op == TOK_PLUS && left.type == VT_STR && right.type == VT_STR)
-        return gw_str_concat(&left, &right);
+    if (op == TOK_PLUS && left->type == VT_STR && right->type == VT_STR)
+        return gw_str_concat(left, right);
 
     /* Relational operators can compare strings */
     if ((op == TOK_GT || op == TOK_EQ || op == TOK_LT)
-        && left.type == VT_STR && right.type == VT_STR) {
-        char *ls = gw_str_to_cstr(&left.sval);
-        char *rs = gw_str_to_cstr(&right.sval);
+        && left->type == VT_STR && right->type == VT_STR) {
+        char *ls = gw_str_to_cstr(&left->sval);
+        char *rs = gw_str_to_cstr(&right->sval);
         int cmp = strcmp(ls, rs);
         free(ls); free(rs);
-        gw_str_free(&left.sval);
-        gw_str_free(&right.sval);
+        gw_str_free(&left->sval);
+        gw_str_free(&right->sval);
         result.type = VT_INT;
         switch (op) {
         case TOK_GT: result.ival = cmp > 0 ? -1 : 0; break;
@@ -86,231 +209,238 @@ static gw_value_t apply_binop(uint8_t op, gw_value_t left, gw_value_t right)
     }
 
     /* Type mismatch if mixed string/numeric */
-    if (left.type == VT_STR || right.type == VT_STR)
+    if (left->type == VT_STR || right->type == VT_STR)
         gw_error(ERR_TM);
 
-    /* Logical/bitwise operators: force to integer */
+    /* Logical/bitwise operators, integer division and MOD: force to
+     * integer */
     if (op == TOK_AND || op == TOK_OR || op == TOK_XOR
-        || op == TOK_EQV || op == TOK_IMP) {
-        int16_t a = gw_to_int(&left);
-        int16_t b = gw_to_int(&right);
-        result.type = VT_INT;
-        switch (op) {
-        case TOK_AND: result.ival = a & b; break;
-        case TOK_OR:  result.ival = a | b; break;
-        case TOK_XOR: result.ival = a ^ b; break;
-        case TOK_EQV: result.ival = ~(a ^ b); break;
-        case TOK_IMP: result.ival = (~a) | b; break;
-        }
-        return result;
-    }
-
-    /* Integer division and MOD: force to integer */
-    if (op == TOK_IDIV || op == TOK_MOD) {
-        int16_t a = gw_to_int(&left);
-        int16_t b = gw_to_int(&right);
-        if (b == 0) gw_error(ERR_DZ);
-        result.type = VT_INT;
-        if (op == TOK_IDIV)
-            result.ival = a / b;
-        else
-            result.ival = a % b;
+        || op == TOK_EQV || op == TOK_IMP
+        || op == TOK_IDIV || op == TOK_MOD) {
+        int16_t a = gw_to_int(left);
+        int16_t b = gw_to_int(right);
+        binop_int(op, a, b, &result);
         return result;
     }
 
     /* Promote to common numeric type */
-    gw_promote(&left, &right);
-
-    /* Integer arithmetic */
-    if (left.type == VT_INT) {
-        result.type = VT_INT;
-        switch (op) {
-        case TOK_PLUS:  result.ival = gw_int_add(left.ival, right.ival); break;
-        case TOK_MINUS: result.ival = gw_int_sub(left.ival, right.ival); break;
-        case TOK_MUL:   result.ival = gw_int_mul(left.ival, right.ival); break;
-        case TOK_DIV:
-            /* Integer / integer -> single in GW-BASIC */
-            if (right.ival == 0) gw_error(ERR_DZ);
-            result.type = VT_SNG;
-            result.fval = (float)left.ival / (float)right.ival;
-            break;
-        case TOK_POW:
-            result.type = VT_SNG;
-            result.fval = (float)gw_fpow(left.ival, right.ival);
-            break;
-        case TOK_GT: result.ival = left.ival > right.ival ? -1 : 0; break;
-        case TOK_EQ: result.ival = left.ival == right.ival ? -1 : 0; break;
-        case TOK_LT: result.ival = left.ival < right.ival ? -1 : 0; break;
-        default: gw_error(ERR_SN);
-        }
+    gw_promote(left, right);
+
+    /* INTEGER ^ INTEGER -> single */
+    if (left->type == VT_INT) {
+        if (op != TOK_POW) gw_error(ERR_SN);
+        result.type = VT_SNG;
+        result.fval = (float)gw_fpow(left->ival, right->ival);
+        check_fp(result.fval);
         return result;
     }
 
-    /* Float/double arithmetic */
-    double a = (left.type == VT_SNG) ? left.fval : left.dval;
-    double b = (right.type == VT_SNG) ? right.fval : right.dval;
-    double r;
-    int is_relational = 0;
+    double a = (left->type == VT_SNG) ? left->fval : left->dval;
+    double b = (right->type == VT_SNG) ? right->fval : right->dval;
 
-    switch (op) {
-    case TOK_PLUS:  r = gw_fadd(a, b); break;
-    case TOK_MINUS: r = gw_fsub(a, b); break;
-    case TOK_MUL:   r = gw_fmul(a, b); break;
-    case TOK_DIV:   r = gw_fdiv(a, b); break;
-    case TOK_POW:   r = gw_fpow(a, b); break;
-    case TOK_GT:    result.type = VT_INT; result.ival = a > b ? -1 : 0; is_relational = 1; break;
-    case TOK_EQ:    result.type = VT_INT; result.ival = a == b ? -1 : 0; is_relational = 1; break;
-    case TOK_LT:    result.type = VT_INT; result.ival = a < b ? -1 : 0; is_relational = 1; break;
-    default: gw_error(ERR_SN); r = 0;
-    }
-
-    if (!is_relational) {
-        if (left.type == VT_DBL || right.type == VT_DBL) {
+    if (op == TOK_POW) {
+        double r = gw_fpow(a, b);
+        if (left->type == VT_DBL) {
             result.type = VT_DBL;
             result.dval = r;
         } else {
             result.type = VT_SNG;
             result.fval = (float)r;
+            check_fp(result.fval);
         }
+        return result;
     }
+
+    /* Mixed SINGLE/DOUBLE have been promoted; use the matching kernel */
+    bool ok = left->type == VT_DBL ? binop_dbl(op, a, b, &result)
+                                   : binop_sng(op, a, b, &result);
+    if (!ok)
+        gw_error(ERR_SN);
     return result;
 }
 
-/* Combined relational: handle >=, <=, <> as combined tokens */
-static int try_combined_relational(uint8_t first, gw_value_t left, gw_value_t *result)
-{
-    uint8_t *save = gw.text_ptr;
-    gw_skip_spaces();
-    uint8_t next = gw_chrgot();
-
-    if (first == TOK_LT && next == TOK_GT) {
-        /* <> (not equal) */
-        gw.text_ptr++;  /* consume '>' */
-        gw_value_t right = eval_expr(65);
-        *result = apply_binop(TOK_EQ, left, right);
-        result->ival = ~result->ival;
-        return 1;
-    }
-    if (first == TOK_LT && next == TOK_EQ) {
-        /* <= */
-        gw.text_ptr++;
-        gw_value_t right = eval_expr(65);
-        gw_value_t gt_result = apply_binop(TOK_GT, left, right);
-        result->type = VT_INT;
-        result->ival = ~gt_result.ival;
-        return 1;
-    }
-    if (first == TOK_GT && next == TOK_EQ) {
-        /* >= */
-        gw.text_ptr++;
-        gw_value_t right = eval_expr(65);
-        gw_value_t lt_result = apply_binop(TOK_LT, left, right);
-        result->type = VT_INT;
-        result->ival = ~lt_result.ival;
-        return 1;
-    }
-    if (first == TOK_EQ && (next == TOK_LT || next == TOK_GT)) {
-        /* =< or => (unusual but valid) */
-        gw.text_ptr++;
-        gw_value_t right = eval_expr(65);
-        if (next == TOK_LT) {
-            gw_value_t gt_result = apply_binop(TOK_GT, left, right);
-            result->type = VT_INT;
-            result->ival = ~gt_result.ival;
-        } else {
-            gw_value_t lt_result = apply_binop(TOK_LT, left, right);
-            result->type = VT_INT;
-            result->ival = ~lt_result.ival;
-        }
-        return 1;
-    }
+/* ================================================================
+ * Operator precedence loop
+ * ================================================================ */
 
-    /* Not a combined relational, put back */
-    gw.text_ptr = save;
-    return 0;
+/* Operator stack entry kinds */
+enum {
+    EV_BINOP,       /* binary operator; right operand binds above prec */
+    EV_NEG,         /* unary minus; operand is a single (prefixed) atom */
+    EV_POS,         /* unary plus */
+    EV_NOT,         /* NOT; operand takes operators of precedence >= 50 */
+    EV_PAREN        /* ( waiting for its ) */
+};
+
+static void push_op(uint8_t kind, uint8_t op, uint8_t prec, bool negate)
+{
+    if (gw.eval_osp >= EVAL_STACK_MAX)
+        gw_error(ERR_OM);
+    eval_op_t *e = &gw.eval_ops[gw.eval_osp++];
+    e->kind = kind;
+    e->op = op;
+    e->prec = prec;
+    e->negate = negate;
 }
 
-/* Main expression evaluator entry point */
-static gw_value_t eval_expr(int min_prec)
+static void push_value(const gw_value_t *v)
 {
-    gw_value_t left = eval_unary();
+    if (gw.eval_vsp >= EVAL_STACK_MAX)
+        gw_error(ERR_OM);
+    gw.eval_vals[gw.eval_vsp++] = *v;
+}
 
-    for (;;) {
-        gw_skip_spaces();
-        uint8_t tok = gw_chrgot();
+/* Lowest operator precedence the pending operation lets through */
+static int op_min_prec(const eval_op_t *e)
+{
+    switch (e->kind) {
+    case EV_BINOP: return e->prec + 1;
+    case EV_NOT:   return 50;
+    case EV_PAREN: return 0;
+    default:       return 1000;     /* unary +/- bind to the atom only */
+    }
+}
 
-        int prec = op_prec(tok);
-        if (prec < min_prec)
-            break;
+/* Apply the pending operation e to the top of the operand stack */
+static void reduce(const eval_op_t *e)
+{
+    gw_value_t *v = &gw.eval_vals[gw.eval_vsp - 1];
+
+    switch (e->kind) {
+    case EV_BINOP: {
+        gw_value_t right = *v;
+        v--;
+        gw.eval_vsp--;
+        *v = apply_binop(e->op, v, &right);
+        if (e->negate)
+            v->ival = ~v->ival;
+        break;
+    }
+    case EV_NEG:
+        if (v->type == VT_STR) gw_error(ERR_TM);
+        if (v->type == VT_INT)
+            v->ival = gw_int_neg(v->ival);
+        else if (v->type == VT_SNG)
+            v->fval = -v->fval;
+        else
+            v->dval = -v->dval;
+        break;
+    case EV_POS:
+        if (v->type == VT_STR) gw_error(ERR_TM);
+        break;
+    case EV_NOT: {
+        int16_t i = gw_to_int(v);
+        v->type = VT_INT;
+        v->ival = ~i;
+        break;
+    }
+    }
+}
 
-        gw_chrget();  /* consume operator */
+/* Operator stack kind for a prefix token, -1 if it starts an atom */
+static int prefix_kind(uint8_t tok)
+{
+    switch (tok) {
+    case TOK_MINUS: return EV_NEG;
+    case TOK_PLUS:  return EV_POS;
+    case TOK_NOT:   return EV_NOT;
+    case '(':       return EV_PAREN;
+    default:        return -1;
+    }
+}
 
-        /* Handle combined relationals like >=, <=, <> */
-        if (tok == TOK_GT || tok == TOK_LT || tok == TOK_EQ) {
-            gw_value_t combined;
-            if (try_combined_relational(tok, left, &combined)) {
-                left = combined;
-                continue;
-            }
-        }
+/* Called with gw.text_ptr just past the relational operator *tok.
+ * <>, <=, >=, =< and => are written as two tokens and evaluated as the
+ * complement of =, > or <: consume the second token, change *tok to
+ * the base operator and return true. */
+static bool combine_relational(uint8_t *tok)
+{
+    if (*tok != TOK_GT && *tok != TOK_LT && *tok != TOK_EQ)
+        return false;
 
-        gw_value_t right = eval_expr(prec + 1);
-        left = apply_binop(tok, left, right);
+    uint8_t *save = gw.text_ptr;
+    gw_skip_spaces();
+    uint8_t next = *gw.text_ptr;
+    if (*tok == TOK_LT && next == TOK_GT) {
+        *tok = TOK_EQ;
+    } else if ((*tok == TOK_LT && next == TOK_EQ)
+               || (*tok == TOK_EQ && next == TOK_LT)) {
+        *tok = TOK_GT;
+    } else if ((*tok == TOK_GT && next == TOK_EQ)
+               || (*tok == TOK_EQ && next == TOK_GT)) {
+        *tok = TOK_LT;
+    } else {
+        gw.text_ptr = save;
+        return false;
     }
-
-    return left;
+    gw.text_ptr++;
+    return true;
 }
 
-/* Unary operators: NOT, unary +, unary - */
-static gw_value_t eval_unary(void)
+/* Evaluate one expression from gw.text_ptr. Each token is looked at
+ * once: prefix operators and '(' are pushed, atoms are evaluated onto
+ * the operand stack, and before a binary operator is pushed every
+ * pending operation that binds at least as tightly is applied. This is
+ * the same grouping as precedence climbing: a binary operator's right
+ * operand takes operators of higher precedence only, NOT's operand
+ * takes those of precedence 50 and up, and unary +/- take a single
+ * atom (so -2^2 is 4). Nested evaluations, e.g. function arguments,
+ * use the stacks above the caller's entries. */
+static gw_value_t eval_expr(void)
 {
-    gw_skip_spaces();
-    uint8_t tok = gw_chrgot();
+    int vbase = gw.eval_vsp;
+    int obase = gw.eval_osp;
 
-    if (tok == TOK_MINUS) {
-        gw_chrget();
-        gw_value_t v = eval_unary();
-        if (v.type == VT_STR) gw_error(ERR_TM);
-        if (v.type == VT_INT) {
-            v.ival = gw_int_neg(v.ival);
-        } else if (v.type == VT_SNG) {
-            v.fval = -v.fval;
-        } else {
-            v.dval = -v.dval;
+    for (;;) {
+        /* Operand: prefix operators, then an atom */
+        for (;;) {
+            gw_skip_spaces();
+            uint8_t tok = *gw.text_ptr;
+            int kind = prefix_kind(tok);
+            if (kind < 0) {
+                gw_value_t v = eval_atom();
+                push_value(&v);
+                break;
+            }
+            push_op((uint8_t)kind, tok, 0, false);
+            gw.text_ptr++;
         }
-        return v;
-    }
 
-    if (tok == TOK_PLUS) {
-        gw_chrget();
-        gw_value_t v = eval_unary();
-        if (v.type == VT_STR) gw_error(ERR_TM);
-        return v;
-    }
+        /* Operators: close parentheses and apply pending operations
+         * until the next operator can be pushed or the expression ends */
+        uint8_t tok;
+        int prec;
+        for (;;) {
+            gw_skip_spaces();
+            tok = *gw.text_ptr;
+            prec = op_prec(tok);
 
-    if (tok == TOK_NOT) {
-        gw_chrget();
-        gw_value_t v = eval_expr(50);
-        int16_t i = gw_to_int(&v);
-        gw_value_t result;
-        result.type = VT_INT;
-        result.ival = ~i;
-        return result;
-    }
+            if (gw.eval_osp == obase) {
+                if (prec < 0) {
+                    gw.eval_vsp = vbase;
+                    return gw.eval_vals[vbase];
+                }
+                break;
+            }
 
-    return eval_atom();
-}
+            eval_op_t *top = &gw.eval_ops[gw.eval_osp - 1];
+            if (prec >= op_min_prec(top))
+                break;
+            if (top->kind == EV_PAREN) {
+                if (tok != ')')
+                    gw_error(ERR_SN);
+                gw.text_ptr++;
+                gw.eval_osp--;
+                continue;
+            }
+            gw.eval_osp--;
+            reduce(top);
+        }
 
-/* Parse a parenthesized expression */
-static gw_value_t eval_paren(void)
-{
-    gw_chrget();  /* skip '(' */
-    gw_value_t v = eval_expr(0);
-    gw_skip_spaces();
-    if (gw_chrgot() != ')')
-        gw_error(ERR_SN);
-    gw_chrget();  /* skip ')' */
-    return v;
+        gw.text_ptr++;
+        bool negate = combine_relational(&tok);
+        push_op(EV_BINOP, tok, (uint8_t)prec, negate);
+    }
 }
 
 /* Parse a numeric literal from token stream */
@@ -356,6 +486,13 @@ static gw_value_t eval_number(void)
         return v;
     }
 
+    /* Folded constant (0x1D followed by a 2-byte pool index) */
+    if (tok == TOK_CONST_FOLD) {
+        v = gw_fold_const(gw.text_ptr + 1);
+        gw.text_ptr += 3;
+        return v;
+    }
+
     /* Double precision constant (0x1F followed by 8 data bytes) */
     if (tok == TOK_CONST_DBL) {
         gw.text_ptr++;
@@ -397,243 +534,236 @@ static gw_value_t eval_string_literal(void)
     return v;
 }
 
-/* Evaluate built-in functions (0xFF prefix) */
-static gw_value_t eval_function(uint8_t prefix, uint8_t func_tok)
+/* ================================================================
+ * Built-in functions with plain value arguments
+ * ================================================================ */
+
+/* Argument kinds, checked as gw_eval_num, gw_eval_str and gw_eval_int
+ * check their results */
+enum { ARG_NUM = 1, ARG_STR, ARG_INT };
+
+typedef struct {
+    uint8_t nargs;      /* required arguments; 0: the list is optional */
+    uint8_t maxargs;
+    uint8_t kind[3];
+} fn_sig_t;
+
+static const fn_sig_t sig_num = { 1, 1, { ARG_NUM } };
+static const fn_sig_t sig_str = { 1, 1, { ARG_STR } };
+static const fn_sig_t sig_int = { 1, 1, { ARG_INT } };
+static const fn_sig_t sig_str_int = { 2, 2, { ARG_STR, ARG_INT } };
+static const fn_sig_t sig_mid = { 2, 3, { ARG_STR, ARG_INT, ARG_INT } };
+static const fn_sig_t sig_rnd = { 0, 1, { ARG_NUM } };
+
+/* Signature of a function computed by call_builtin, NULL for the
+ * functions that parse their own arguments */
+static const fn_sig_t *builtin_sig(uint8_t prefix, uint8_t func)
 {
-    gw_value_t v, arg;
-    int n;
+    if (prefix == TOK_PREFIX_FD) {
+        switch (func) {
+        case XFUNC_CVI:
+        case XFUNC_CVS:
+        case XFUNC_CVD:  return &sig_str;
+        case XFUNC_MKI:  return &sig_int;
+        case XFUNC_MKS:
+        case XFUNC_MKD:  return &sig_num;
+        default:         return NULL;
+        }
+    }
 
-    /* Most functions: FUNCNAME(expr) */
-    switch (func_tok) {
-    /* Numeric -> Numeric functions */
+    switch (func) {
     case FUNC_SGN:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_INT;
-        v.ival = (int16_t)gw_sgn(gw_to_dbl(&arg));
-        return v;
-
     case FUNC_INT:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = (arg.type == VT_DBL) ? VT_DBL : VT_SNG;
-        if (v.type == VT_DBL) v.dval = gw_int_fn(arg.dval);
-        else v.fval = (float)gw_int_fn(gw_to_dbl(&arg));
-        return v;
-
     case FUNC_ABS:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = arg.type;
-        if (arg.type == VT_INT) v.ival = arg.ival < 0 ? gw_int_neg(arg.ival) : arg.ival;
-        else if (arg.type == VT_SNG) v.fval = (float)gw_abs(arg.fval);
-        else v.dval = gw_abs(arg.dval);
-        return v;
-
     case FUNC_SQR:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_DBL;
-        v.dval = gw_sqr(gw_to_dbl(&arg));
-        if (arg.type != VT_DBL) { v.type = VT_SNG; v.fval = (float)v.dval; }
-        return v;
-
     case FUNC_SIN:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_DBL;
-        v.dval = gw_sin(gw_to_dbl(&arg));
-        if (arg.type != VT_DBL) { v.type = VT_SNG; v.fval = (float)v.dval; }
-        return v;
-
     case FUNC_COS:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_DBL;
-        v.dval = gw_cos(gw_to_dbl(&arg));
-        if (arg.type != VT_DBL) { v.type = VT_SNG; v.fval = (float)v.dval; }
-        return v;
-
     case FUNC_TAN:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_DBL;
-        v.dval = gw_tan(gw_to_dbl(&arg));
-        if (arg.type != VT_DBL) { v.type = VT_SNG; v.fval = (float)v.dval; }
-        return v;
-
     case FUNC_ATN:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_DBL;
-        v.dval = gw_atn(gw_to_dbl(&arg));
-        if (arg.type != VT_DBL) { v.type = VT_SNG; v.fval = (float)v.dval; }
-        return v;
-
     case FUNC_LOG:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_DBL;
-        v.dval = gw_log(gw_to_dbl(&arg));
-        if (arg.type != VT_DBL) { v.type = VT_SNG; v.fval = (float)v.dval; }
-        return v;
-
     case FUNC_EXP:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_DBL;
-        v.dval = gw_exp(gw_to_dbl(&arg));
-        if (arg.type != VT_DBL) { v.type = VT_SNG; v.fval = (float)v.dval; }
-        return v;
+    case FUNC_FIX:
+    case FUNC_CINT:
+    case FUNC_CSNG:
+    case FUNC_CDBL:
+    case FUNC_STR:   return &sig_num;
+    case FUNC_LEN:
+    case FUNC_ASC:
+    case FUNC_VAL:   return &sig_str;
+    case FUNC_CHR:
+    case FUNC_SPACE:
+    case FUNC_HEX:
+    case FUNC_OCT:   return &sig_int;
+    case FUNC_LEFT:
+    case FUNC_RIGHT: return &sig_str_int;
+    case FUNC_MID:   return &sig_mid;
+    case FUNC_RND:   return &sig_rnd;
+    default:         return NULL;
+    }
+}
+
+/* Type check (and for ARG_INT, convert) an evaluated argument */
+static void check_arg(uint8_t kind, gw_value_t *v)
+{
+    if (kind == ARG_STR) {
+        if (v->type != VT_STR)
+            gw_error(ERR_TM);
+        return;
+    }
+    if (v->type == VT_STR)
+        gw_error(ERR_TM);
+    if (kind == ARG_INT) {
+        v->ival = gw_to_int(v);
+        v->type = VT_INT;
+    }
+}
 
-    case FUNC_RND: {
-        double rnd_arg = 1.0;
+/* Parse "(arg, ...)" for a signature; returns the argument count */
+static int parse_args(const fn_sig_t *sig, gw_value_t *args)
+{
+    int n = 0;
+    if (sig->nargs == 0) {
         gw_skip_spaces();
-        if (gw_chrgot() == '(') {
-            gw_chrget();
-            arg = gw_eval_num();
-            gw_expect_rparen();
-            rnd_arg = gw_to_dbl(&arg);
-        }
+        if (gw_chrgot() != '(')
+            return 0;
+    }
+    gw_expect('(');
+    for (;;) {
+        args[n] = gw_eval();
+        check_arg(sig->kind[n], &args[n]);
+        if (++n == sig->maxargs)
+            break;
+        gw_skip_spaces();
+        if (n >= sig->nargs && gw_chrgot() != ',')
+            break;
+        gw_expect(',');
+    }
+    gw_expect_rparen();
+    return n;
+}
+
+/* Result of a single-precision function computed in double */
+static gw_value_t float_result(double r, const gw_value_t *arg)
+{
+    gw_value_t v;
+    if (arg->type == VT_DBL) {
+        v.type = VT_DBL;
+        v.dval = r;
+    } else {
         v.type = VT_SNG;
-        v.fval = (float)gw_rnd(rnd_arg);
-        return v;
+        v.fval = (float)r;
     }
+    return v;
+}
 
-    case FUNC_FIX:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = arg.type;
-        if (arg.type == VT_INT) v.ival = arg.ival;
-        else if (arg.type == VT_SNG) v.fval = (float)gw_fix(arg.fval);
-        else v.dval = gw_fix(arg.dval);
-        return v;
+/* Compute a function with a signature from its checked arguments */
+static gw_value_t call_builtin(uint8_t prefix, uint8_t func,
+                               gw_value_t *a, int nargs)
+{
+    gw_value_t v;
 
-    case FUNC_CINT:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
+    if (prefix == TOK_PREFIX_FD) {
+        switch (func) {
+        case XFUNC_CVI: return gw_fn_cvi(&a[0]);
+        case XFUNC_CVS: return gw_fn_cvs(&a[0]);
+        case XFUNC_CVD: return gw_fn_cvd(&a[0]);
+        case XFUNC_MKI: return gw_fn_mki(a[0].ival);
+        case XFUNC_MKS: return gw_fn_mks(gw_to_sng(&a[0]));
+        default:        return gw_fn_mkd(gw_to_dbl(&a[0]));
+        }
+    }
+
+    switch (func) {
+    /* Numeric -> Numeric functions */
+    case FUNC_SGN:
         v.type = VT_INT;
-        v.ival = gw_cint(gw_to_dbl(&arg));
+        v.ival = (int16_t)gw_sgn(gw_to_dbl(&a[0]));
         return v;
 
-    case FUNC_CSNG:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_SNG;
-        v.fval = gw_csng(gw_to_dbl(&arg));
+    case FUNC_INT:
+        v.type = (a[0].type == VT_DBL) ? VT_DBL : VT_SNG;
+        if (v.type == VT_DBL) v.dval = gw_int_fn(a[0].dval);
+        else v.fval = (float)gw_int_fn(gw_to_dbl(&a[0]));
         return v;
 
-    case FUNC_CDBL:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        v.type = VT_DBL;
-        v.dval = gw_cdbl(&arg);
+    case FUNC_ABS:
+        v.type = a[0].type;
+        if (a[0].type == VT_INT) v.ival = a[0].ival < 0 ? gw_int_neg(a[0].ival) : a[0].ival;
+        else if (a[0].type == VT_SNG) v.fval = (float)gw_abs(a[0].fval);
+        else v.dval = gw_abs(a[0].dval);
         return v;
 
-    /* String functions */
-    case FUNC_LEN:
-        gw_expect('(');
-        arg = gw_eval_str();
-        gw_expect_rparen();
-        return gw_fn_len(&arg);
-
-    case FUNC_ASC:
-        gw_expect('(');
-        arg = gw_eval_str();
-        gw_expect_rparen();
-        return gw_fn_asc(&arg);
+    case FUNC_SQR: return float_result(gw_sqr(gw_to_dbl(&a[0])), &a[0]);
+    case FUNC_SIN: return float_result(gw_sin(gw_to_dbl(&a[0])), &a[0]);
+    case FUNC_COS: return float_result(gw_cos(gw_to_dbl(&a[0])), &a[0]);
+    case FUNC_TAN: return float_result(gw_tan(gw_to_dbl(&a[0])), &a[0]);
+    case FUNC_ATN: return float_result(gw_atn(gw_to_dbl(&a[0])), &a[0]);
+    case FUNC_LOG: return float_result(gw_log(gw_to_dbl(&a[0])), &a[0]);
+    case FUNC_EXP: return float_result(gw_exp(gw_to_dbl(&a[0])), &a[0]);
 
-    case FUNC_CHR:
-        gw_expect('(');
-        n = gw_eval_int();
-        gw_expect_rparen();
-        return gw_fn_chr(n);
-
-    case FUNC_VAL:
-        gw_expect('(');
-        arg = gw_eval_str();
-        gw_expect_rparen();
-        return gw_fn_val(&arg);
+    case FUNC_RND:
+        v.type = VT_SNG;
+        v.fval = (float)gw_rnd(nargs ? gw_to_dbl(&a[0]) : 1.0);
+        return v;
 
-    case FUNC_STR:
-        gw_expect('(');
-        arg = gw_eval_num();
-        gw_expect_rparen();
-        return gw_fn_str(&arg);
+    case FUNC_FIX:
+        v.type = a[0].type;
+        if (a[0].type == VT_INT) v.ival = a[0].ival;
+        else if (a[0].type == VT_SNG) v.fval = (float)gw_fix(a[0].fval);
+        else v.dval = gw_fix(a[0].dval);
+        return v;
 
-    case FUNC_SPACE:
-        gw_expect('(');
-        n = gw_eval_int();
-        gw_expect_rparen();
-        return gw_fn_space(n);
+    case FUNC_CINT:
+        v.type = VT_INT;
+        v.ival = gw_cint(gw_to_dbl(&a[0]));
+        return v;
 
-    case FUNC_LEFT:
-    {
-        gw_expect('(');
-        gw_value_t s = gw_eval_str();
-        gw_skip_spaces();
-        gw_expect(',');
-        n = gw_eval_int();
-        gw_expect_rparen();
-        return gw_fn_left(&s, n);
-    }
+    case FUNC_CSNG:
+        v.type = VT_SNG;
+        v.fval = gw_csng(gw_to_dbl(&a[0]));
+        return v;
 
-    case FUNC_RIGHT:
-    {
-        gw_expect('(');
-        gw_value_t s = gw_eval_str();
-        gw_skip_spaces();
-        gw_expect(',');
-        n = gw_eval_int();
-        gw_expect_rparen();
-        return gw_fn_right(&s, n);
-    }
+    case FUNC_CDBL:
+        v.type = VT_DBL;
+        v.dval = gw_cdbl(&a[0]);
+        return v;
 
-    case FUNC_MID:
-    {
-        gw_expect('(');
-        gw_value_t s = gw_eval_str();
-        gw_skip_spaces();
-        gw_expect(',');
-        int start = gw_eval_int();
-        int len = -1;
-        gw_skip_spaces();
-        if (gw_chrgot() == ',') {
-            gw_chrget();
-            len = gw_eval_int();
-        }
-        gw_expect_rparen();
+    /* String functions */
+    case FUNC_LEN:   return gw_fn_len(&a[0]);
+    case FUNC_ASC:   return gw_fn_asc(&a[0]);
+    case FUNC_CHR:   return gw_fn_chr(a[0].ival);
+    case FUNC_VAL:   return gw_fn_val(&a[0]);
+    case FUNC_STR:   return gw_fn_str(&a[0]);
+    case FUNC_SPACE: return gw_fn_space(a[0].ival);
+    case FUNC_LEFT:  return gw_fn_left(&a[0], a[1].ival);
+    case FUNC_RIGHT: return gw_fn_right(&a[0], a[1].ival);
+    case FUNC_MID: {
+        int len = nargs > 2 ? a[2].ival : -1;
         if (len < 0)
             len = 255;  /* default: rest of string */
-        return gw_fn_mid(&s, start, len);
+        return gw_fn_mid(&a[0], a[1].ival, len);
+    }
+    case FUNC_HEX:   return gw_fn_hex(a[0].ival);
+    default:         return gw_fn_oct(a[0].ival);
     }
+}
 
-    case FUNC_HEX:
-        gw_expect('(');
-        n = gw_eval_int();
-        gw_expect_rparen();
-        return gw_fn_hex(n);
+/* Evaluate built-in functions (0xFF prefix, and 0xFD for CVI etc.) */
+static gw_value_t eval_function(uint8_t prefix, uint8_t func_tok)
+{
+    gw_value_t v, arg;
 
-    case FUNC_OCT:
-        gw_expect('(');
-        n = gw_eval_int();
-        gw_expect_rparen();
-        return gw_fn_oct(n);
+    const fn_sig_t *sig = builtin_sig(prefix, func_tok);
+    if (sig) {
+        gw_value_t args[3];
+        int n = parse_args(sig, args);
+        return call_builtin(prefix, func_tok, args, n);
+    }
+    if (prefix != TOK_PREFIX_FF)
+        gw_error(ERR_SN);
 
+    /* Functions that parse their own arguments */
+    switch (func_tok) {
     case FUNC_FRE:
         gw_expect('(');
         arg = gw_eval();  /* can be string or numeric */
@@ -679,14 +809,10 @@ static gw_value_t eval_function(uint8_t prefix, uint8_t func_tok)
         /* LOC and LOF: return approximate values */
         file_entry_t *lf = gw_file_get(fnum);
         v.type = VT_SNG;
-        if (func_tok == FUNC_LOF) {
-            long cur = ftell(lf->fp);
-            fseek(lf->fp, 0, SEEK_END);
-            v.fval = (float)ftell(lf->fp);
-            fseek(lf->fp, cur, SEEK_SET);
-        } else {
-            v.fval = (float)(ftell(lf->fp) / 128 + 1);
-        }
+        if (func_tok == FUNC_LOF)
+            v.fval = (float)gw_file_lof(lf);
+        else
+            v.fval = (float)gw_file_loc(lf);
         return v;
     }
 
@@ -710,16 +836,12 @@ static gw_value_t eval_function(uint8_t prefix, uint8_t func_tok)
     }
 }
 
-/* Atom: number, string, function, or parenthesized expression */
+/* Atom: number, string, function or variable (the caller has skipped
+ * blanks and handles parentheses) */
 static gw_value_t eval_atom(void)
 {
-    gw_skip_spaces();
     uint8_t tok = gw_chrgot();
 
-    /* Parenthesized expression */
-    if (tok == '(')
-        return eval_paren();
-
     /* String literal */
     if (tok == '"')
         return eval_string_literal();
@@ -741,54 +863,7 @@ static gw_value_t eval_atom(void)
         gw_chrget();
         uint8_t func = gw_chrgot();
         gw_chrget();
-
-        switch (func) {
-        case XFUNC_CVI:
-        {
-            gw_expect('(');
-            gw_value_t arg = gw_eval_str();
-            gw_expect_rparen();
-            return gw_fn_cvi(&arg);
-        }
-        case XFUNC_CVS:
-        {
-            gw_expect('(');
-            gw_value_t arg = gw_eval_str();
-            gw_expect_rparen();
-            return gw_fn_cvs(&arg);
-        }
-        case XFUNC_CVD:
-        {
-            gw_expect('(');
-            gw_value_t arg = gw_eval_str();
-            gw_expect_rparen();
-            return gw_fn_cvd(&arg);
-        }
-        case XFUNC_MKI:
-        {
-            gw_expect('(');
-            int16_t n = gw_eval_int();
-            gw_expect_rparen();
-            return gw_fn_mki(n);
-        }
-        case XFUNC_MKS:
-        {
-            gw_expect('(');
-            gw_value_t arg = gw_eval_num();
-            gw_expect_rparen();
-            return gw_fn_mks(gw_to_sng(&arg));
-        }
-        case XFUNC_MKD:
-        {
-            gw_expect('(');
-            gw_value_t arg = gw_eval_num();
-            gw_expect_rparen();
-            return gw_fn_mkd(gw_to_dbl(&arg));
-        }
-        default:
-            gw_error(ERR_SN);
-            break;
-        }
+        return eval_function(TOK_PREFIX_FD, func);
     }
 
     /* STRING$ function (single-byte token but acts like function) */
@@ -856,11 +931,17 @@ static gw_value_t eval_atom(void)
     if (tok == TOK_POINT) {
         gw_chrget();
         gw_expect('(');
-        int px = gw_eval_int();
+        gw_value_t v = gw_eval_num();
+        double px = gw_to_dbl(&v);
         gw_expect(',');
-        int py = gw_eval_int();
+        v = gw_eval_num();
+        double py = gw_to_dbl(&v);
         gw_expect_rparen();
-        gw_value_t v;
+        /* Pixel coordinates must fit an INTEGER */
+        if (!gfx_window_active()) {
+            px = gw_cint(px);
+            py = gw_cint(py);
+        }
         v.type = VT_INT;
         v.ival = gfx_point(px, py);
         return v;
@@ -919,7 +1000,7 @@ static gw_value_t eval_atom(void)
             if (filenum > 0) {
                 file_entry_t *fe = gw_file_get(filenum);
                 for (int i = 0; i < n; i++) {
-                    int ch = fgetc(fe->fp);
+                    int ch = gw_file_getc(fe);
                     if (ch == EOF) { v.sval.len = i; break; }
                     v.sval.data[i] = ch;
                 }
@@ -932,7 +1013,8 @@ static gw_value_t eval_atom(void)
         gw.text_ptr = save;
     }
 
-    /* Extended statement tokens that work as functions (DATE$, TIME$, TIMER) */
+    /* Extended statement tokens that work as functions (DATE$, TIME$,
+     * TIMER, PMAP, PLAY) */
     if (tok == TOK_PREFIX_FE) {
         uint8_t *save = gw.text_ptr;
         gw_chrget();
@@ -964,6 +1046,32 @@ static gw_value_t eval_atom(void)
             v.fval = (float)(tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec);
             return v;
         }
+        /* PLAY(n): notes left in the background music queue */
+        if (xtok == XSTMT_PLAY) {
+            gw_chrget();
+            gw_expect('(');
+            gw_eval_num();
+            gw_expect_rparen();
+            gw_value_t v;
+            v.type = VT_INT;
+            v.ival = (int16_t)snd_queued();
+            return v;
+        }
+        /* PMAP(coord, fn): world to physical and back */
+        if (xtok == XSTMT_PMAP) {
+            gw_chrget();
+            gw_expect('(');
+            gw_value_t v = gw_eval_num();
+            double c = gw_to_dbl(&v);
+            gw_expect(',');
+            int fn = gw_eval_int();
+            gw_expect_rparen();
+            if (fn < 0 || fn > 3 || !gfx_active())
+                gw_error(ERR_FC);
+            v.type = VT_SNG;
+            v.fval = (float)gfx_pmap(c, fn);
+            return v;
+        }
         gw.text_ptr = save;
     }
 
@@ -1007,15 +1115,622 @@ static gw_value_t eval_atom(void)
     return dummy;
 }
 
+/* ================================================================
+ * Expression cache
+ * ================================================================ */
+
+/*
+ * The first evaluation of an expression in a program line compiles it
+ * to postfix steps kept with the line, keyed by the expression's offset
+ * in the line's tokens; later evaluations run the steps instead of
+ * parsing the text again. The steps hold no pointers: variables and
+ * arrays are looked up by name on first use and their slot is kept,
+ * constants (folded ones included) are decoded once, and string
+ * literals refer to the line text. FN calls are steps too: the body is
+ * itself an expression of the DEF FN line and is cached there. An
+ * expression the compiler does not handle (INKEY$, INPUT$, STRING$,
+ * device functions, ...) or that does not parse is recorded as such and
+ * always evaluated from the text.
+ *
+ * Each step carries the text position the parser would be at when it
+ * performs the same operation, so an error leaves gw.text_ptr where
+ * RESUME and RESUME NEXT expect it.
+ *
+ * A line's cache is freed with the line. CLEAR, RUN, ERASE, DEFtype and
+ * RENUM, which move variables and arrays or change how names are typed,
+ * bump a generation count that discards every cache.
+ */
+
+/* Step kinds */
+enum {
+    EN_CONST,       /* arg: constant index */
+    EN_STRLIT,      /* arg: text offset, op: length */
+    EN_VAR,         /* name, op: type */
+    EN_ARRAY,       /* name, op: type, aux: subscript count */
+    EN_ERL,
+    EN_ERR,
+    EN_ARG,         /* op: ARG_* check on the top value */
+    EN_FUNC,        /* op: function token, aux: prefix, arg: arg count */
+    EN_FNCHECK,     /* op: FN index; Undefined user function if not DEFd */
+    EN_FNCALL,      /* op: FN index, aux: argument present,
+                       arg: operators the parser holds at the call */
+    EN_BINOP,       /* op: operator token, aux: negate */
+    EN_UNARY        /* aux: EV_NEG, EV_POS or EV_NOT */
+};
+
+typedef struct {
+    uint8_t kind;
+    uint8_t op;
+    uint8_t aux;
+    char name[2];
+    int16_t slot;       /* variable or array index, -1 until first use */
+    uint16_t arg;
+    uint16_t pos;       /* text offset when the parser does this step */
+} expr_node_t;
+
+#define EXPR_UNCACHED 0xFFFF
+
+typedef struct {
+    uint16_t offset;    /* expression start in the line's tokens */
+    uint16_t end;       /* text offset after the expression */
+    uint16_t first;     /* first step, EXPR_UNCACHED if not compiled */
+    uint16_t count;
+    uint16_t opeak;     /* most operators the parser would hold */
+    uint16_t vpeak;     /* most values the steps hold */
+} expr_entry_t;
+
+struct expr_cache {
+    uint32_t gen;
+    int hint;           /* where to start looking for the next entry */
+    int nentries, entry_cap;
+    expr_entry_t *entries;
+    int nnodes, node_cap;
+    expr_node_t *nodes;
+    int nconsts, const_cap;
+    gw_value_t *consts;
+};
+
+static bool cache_enabled = true;
+static uint32_t cache_gen;
+static unsigned long cache_evals, cache_hits, cache_compiled, cache_uncached;
+
+void gw_eval_set_cache(bool enable)
+{
+    cache_enabled = enable;
+}
+
+void gw_eval_invalidate(void)
+{
+    cache_gen++;
+}
+
+void gw_eval_free_cache(program_line_t *line)
+{
+    struct expr_cache *c = line->ecache;
+    if (!c)
+        return;
+    free(c->entries);
+    free(c->nodes);
+    free(c->consts);
+    free(c);
+    line->ecache = NULL;
+}
+
+void gw_eval_report(void)
+{
+    if (cache_evals == 0)
+        return;
+    fprintf(stderr, "expression cache: %lu evaluations, %lu hits (%.1f%%), "
+            "%lu compiled, %lu not cacheable\n",
+            cache_evals, cache_hits, 100.0 * cache_hits / cache_evals,
+            cache_compiled, cache_uncached);
+}
+
+/* Grow one of the cache arrays; false if it cannot */
+static bool grow(void **arr, int *cap, size_t size)
+{
+    int n = *cap ? *cap * 2 : 16;
+    if (n > EXPR_UNCACHED)
+        return false;
+    void *p = realloc(*arr, n * size);
+    if (!p)
+        return false;
+    *arr = p;
+    *cap = n;
+    return true;
+}
+
+/* ---------------- Compiler ---------------- */
+
+/* Mirrors eval_expr and eval_atom token for token, but emits steps
+ * instead of evaluating. gw_error_catch is pointed at fail, so a parse
+ * error anywhere (gw_expect etc.) abandons the compilation. */
+typedef struct {
+    struct expr_cache *c;
+    program_line_t *line;
+    jmp_buf fail;
+    eval_op_t ops[EVAL_STACK_MAX];
+    int osp, opeak;
+} compiler_t;
+
+static void abandon(compiler_t *cc)
+{
+    longjmp(cc->fail, 1);
+}
+
+static expr_node_t *emit(compiler_t *cc, uint8_t kind, uint8_t op)
+{
+    struct expr_cache *c = cc->c;
+    if (c->nnodes == c->node_cap
+        && !grow((void **)&c->nodes, &c->node_cap, sizeof(expr_node_t)))
+        abandon(cc);
+    expr_node_t *n = &c->nodes[c->nnodes++];
+    n->kind = kind;
+    n->op = op;
+    n->aux = 0;
+    n->name[0] = n->name[1] = 0;
+    n->slot = -1;
+    n->arg = 0;
+    n->pos = (uint16_t)(gw.text_ptr - cc->line->tokens);
+    return n;
+}
+
+static void compile_expr(compiler_t *cc);
+
+/* Arguments as parse_args reads them; returns the count */
+static int compile_args(compiler_t *cc, const fn_sig_t *sig)
+{
+    int n = 0;
+    if (sig->nargs == 0) {
+        gw_skip_spaces();
+        if (gw_chrgot() != '(')
+            return 0;
+    }
+    gw_expect('(');
+    for (;;) {
+        compile_expr(cc);
+        emit(cc, EN_ARG, sig->kind[n]);
+        if (++n == sig->maxargs)
+            break;
+        gw_skip_spaces();
+        if (n >= sig->nargs && gw_chrgot() != ',')
+            break;
+        gw_expect(',');
+    }
+    gw_expect_rparen();
+    return n;
+}
+
+static void compile_atom(compiler_t *cc)
+{
+    uint8_t tok = gw_chrgot();
+
+    if (tok == '"') {
+        gw.text_ptr++;
+        uint8_t *start = gw.text_ptr;
+        while (*gw.text_ptr && *gw.text_ptr != '"')
+            gw.text_ptr++;
+        if (gw.text_ptr - start > 255)
+            abandon(cc);
+        expr_node_t *n = emit(cc, EN_STRLIT, (uint8_t)(gw.text_ptr - start));
+        n->arg = (uint16_t)(start - cc->line->tokens);
+        if (*gw.text_ptr == '"')
+            gw.text_ptr++;
+        return;
+    }
+
+    if ((tok >= 0x11 && tok <= 0x1A) || tok == TOK_INT1 || tok == TOK_INT2
+        || tok == TOK_CONST_SNG || tok == TOK_CONST_FOLD
+        || tok == TOK_CONST_DBL) {
+        struct expr_cache *c = cc->c;
+        if (c->nconsts == c->const_cap
+            && !grow((void **)&c->consts, &c->const_cap, sizeof(gw_value_t)))
+            abandon(cc);
+        c->consts[c->nconsts] = eval_number();
+        emit(cc, EN_CONST, 0)->arg = (uint16_t)c->nconsts++;
+        return;
+    }
+
+    if (tok == TOK_PREFIX_FF || tok == TOK_PREFIX_FD) {
+        gw_chrget();
+        uint8_t func = gw_chrgot();
+        gw_chrget();
+        const fn_sig_t *sig = builtin_sig(tok, func);
+        if (!sig)
+            abandon(cc);
+        int nargs = compile_args(cc, sig);
+        expr_node_t *n = emit(cc, EN_FUNC, func);
+        n->aux = tok;
+        n->arg = (uint16_t)nargs;
+        return;
+    }
+
+    if (tok == TOK_ERL || tok == TOK_ERR) {
+        gw_chrget();
+        emit(cc, tok == TOK_ERL ? EN_ERL : EN_ERR, 0);
+        return;
+    }
+
+    if (tok == TOK_FN) {
+        /* Name and argument as gw_eval_fn_call reads them */
+        gw_chrget();
+        gw_skip_spaces();
+        if (!gw_is_letter(gw_chrgot()))
+            abandon(cc);
+        uint8_t fn_idx = (uint8_t)(toupper(gw_chrgot()) - 'A');
+        gw_chrget();
+        while (gw_is_letter(gw_chrgot()) || gw_is_digit(gw_chrgot()))
+            gw_chrget();
+        if (gw_chrgot() == '%' || gw_chrgot() == '!' ||
+            gw_chrgot() == '#' || gw_chrgot() == '$')
+            gw_chrget();
+        emit(cc, EN_FNCHECK, fn_idx);
+
+        bool has_arg = false;
+        gw_skip_spaces();
+        if (gw_chrgot() == '(') {
+            gw_chrget();
+            compile_expr(cc);
+            gw_expect_rparen();
+            has_arg = true;
+        }
+        expr_node_t *n = emit(cc, EN_FNCALL, fn_idx);
+        n->aux = has_arg;
+        n->arg = (uint16_t)cc->osp;
+        return;
+    }
+
+    if (!gw_is_letter(tok))
+        abandon(cc);
+
+    char name[2];
+    gw_valtype_t type = gw_parse_varname(name);
+    expr_node_t *n;
+    gw_skip_spaces();
+    if (gw_chrgot() == '(') {
+        /* Subscripts as gw_array_element reads them */
+        gw_expect('(');
+        int nsubs = 0;
+        for (;;) {
+            if (nsubs >= 8)
+                abandon(cc);
+            compile_expr(cc);
+            emit(cc, EN_ARG, ARG_INT);
+            nsubs++;
+            gw_skip_spaces();
+            if (gw_chrgot() != ',')
+                break;
+            gw_chrget();
+        }
+        gw_expect_rparen();
+        n = emit(cc, EN_ARRAY, (uint8_t)type);
+        n->aux = (uint8_t)nsubs;
+    } else {
+        n = emit(cc, EN_VAR, (uint8_t)type);
+    }
+    n->name[0] = name[0];
+    n->name[1] = name[1];
+}
+
+static void compile_push(compiler_t *cc, uint8_t kind, uint8_t op,
+                         uint8_t prec, bool negate)
+{
+    if (cc->osp >= EVAL_STACK_MAX)
+        abandon(cc);
+    eval_op_t *e = &cc->ops[cc->osp++];
+    if (cc->osp > cc->opeak)
+        cc->opeak = cc->osp;
+    e->kind = kind;
+    e->op = op;
+    e->prec = prec;
+    e->negate = negate;
+}
+
+/* Emit the step for a pending operation (reduce at run time) */
+static void compile_reduce(compiler_t *cc, const eval_op_t *e)
+{
+    if (e->kind == EV_BINOP)
+        emit(cc, EN_BINOP, e->op)->aux = e->negate;
+    else
+        emit(cc, EN_UNARY, e->op)->aux = e->kind;
+}
+
+static void compile_expr(compiler_t *cc)
+{
+    int obase = cc->osp;
+
+    for (;;) {
+        for (;;) {
+            gw_skip_spaces();
+            uint8_t tok = *gw.text_ptr;
+            int kind = prefix_kind(tok);
+            if (kind < 0) {
+                compile_atom(cc);
+                break;
+            }
+            compile_push(cc, (uint8_t)kind, tok, 0, false);
+            gw.text_ptr++;
+        }
+
+        uint8_t tok;
+        int prec;
+        for (;;) {
+            gw_skip_spaces();
+            tok = *gw.text_ptr;
+            prec = op_prec(tok);
+
+            if (cc->osp == obase) {
+                if (prec < 0)
+                    return;
+                break;
+            }
+
+            eval_op_t *top = &cc->ops[cc->osp - 1];
+            if (prec >= op_min_prec(top))
+                break;
+            cc->osp--;
+            if (top->kind == EV_PAREN) {
+                if (tok != ')')
+                    abandon(cc);
+                gw.text_ptr++;
+                continue;
+            }
+            compile_reduce(cc, top);
+        }
+
+        gw.text_ptr++;
+        bool negate = combine_relational(&tok);
+        compile_push(cc, EV_BINOP, tok, (uint8_t)prec, negate);
+    }
+}
+
+/* Most values on the stack at once while an entry's steps run */
+static uint16_t value_peak(const struct expr_cache *c, const expr_entry_t *e)
+{
+    int depth = 0, peak = 0;
+    for (int i = e->first; i < e->first + e->count; i++) {
+        const expr_node_t *n = &c->nodes[i];
+        switch (n->kind) {
+        case EN_ARRAY:  depth -= n->aux; break;
+        case EN_FUNC:   depth -= n->arg; break;
+        case EN_FNCALL: depth -= n->aux; break;
+        case EN_BINOP:  depth -= 2; break;
+        case EN_ARG: case EN_FNCHECK: case EN_UNARY: continue;
+        }
+        if (++depth > peak)
+            peak = depth;
+    }
+    return (uint16_t)peak;
+}
+
+/* Compile the expression at gw.text_ptr into a new entry. The entry is
+ * marked uncached if the compiler gives up; NULL if out of memory. */
+static expr_entry_t *compile_entry(struct expr_cache *c, program_line_t *line,
+                                   uint16_t offset)
+{
+    if (c->nentries == c->entry_cap
+        && !grow((void **)&c->entries, &c->entry_cap, sizeof(expr_entry_t)))
+        return NULL;
+
+    compiler_t cc;
+    cc.c = c;
+    cc.line = line;
+    cc.osp = cc.opeak = 0;
+
+    expr_entry_t *e = &c->entries[c->nentries++];
+    e->offset = offset;
+    e->first = (uint16_t)c->nnodes;
+    int nconsts = c->nconsts;
+    uint8_t *save = gw.text_ptr;
+    jmp_buf *save_catch = gw_error_catch;
+    gw_error_catch = &cc.fail;
+
+    if (setjmp(cc.fail) == 0) {
+        compile_expr(&cc);
+        e->count = (uint16_t)(c->nnodes - e->first);
+        e->end = (uint16_t)(gw.text_ptr - line->tokens);
+        e->opeak = (uint16_t)cc.opeak;
+        e->vpeak = value_peak(c, e);
+        cache_compiled++;
+    } else {
+        c->nnodes = e->first;
+        c->nconsts = nconsts;
+        e->first = EXPR_UNCACHED;
+        e->count = 0;
+        e->end = 0;
+        cache_uncached++;
+    }
+
+    gw_error_catch = save_catch;
+    gw.text_ptr = save;
+    c->hint = c->nentries;
+    return e;
+}
+
+/* ---------------- Execution ---------------- */
+
+/* Run an entry's steps. An FN body may be compiled into this same cache
+ * while the steps run, moving the arrays, so steps are addressed by
+ * index and the entry is copied first. */
+static gw_value_t run_entry(struct expr_cache *c, expr_entry_t e,
+                            program_line_t *line)
+{
+    int vbase = gw.eval_vsp;
+    uint8_t *text = line->tokens;
+    gw_value_t v;
+
+    for (int i = e.first; i < e.first + e.count; i++) {
+        expr_node_t *n = &c->nodes[i];
+        gw.text_ptr = text + n->pos;
+        switch (n->kind) {
+        case EN_CONST:
+            push_value(&c->consts[n->arg]);
+            break;
+
+        case EN_STRLIT:
+            v.type = VT_STR;
+            v.sval = gw_str_alloc(n->op);
+            memcpy(v.sval.data, text + n->arg, n->op);
+            push_value(&v);
+            break;
+
+        case EN_VAR: {
+            if (n->slot < 0)
+                n->slot = (int16_t)(gw_var_find_or_create(n->name, n->op)
+                                    - gw.vars);
+            gw_value_t *src = &gw.vars[n->slot].val;
+            v = *src;
+            if (v.type == VT_STR && v.sval.data)
+                v.sval = gw_str_copy(&src->sval);
+            push_value(&v);
+            break;
+        }
+
+        case EN_ARRAY: {
+            int subs[8];
+            int nsubs = n->aux;
+            gw.eval_vsp -= nsubs;
+            for (int i = 0; i < nsubs; i++)
+                subs[i] = gw.eval_vals[gw.eval_vsp + i].ival;
+            if (n->slot < 0)
+                n->slot = (int16_t)(gw_array_get(n->name, n->op, nsubs)
+                                    - gw.arrays);
+            gw_value_t *src = gw_array_at(&gw.arrays[n->slot], subs, nsubs);
+            v = *src;
+            if (v.type == VT_STR && v.sval.data)
+                v.sval = gw_str_copy(&src->sval);
+            push_value(&v);
+            break;
+        }
+
+        case EN_ERL:
+            v.type = VT_INT;
+            v.ival = gw.err_line_num;
+            push_value(&v);
+            break;
+
+        case EN_ERR:
+            v.type = VT_INT;
+            v.ival = gw_errno;
+            push_value(&v);
+            break;
+
+        case EN_ARG:
+            check_arg(n->op, &gw.eval_vals[gw.eval_vsp - 1]);
+            break;
+
+        case EN_FUNC:
+            gw.eval_vsp -= n->arg;
+            v = call_builtin(n->aux, n->op, &gw.eval_vals[gw.eval_vsp], n->arg);
+            push_value(&v);
+            break;
+
+        case EN_FNCHECK:
+            if (!gw.fn_defs[n->op].defined)
+                gw_error(ERR_UF);
+            break;
+
+        case EN_FNCALL: {
+            /* The call may move c->nodes; n is not valid after it */
+            int osp = n->arg, has_arg = n->aux;
+            gw_value_t arg = {0};
+            if (has_arg)
+                arg = gw.eval_vals[--gw.eval_vsp];
+            /* The body sees the operator stack as the parser leaves it */
+            gw.eval_osp += osp;
+            v = gw_fn_invoke(&gw.fn_defs[n->op], &arg, has_arg);
+            gw.eval_osp -= osp;
+            push_value(&v);
+            break;
+        }
+
+        default: {
+            eval_op_t op;
+            op.kind = n->kind == EN_BINOP ? EV_BINOP : n->aux;
+            op.op = n->op;
+            op.prec = 0;
+            op.negate = n->kind == EN_BINOP && n->aux;
+            reduce(&op);
+            break;
+        }
+        }
+    }
+
+    gw.text_ptr = text + e.end;
+    gw.eval_vsp = vbase;
+    return gw.eval_vals[vbase];
+}
+
+/* Evaluate the expression at gw.text_ptr, through the current line's
+ * cache when the text is in a program line */
+static gw_value_t eval_cached(void)
+{
+    program_line_t *line = gw.cur_line;
+    if (!cache_enabled || !line || gw.text_ptr < line->tokens
+        || gw.text_ptr >= line->tokens + line->len)
+        return eval_expr();
+
+    struct expr_cache *c = line->ecache;
+    if (!c) {
+        c = calloc(1, sizeof(struct expr_cache));
+        if (!c)
+            return eval_expr();
+        c->gen = cache_gen;
+        line->ecache = c;
+    } else if (c->gen != cache_gen) {
+        c->gen = cache_gen;
+        c->hint = c->nentries = c->nnodes = c->nconsts = 0;
+    }
+
+    uint16_t offset = (uint16_t)(gw.text_ptr - line->tokens);
+    cache_evals++;
+
+    /* Expressions in a line are usually evaluated in order, so start
+     * looking after the last one used */
+    expr_entry_t *e = NULL;
+    for (int k = 0; k < c->nentries; k++) {
+        int i = c->hint + k;
+        if (i >= c->nentries)
+            i -= c->nentries;
+        if (c->entries[i].offset == offset) {
+            e = &c->entries[i];
+            c->hint = i + 1;
+            break;
+        }
+    }
+
+    if (e) {
+        if (e->first == EXPR_UNCACHED)
+            return eval_expr();
+        cache_hits++;
+    } else {
+        e = compile_entry(c, line, offset);
+        if (!e || e->first == EXPR_UNCACHED)
+            return eval_expr();
+    }
+
+    /* Near the stack limits, let the parser run out of room exactly
+     * where it always has */
+    if (gw.eval_osp + e->opeak > EVAL_STACK_MAX
+        || gw.eval_vsp + e->vpeak > EVAL_STACK_MAX)
+        return eval_expr();
+    return run_entry(c, *e, line);
+}
+
 /* Public API */
 gw_value_t gw_eval(void)
 {
-    return eval_expr(0);
+    return eval_cached();
+}
+
+gw_value_t gw_eval_binop(uint8_t op, gw_value_t left, gw_value_t right)
+{
+    return apply_binop(op, &left, &right);
 }
 
 gw_value_t gw_eval_num(void)
 {
-    gw_value_t v = eval_expr(0);
+    gw_value_t v = eval_cached();
     if (v.type == VT_STR)
         gw_error(ERR_TM);
     return v;
@@ -1023,7 +1738,7 @@ gw_value_t gw_eval_num(void)
 
 gw_value_t gw_eval_str(void)
 {
-    gw_value_t v = eval_expr(0);
+    gw_value_t v = eval_cached();
     if (v.type != VT_STR)
         gw_error(ERR_TM);
     return v;
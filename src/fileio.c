@@ -2,6 +2,378 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Default stdio buffer for sequential files; --iobuf overrides it */
+#define FILE_BUFSIZE_DEFAULT (64 * 1024)
+#define FILE_BUFSIZE_MIN     512
+#define REC_BUF_INITIAL      256
+#define OUT_STAGE_SIZE       4096
+
+static size_t file_bufsize = FILE_BUFSIZE_DEFAULT;
+static bool file_mmap = false;
+
+void gw_file_set_bufsize(size_t size)
+{
+    file_bufsize = size < FILE_BUFSIZE_MIN ? FILE_BUFSIZE_MIN : size;
+}
+
+void gw_file_set_mmap(bool enable)
+{
+    file_mmap = enable;
+}
+
+/* ================================================================
+ * Memory-mapped random files
+ *
+ * With --mmap, a random file is mapped shared and GET/PUT become
+ * memcpy to and from the mapping. The file is extended on disk to the
+ * mapped size and cut back to its logical size when it is closed or
+ * when the program stops; after a stop it carries on through stdio.
+ * ================================================================ */
+
+#ifdef HAVE_MMAP
+#define MAP_CAP_MIN (64 * 1024)
+
+static bool map_open(file_entry_t *f)
+{
+    int fd = fileno(f->fp);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    size_t size = (size_t)st.st_size;
+    size_t cap = size < MAP_CAP_MIN ? MAP_CAP_MIN : size;
+    if (ftruncate(fd, (off_t)cap) != 0)
+        return false;
+    void *m = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        int rc = ftruncate(fd, (off_t)size);
+        (void)rc;
+        return false;
+    }
+    f->map = m;
+    f->map_cap = cap;
+    f->rnd_size = size;
+    f->rnd_pos = 0;
+    return true;
+}
+
+/* Write the mapping back, unmap it and trim the file to its logical
+ * size; the entry carries on as an ordinary stdio file */
+static void map_close(file_entry_t *f)
+{
+    msync(f->map, f->map_cap, MS_SYNC);
+    munmap(f->map, f->map_cap);
+    int rc = ftruncate(fileno(f->fp), (off_t)f->rnd_size);
+    (void)rc;
+    fseek(f->fp, (long)f->rnd_pos, SEEK_SET);
+    f->map = NULL;
+    f->map_cap = 0;
+}
+
+/* Grow the mapping (geometrically) so that `need` bytes fit */
+static void map_reserve(file_entry_t *f, size_t need)
+{
+    if (need <= f->map_cap)
+        return;
+    size_t cap = f->map_cap * 2;
+    while (cap < need)
+        cap *= 2;
+    int fd = fileno(f->fp);
+    msync(f->map, f->map_cap, MS_ASYNC);
+    munmap(f->map, f->map_cap);
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, (off_t)cap) == 0)
+        m = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        /* Fall back to stdio for the rest of this file's life */
+        int rc = ftruncate(fd, (off_t)f->rnd_size);
+        (void)rc;
+        fseek(f->fp, (long)f->rnd_pos, SEEK_SET);
+        f->map = NULL;
+        f->map_cap = 0;
+        gw_error(ERR_DF);
+    }
+    f->map = m;
+    f->map_cap = cap;
+}
+#endif
+
+/* ================================================================
+ * Random-file record cache
+ *
+ * Without --mmap, each random file keeps an LRU cache of records.
+ * PUT only marks a record dirty; dirty records are written back in
+ * record order, one seek per run of consecutive records, on CLOSE,
+ * RESET, eviction and program end. A miss during sequential access
+ * reads several records ahead with a single fread.
+ * ================================================================ */
+
+#define CACHE_RECORDS_DEFAULT 256
+#define READAHEAD_MAX         32
+
+typedef struct {
+    long rec;               /* 0-based record number, -1 = free */
+    int hnext;              /* hash chain */
+    int prev, next;         /* LRU list, head = most recently used */
+    bool dirty;
+} cache_slot_t;
+
+typedef struct record_cache {
+    int nslots;
+    int reclen;
+    int hmask;
+    int *hash;
+    cache_slot_t *slots;
+    uint8_t *data;          /* nslots * reclen bytes */
+    int head, tail;         /* LRU ends */
+    int nfree;              /* slots never used yet */
+    struct dirty_ref { long rec; int slot; } *order;
+    uint8_t *ra_buf;        /* read-ahead staging, ra_max records */
+    int ra_max;
+    long last_rec;
+    int seq_run;            /* consecutive sequential accesses */
+    unsigned long hits, misses, readaheads, runs, written;
+} record_cache_t;
+
+static int file_cache_records = CACHE_RECORDS_DEFAULT;
+
+void gw_file_set_cache(int records)
+{
+    file_cache_records = records < 0 ? 0 : records;
+}
+
+static record_cache_t *cache_create(int nslots, int reclen)
+{
+    record_cache_t *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    int hsize = 1;
+    while (hsize < nslots * 2) hsize <<= 1;
+    c->nslots = nslots;
+    c->reclen = reclen;
+    c->hmask = hsize - 1;
+    c->ra_max = nslots / 2 < READAHEAD_MAX ? nslots / 2 : READAHEAD_MAX;
+    if (c->ra_max < 1) c->ra_max = 1;
+    c->hash = malloc(hsize * sizeof(int));
+    c->slots = malloc(nslots * sizeof(cache_slot_t));
+    c->data = malloc((size_t)nslots * reclen);
+    c->order = malloc(nslots * sizeof(*c->order));
+    c->ra_buf = malloc((size_t)c->ra_max * reclen);
+    if (!c->hash || !c->slots || !c->data || !c->order || !c->ra_buf) {
+        free(c->hash); free(c->slots); free(c->data);
+        free(c->order); free(c->ra_buf); free(c);
+        return NULL;
+    }
+    for (int i = 0; i < hsize; i++)
+        c->hash[i] = -1;
+    c->head = c->tail = -1;
+    c->nfree = nslots;
+    c->last_rec = -2;
+    return c;
+}
+
+static void cache_destroy(record_cache_t *c)
+{
+    free(c->hash); free(c->slots); free(c->data);
+    free(c->order); free(c->ra_buf); free(c);
+}
+
+static inline int cache_bucket(record_cache_t *c, long rec)
+{
+    return (int)((unsigned long)rec * 2654435761u) & c->hmask;
+}
+
+static inline uint8_t *cache_data(record_cache_t *c, int slot)
+{
+    return c->data + (size_t)slot * c->reclen;
+}
+
+static int cache_find(record_cache_t *c, long rec)
+{
+    for (int i = c->hash[cache_bucket(c, rec)]; i >= 0; i = c->slots[i].hnext)
+        if (c->slots[i].rec == rec)
+            return i;
+    return -1;
+}
+
+static void lru_unlink(record_cache_t *c, int i)
+{
+    cache_slot_t *s = &c->slots[i];
+    if (s->prev >= 0) c->slots[s->prev].next = s->next; else c->head = s->next;
+    if (s->next >= 0) c->slots[s->next].prev = s->prev; else c->tail = s->prev;
+}
+
+static void lru_push_front(record_cache_t *c, int i)
+{
+    cache_slot_t *s = &c->slots[i];
+    s->prev = -1;
+    s->next = c->head;
+    if (c->head >= 0) c->slots[c->head].prev = i;
+    c->head = i;
+    if (c->tail < 0) c->tail = i;
+}
+
+static void lru_touch(record_cache_t *c, int i)
+{
+    if (c->head == i) return;
+    lru_unlink(c, i);
+    lru_push_front(c, i);
+}
+
+static int cmp_dirty_ref(const void *a, const void *b)
+{
+    long ra = ((const struct dirty_ref *)a)->rec;
+    long rb = ((const struct dirty_ref *)b)->rec;
+    return (ra > rb) - (ra < rb);
+}
+
+/* Write every dirty record back, sorted, one seek per consecutive run */
+static void cache_flush(file_entry_t *f)
+{
+    record_cache_t *c = f->rcache;
+    int n = 0;
+    for (int i = c->head; i >= 0; i = c->slots[i].next) {
+        if (c->slots[i].dirty) {
+            c->order[n].rec = c->slots[i].rec;
+            c->order[n].slot = i;
+            n++;
+        }
+    }
+    if (n == 0) return;
+    qsort(c->order, n, sizeof(*c->order), cmp_dirty_ref);
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || c->order[i].rec != c->order[i - 1].rec + 1) {
+            fseek(f->fp, c->order[i].rec * c->reclen, SEEK_SET);
+            c->runs++;
+        }
+        fwrite(cache_data(c, c->order[i].slot), 1, c->reclen, f->fp);
+        c->slots[c->order[i].slot].dirty = false;
+    }
+    c->written += n;
+}
+
+/* Claim a slot for `rec`, evicting the least recently used record if
+ * needed. Evicting a dirty record writes back all dirty records. */
+static int cache_claim(file_entry_t *f, long rec)
+{
+    record_cache_t *c = f->rcache;
+    int i;
+    if (c->nfree > 0) {
+        i = c->nslots - c->nfree--;
+    } else {
+        i = c->tail;
+        if (c->slots[i].dirty)
+            cache_flush(f);
+        lru_unlink(c, i);
+        int *pp = &c->hash[cache_bucket(c, c->slots[i].rec)];
+        while (*pp != i) pp = &c->slots[*pp].hnext;
+        *pp = c->slots[i].hnext;
+    }
+    int b = cache_bucket(c, rec);
+    c->slots[i].rec = rec;
+    c->slots[i].dirty = false;
+    c->slots[i].hnext = c->hash[b];
+    c->hash[b] = i;
+    lru_push_front(c, i);
+    return i;
+}
+
+/* Note the access pattern; returns true if it continues a forward scan */
+static bool cache_note_access(record_cache_t *c, long rec)
+{
+    c->seq_run = (rec == c->last_rec + 1) ? c->seq_run + 1 : 0;
+    c->last_rec = rec;
+    return c->seq_run >= 2;
+}
+
+/* GET through the cache into field_buf; returns bytes of file data */
+static size_t cache_get(file_entry_t *f, long rec)
+{
+    record_cache_t *c = f->rcache;
+    size_t off = (size_t)rec * c->reclen;
+    bool sequential = cache_note_access(c, rec);
+
+    int i = cache_find(c, rec);
+    if (i >= 0) {
+        c->hits++;
+        lru_touch(c, i);
+        memcpy(f->field_buf, cache_data(c, i), c->reclen);
+        return off < f->rnd_size ? f->rnd_size - off : 0;
+    }
+    c->misses++;
+    if (off >= f->rnd_size) {
+        memset(f->field_buf, 0, c->reclen);
+        return 0;
+    }
+
+    /* Records past the end of what is on disk but inside the logical
+     * size read back as zeros, just as a sparse file would */
+    int want = sequential ? c->ra_max : 1;
+    for (int k = 1; k < want; k++) {
+        /* Keep cached neighbours from being evicted while the run is
+         * inserted, so the stale disk copy never replaces them */
+        int n = cache_find(c, rec + k);
+        if (n >= 0) lru_touch(c, n);
+    }
+    fseek(f->fp, (long)off, SEEK_SET);
+    size_t got = fread(c->ra_buf, 1, (size_t)want * c->reclen, f->fp);
+    size_t avail = f->rnd_size - off;
+    size_t limit = (size_t)want * c->reclen;
+    if (avail < limit) limit = avail;
+    if (got < limit)
+        memset(c->ra_buf + got, 0, limit - got);
+    int nrec = (int)((limit + c->reclen - 1) / c->reclen);
+    if (limit % c->reclen)
+        memset(c->ra_buf + limit, 0, (size_t)nrec * c->reclen - limit);
+    if (nrec > 1)
+        c->readaheads++;
+
+    for (int k = 0; k < nrec; k++) {
+        if (k > 0 && cache_find(c, rec + k) >= 0)
+            continue;       /* the cached copy is newer */
+        int s = cache_claim(f, rec + k);
+        memcpy(cache_data(c, s), c->ra_buf + (size_t)k * c->reclen, c->reclen);
+    }
+    /* Leave the requested record most recently used */
+    lru_touch(c, cache_find(c, rec));
+    memcpy(f->field_buf, c->ra_buf, c->reclen);
+    return avail;
+}
+
+/* PUT through the cache: the record only becomes dirty */
+static void cache_put(file_entry_t *f, long rec)
+{
+    record_cache_t *c = f->rcache;
+    cache_note_access(c, rec);
+    int i = cache_find(c, rec);
+    if (i >= 0) {
+        c->hits++;
+        lru_touch(c, i);
+    } else {
+        c->misses++;
+        i = cache_claim(f, rec);
+    }
+    memcpy(cache_data(c, i), f->field_buf, c->reclen);
+    c->slots[i].dirty = true;
+    size_t end = (size_t)(rec + 1) * c->reclen;
+    if (end > f->rnd_size)
+        f->rnd_size = end;
+}
+
+static void cache_report(file_entry_t *f)
+{
+    record_cache_t *c = f->rcache;
+    unsigned long total = c->hits + c->misses;
+    if (total == 0) return;
+    fprintf(stderr, "#%d record cache: %lu GET/PUT, %lu hits (%.1f%%), "
+            "%lu read-aheads, %lu records written in %lu runs\n",
+            f->file_num, total, c->hits, 100.0 * c->hits / total,
+            c->readaheads, c->written, c->runs);
+}
 
 file_entry_t *gw_file_get(int num)
 {
@@ -13,20 +385,186 @@ file_entry_t *gw_file_get(int num)
     return f;
 }
 
+/* Hand staged PRINT#/WRITE# output to stdio */
+static void out_flush(file_entry_t *f)
+{
+    if (f->out_len) {
+        fwrite(f->out_buf, 1, f->out_len, f->fp);
+        f->out_len = 0;
+    }
+}
+
+/* Room for n more bytes of output (n <= OUT_STAGE_SIZE) */
+static inline char *out_reserve(file_entry_t *f, size_t n)
+{
+    if (f->out_len + n > OUT_STAGE_SIZE)
+        out_flush(f);
+    return f->out_buf + f->out_len;
+}
+
+static void file_close(file_entry_t *f)
+{
+    if (f->out_buf) {
+        out_flush(f);
+        free(f->out_buf);
+        f->out_buf = NULL;
+    }
+    if (f->rcache) {
+        cache_flush(f);
+        if (gw.show_stats)
+            cache_report(f);
+        cache_destroy(f->rcache);
+        f->rcache = NULL;
+    }
+#ifdef HAVE_MMAP
+    if (f->map)
+        map_close(f);
+#endif
+    if (f->fp) {
+        fclose(f->fp);
+        f->fp = NULL;
+        f->mode = 0;
+        f->eof_flag = false;
+    }
+    free(f->io_buf);
+    f->io_buf = NULL;
+    free(f->rec_buf);
+    f->rec_buf = NULL;
+    f->rec_cap = f->rec_len = f->rec_pos = 0;
+    f->rnd_size = f->rnd_pos = 0;
+    f->write_pending = false;
+    free(f->field_buf);
+    f->field_buf = NULL;
+    f->field_count = 0;
+    f->record_len = 0;
+}
+
 void gw_file_close_all(void)
+{
+    for (int i = 1; i <= 15; i++)
+        file_close(&gw.files[i]);
+}
+
+/* Push buffered output to disk without closing, so SHELL and the
+ * command line see what the program has written so far */
+void gw_file_flush_all(void)
 {
     for (int i = 1; i <= 15; i++) {
-        if (gw.files[i].fp) {
-            fclose(gw.files[i].fp);
-            gw.files[i].fp = NULL;
-            gw.files[i].mode = 0;
-            gw.files[i].eof_flag = false;
+        if (!gw.files[i].fp)
+            continue;
+        if (gw.files[i].out_buf)
+            out_flush(&gw.files[i]);
+        if (gw.files[i].rcache)
+            cache_flush(&gw.files[i]);
+#ifdef HAVE_MMAP
+        /* The on-disk size must be the logical one once control
+         * leaves the program, so give up the mapping here */
+        if (gw.files[i].map)
+            map_close(&gw.files[i]);
+#endif
+        fflush(gw.files[i].fp);
+    }
+}
+
+/* ================================================================
+ * Sequential input records
+ *
+ * INPUT# and LINE INPUT# read a whole line into the file's record
+ * buffer, which grows to fit it, and parse fields in place. The
+ * 255-character limit applies only to the strings assigned from it.
+ * ================================================================ */
+
+/* ISO C needs a seek between a write and a following read on the
+ * same stream; PUT no longer flushes, so reads do it here */
+static void file_prepare_read(file_entry_t *f)
+{
+    if (f->rcache) {
+        cache_flush(f);
+        fseek(f->fp, (long)f->rnd_pos, SEEK_SET);
+        return;
+    }
+    if (f->write_pending) {
+        fseek(f->fp, 0, SEEK_CUR);
+        f->write_pending = false;
+    }
+}
+
+/* Make sure unconsumed record data is available; returns false at EOF */
+static bool record_fill(file_entry_t *f)
+{
+    if (f->rec_pos < f->rec_len)
+        return true;
+    f->rec_len = f->rec_pos = 0;
+    file_prepare_read(f);
+    for (;;) {
+        if (f->rec_cap - f->rec_len < 2) {
+            size_t cap = f->rec_cap ? f->rec_cap * 2 : REC_BUF_INITIAL;
+            char *nb = realloc(f->rec_buf, cap);
+            if (!nb) gw_error(ERR_OM);
+            f->rec_buf = nb;
+            f->rec_cap = cap;
         }
-        free(gw.files[i].field_buf);
-        gw.files[i].field_buf = NULL;
-        gw.files[i].field_count = 0;
-        gw.files[i].record_len = 0;
+        char *dst = f->rec_buf + f->rec_len;
+        if (!fgets(dst, (int)(f->rec_cap - f->rec_len), f->fp))
+            break;
+        f->rec_len += strlen(dst);
+        if (f->rec_len > 0 && f->rec_buf[f->rec_len - 1] == '\n')
+            break;
+    }
+    if (f->rcache)
+        f->rnd_pos = (size_t)ftell(f->fp);
+    return f->rec_len > 0;
+}
+
+/* Length of the current record without its CR/LF ending */
+static size_t record_content_end(file_entry_t *f)
+{
+    size_t end = f->rec_len;
+    while (end > f->rec_pos &&
+           (f->rec_buf[end - 1] == '\n' || f->rec_buf[end - 1] == '\r'))
+        end--;
+    return end;
+}
+
+/* Read one character, draining any partly consumed record first */
+int gw_file_getc(file_entry_t *f)
+{
+    if (f->rec_pos < f->rec_len)
+        return (uint8_t)f->rec_buf[f->rec_pos++];
+    if (f->map)
+        return f->rnd_pos < f->rnd_size ? f->map[f->rnd_pos++] : EOF;
+    file_prepare_read(f);
+    int ch = fgetc(f->fp);
+    if (f->rcache && ch != EOF)
+        f->rnd_pos++;
+    return ch;
+}
+
+/* LOC: last record read or written for random files, 128-byte blocks
+ * for sequential ones */
+long gw_file_loc(file_entry_t *f)
+{
+    if (f->mode == 'R') {
+        long pos = (f->map || f->rcache) ? (long)f->rnd_pos : ftell(f->fp);
+        return f->record_len > 0 ? pos / f->record_len : 0;
     }
+    return (ftell(f->fp) + (long)f->out_len) / 128 + 1;
+}
+
+/* File length in bytes (LOF) */
+long gw_file_lof(file_entry_t *f)
+{
+    if (f->map || f->rcache)
+        return (long)f->rnd_size;
+    if (f->out_buf)
+        out_flush(f);
+    fflush(f->fp);
+    f->write_pending = false;
+    long cur = ftell(f->fp);
+    fseek(f->fp, 0, SEEK_END);
+    long len = ftell(f->fp);
+    fseek(f->fp, cur, SEEK_SET);
+    return len;
 }
 
 int gw_file_eof(int num)
@@ -36,8 +574,13 @@ int gw_file_eof(int num)
     file_entry_t *f = &gw.files[num];
     if (!f->fp)
         gw_error(ERR_BN);
+    if (f->rec_pos < f->rec_len)
+        return 0;
+    if (f->map || f->rcache)
+        return (f->eof_flag || f->rnd_pos >= f->rnd_size) ? -1 : 0;
     if (f->eof_flag || feof(f->fp))
         return -1;
+    file_prepare_read(f);
     /* Peek ahead to detect EOF before next read */
     int ch = fgetc(f->fp);
     if (ch == EOF) {
@@ -161,18 +704,36 @@ void gw_stmt_open(void)
     }
 
     FILE *fp = fopen(filename, fmode);
-    if (!fp) {
-        /* For random mode, try creating if doesn't exist */
-        if (mode == 'R')
-            fp = fopen(filename, "w+");
-        if (!fp) {
-            free(filename);
-            gw_error(ERR_FF);
-        }
-    }
+    /* For random mode, try creating if doesn't exist */
+    if (!fp && mode == 'R')
+        fp = fopen(filename, "w+");
     free(filename);
+    if (!fp)
+        gw_error(ERR_FF);
+
+    /* Sequential files get a large private buffer; random files keep
+     * the stdio default since every GET/PUT seeks anyway */
+    char *io_buf = NULL;
+    if (mode != 'R') {
+        io_buf = malloc(file_bufsize);
+        if (io_buf)
+            setvbuf(fp, io_buf, _IOFBF, file_bufsize);
+    }
 
     gw.files[file_num].fp = fp;
+    gw.files[file_num].io_buf = io_buf;
+    gw.files[file_num].out_len = 0;
+    gw.files[file_num].out_buf = NULL;
+    if (mode == 'O' || mode == 'A') {
+        gw.files[file_num].out_buf = malloc(OUT_STAGE_SIZE);
+        if (!gw.files[file_num].out_buf) {
+            fclose(fp);
+            gw.files[file_num].fp = NULL;
+            free(io_buf);
+            gw.files[file_num].io_buf = NULL;
+            gw_error(ERR_OM);
+        }
+    }
     gw.files[file_num].mode = mode;
     gw.files[file_num].file_num = file_num;
     gw.files[file_num].eof_flag = false;
@@ -201,6 +762,20 @@ void gw_stmt_open(void)
     if (mode == 'R') {
         gw.files[file_num].field_buf = calloc(1, reclen);
         if (!gw.files[file_num].field_buf) gw_error(ERR_OM);
+        file_entry_t *f = &gw.files[file_num];
+#ifdef HAVE_MMAP
+        if (file_mmap)
+            map_open(f);
+#endif
+        if (!f->map && file_cache_records > 0 && reclen > 0) {
+            f->rcache = cache_create(file_cache_records, reclen);
+            if (f->rcache) {
+                fseek(fp, 0, SEEK_END);
+                f->rnd_size = (size_t)ftell(fp);
+                f->rnd_pos = 0;
+                rewind(fp);
+            }
+        }
     }
 }
 
@@ -220,16 +795,7 @@ void gw_stmt_close(void)
         int num = gw_eval_int();
         if (num < 1 || num > 15)
             gw_error(ERR_BN);
-        if (gw.files[num].fp) {
-            fclose(gw.files[num].fp);
-            gw.files[num].fp = NULL;
-            gw.files[num].mode = 0;
-            gw.files[num].eof_flag = false;
-            free(gw.files[num].field_buf);
-            gw.files[num].field_buf = NULL;
-            gw.files[num].field_count = 0;
-            gw.files[num].record_len = 0;
-        }
+        file_close(&gw.files[num]);
         gw_skip_spaces();
         if (gw_chrgot() != ',')
             break;
@@ -237,17 +803,18 @@ void gw_stmt_close(void)
     }
 }
 
-/* Helper: write a gw_value_t to a FILE* */
-static void fprint_value(FILE *fp, gw_value_t *v)
+/* Helper: stage a value for PRINT#; numbers are formatted in place */
+static void fprint_value(file_entry_t *f, gw_value_t *v)
 {
     if (v->type == VT_STR) {
-        fwrite(v->sval.data, 1, v->sval.len, fp);
+        memcpy(out_reserve(f, v->sval.len), v->sval.data, v->sval.len);
+        f->out_len += v->sval.len;
         gw_str_free(&v->sval);
     } else {
-        char buf[64];
-        gw_format_number(v, buf, sizeof(buf));
-        fputs(buf, fp);
-        fputc(' ', fp);
+        char *p = out_reserve(f, GW_NUM_TEXT_MAX + 1);
+        int n = gw_num_to_text(v, p);
+        p[n++] = ' ';
+        f->out_len += n;
     }
 }
 
@@ -270,6 +837,7 @@ void gw_stmt_print_file(void)
     gw_skip_spaces();
     if (gw_chrgot() == TOK_USING) {
         gw_chrget();
+        out_flush(f);
         gw_print_using(f->fp);
         return;
     }
@@ -291,19 +859,21 @@ void gw_stmt_print_file(void)
             gw_chrget();
             /* Tab to next 14-char zone */
             /* Tab to next zone: approximate with comma */
-            fputc(',', f->fp);
+            *out_reserve(f, 1) = ',';
+            f->out_len++;
             need_newline = 0;
             continue;
         }
 
         gw_value_t v = gw_eval();
-        fprint_value(f->fp, &v);
+        fprint_value(f, &v);
         need_newline = 1;
     }
 
-    if (need_newline)
-        fputc('\n', f->fp);
-    fflush(f->fp);
+    if (need_newline) {
+        *out_reserve(f, 1) = '\n';
+        f->out_len++;
+    }
 }
 
 /* WRITE #n, ... - CSV format with quotes around strings */
@@ -326,21 +896,28 @@ void gw_stmt_write_file(void)
         gw_skip_spaces();
         uint8_t ch = gw_chrgot();
         if (ch == 0 || ch == ':') break;
-        if (!first) fputc(',', f->fp);
+        if (!first) {
+            *out_reserve(f, 1) = ',';
+            f->out_len++;
+        }
 
         gw_value_t v = gw_eval();
         if (v.type == VT_STR) {
-            fputc('"', f->fp);
-            fwrite(v.sval.data, 1, v.sval.len, f->fp);
-            fputc('"', f->fp);
+            char *p = out_reserve(f, v.sval.len + 2);
+            *p++ = '"';
+            memcpy(p, v.sval.data, v.sval.len);
+            p[v.sval.len] = '"';
+            f->out_len += v.sval.len + 2;
             gw_str_free(&v.sval);
         } else {
-            char buf[64];
-            gw_format_number(&v, buf, sizeof(buf));
+            char *p = out_reserve(f, GW_NUM_TEXT_MAX);
+            int n = gw_num_to_text(&v, p);
             /* Strip leading space from positive numbers */
-            char *p = buf;
-            while (*p == ' ') p++;
-            fputs(p, f->fp);
+            if (*p == ' ') {
+                memmove(p, p + 1, n);
+                n--;
+            }
+            f->out_len += n;
         }
         first = 0;
 
@@ -349,8 +926,8 @@ void gw_stmt_write_file(void)
         if (gw_chrgot() == ';') { gw_chrget(); continue; }
         break;
     }
-    fputc('\n', f->fp);
-    fflush(f->fp);
+    *out_reserve(f, 1) = '\n';
+    f->out_len++;
 }
 
 /* INPUT #n, var, var... */
@@ -368,17 +945,17 @@ void gw_stmt_input_file(void)
     if (gw_chrgot() == ',')
         gw_chrget();
 
-    /* Read a line from the file */
-    char linebuf[256];
-    if (!fgets(linebuf, sizeof(linebuf), f->fp)) {
+    /* Fields are split straight out of the record buffer; the whole
+     * record is consumed by this statement */
+    if (!record_fill(f)) {
         f->eof_flag = true;
         gw_error(ERR_EF);
     }
-    int len = strlen(linebuf);
-    while (len > 0 && (linebuf[len - 1] == '\n' || linebuf[len - 1] == '\r'))
-        linebuf[--len] = '\0';
-
-    const char *p = linebuf;
+    size_t end = record_content_end(f);
+    f->rec_buf[end] = '\0';
+    const char *p = f->rec_buf + f->rec_pos;
+    const char *rec_end = f->rec_buf + end;
+    f->rec_pos = f->rec_len;
 
     for (;;) {
         gw_skip_spaces();
@@ -406,26 +983,25 @@ void gw_stmt_input_file(void)
                 p++;
                 start = p;
                 while (*p && *p != '"') p++;
-                int slen = p - start;
+                size_t slen = p - start;
+                if (slen > 255) slen = 255;
                 val.type = VT_STR;
-                val.sval = gw_str_alloc(slen);
+                val.sval = gw_str_alloc((int)slen);
                 memcpy(val.sval.data, start, slen);
                 if (*p == '"') p++;
             } else {
                 while (*p && *p != ',') p++;
-                int slen = p - start;
+                size_t slen = p - start;
                 while (slen > 0 && start[slen - 1] == ' ') slen--;
+                if (slen > 255) slen = 255;
                 val.type = VT_STR;
-                val.sval = gw_str_alloc(slen);
+                val.sval = gw_str_alloc((int)slen);
                 memcpy(val.sval.data, start, slen);
             }
         } else {
-            char *end;
-            double d = strtod(p, &end);
-            if (end == p) d = 0;
-            p = end;
-            val.type = VT_DBL;
-            val.dval = d;
+            /* A number ends at a blank, unlike VAL */
+            p = gw_scan_number(p, rec_end, false, type == VT_DBL, &val);
+            while (*p == ' ') p++;
         }
 
         if (arr_elem) {
@@ -456,7 +1032,7 @@ void gw_stmt_input_file(void)
         }
     }
 
-    if (feof(f->fp))
+    if (f->rec_pos >= f->rec_len && feof(f->fp))
         f->eof_flag = true;
 }
 
@@ -480,23 +1056,28 @@ void gw_stmt_line_input_file(void)
     if (type != VT_STR)
         gw_error(ERR_TM);
 
-    char linebuf[256];
-    if (!fgets(linebuf, sizeof(linebuf), f->fp)) {
+    if (!record_fill(f)) {
         f->eof_flag = true;
         gw_error(ERR_EF);
     }
-    int len = strlen(linebuf);
-    while (len > 0 && (linebuf[len - 1] == '\n' || linebuf[len - 1] == '\r'))
-        linebuf[--len] = '\0';
+
+    /* A line longer than a string holds is returned 255 characters at
+     * a time; the rest stays in the record for the next read */
+    size_t end = record_content_end(f);
+    size_t len = end - f->rec_pos;
+    if (len > 255)
+        len = 255;
 
     gw_value_t val;
     val.type = VT_STR;
-    val.sval = gw_str_from_cstr(linebuf);
+    val.sval = gw_str_alloc((int)len);
+    memcpy(val.sval.data, f->rec_buf + f->rec_pos, len);
+    f->rec_pos = (len == end - f->rec_pos) ? f->rec_len : f->rec_pos + len;
 
     var_entry_t *var = gw_var_find_or_create(name, type);
     gw_var_assign(var, &val);
 
-    if (feof(f->fp))
+    if (f->rec_pos >= f->rec_len && feof(f->fp))
         f->eof_flag = true;
 }
 
@@ -675,12 +1256,35 @@ void gw_stmt_put(void)
     }
 
     vars_to_field_buf(f);
+    f->rec_len = f->rec_pos = 0;
+
+#ifdef HAVE_MMAP
+    if (f->map) {
+        if (record > 0)
+            f->rnd_pos = (size_t)(record - 1) * f->record_len;
+        size_t end = f->rnd_pos + f->record_len;
+        map_reserve(f, end);
+        memcpy(f->map + f->rnd_pos, f->field_buf, f->record_len);
+        f->rnd_pos = end;
+        if (end > f->rnd_size)
+            f->rnd_size = end;
+        return;
+    }
+#endif
+
+    if (f->rcache) {
+        if (record > 0)
+            f->rnd_pos = (size_t)(record - 1) * f->record_len;
+        cache_put(f, (long)(f->rnd_pos / f->record_len));
+        f->rnd_pos += f->record_len;
+        return;
+    }
 
     if (record > 0)
         fseek(f->fp, (long)(record - 1) * f->record_len, SEEK_SET);
 
     fwrite(f->field_buf, 1, f->record_len, f->fp);
-    fflush(f->fp);
+    f->write_pending = true;
 }
 
 /* GET #n [, record] - read record from file into field buffer */
@@ -702,8 +1306,46 @@ void gw_stmt_get(void)
         if (record < 1) gw_error(ERR_RN);
     }
 
+    f->rec_len = f->rec_pos = 0;
+
+#ifdef HAVE_MMAP
+    if (f->map) {
+        if (record > 0)
+            f->rnd_pos = (size_t)(record - 1) * f->record_len;
+        size_t got = 0;
+        if (f->rnd_pos < f->rnd_size) {
+            got = f->rnd_size - f->rnd_pos;
+            if (got > (size_t)f->record_len)
+                got = f->record_len;
+            memcpy(f->field_buf, f->map + f->rnd_pos, got);
+        }
+        if (got < (size_t)f->record_len)
+            memset(f->field_buf + got, 0, f->record_len - got);
+        if (got == 0)
+            f->eof_flag = true;
+        f->rnd_pos += got;
+        field_buf_to_vars(f);
+        return;
+    }
+#endif
+
+    if (f->rcache) {
+        if (record > 0)
+            f->rnd_pos = (size_t)(record - 1) * f->record_len;
+        size_t got = cache_get(f, (long)(f->rnd_pos / f->record_len));
+        if (got == 0)
+            f->eof_flag = true;
+        else
+            f->rnd_pos += got < (size_t)f->record_len ? got : (size_t)f->record_len;
+        field_buf_to_vars(f);
+        return;
+    }
+
     if (record > 0)
         fseek(f->fp, (long)(record - 1) * f->record_len, SEEK_SET);
+    else
+        file_prepare_read(f);
+    f->write_pending = false;
 
     memset(f->field_buf, 0, f->record_len);
     size_t got = fread(f->field_buf, 1, f->record_len, f->fp);
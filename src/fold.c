@@ -0,0 +1,573 @@
+#include "gwbasic.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Constant folding at line-entry time.
+ *
+ * When a line is stored, runs of numeric constants joined by arithmetic
+ * or logical operators ("2*3.14159", "(1+2)", "-5 AND 255") are
+ * evaluated once and the span in the executable tokens is replaced by
+ * the result: an ordinary INT/SNG/DBL constant token when it fits, or
+ * TOK_CONST_FOLD with an index into the constant pool otherwise, padded
+ * with blanks to the original length. The crunched text as typed is
+ * kept in line->source so LIST, LLIST, EDIT and SAVE show what the user
+ * wrote; offsets into the executable tokens are unchanged.
+ *
+ * A span is only folded where the evaluator's precedence rules would
+ * combine exactly those operands, and only when the arithmetic completes
+ * without an error, so run-time results and error behaviour are the same
+ * as evaluating the original text.
+ */
+
+static bool fold_enabled = true;
+
+void gw_fold_set_enabled(bool enable)
+{
+    fold_enabled = enable;
+}
+
+/* ================================================================
+ * Constant pool
+ * ================================================================ */
+
+#define POOL_MAX 65535
+
+static gw_value_t *pool;
+static uint32_t pool_len, pool_cap;
+static uint16_t *pool_free;
+static uint32_t pool_nfree;
+
+/* Store v and return its index, or -1 when the pool is full */
+static int pool_add(const gw_value_t *v)
+{
+    uint32_t idx;
+    if (pool_nfree) {
+        idx = pool_free[--pool_nfree];
+    } else {
+        if (pool_len == POOL_MAX)
+            return -1;
+        if (pool_len == pool_cap) {
+            uint32_t cap = pool_cap ? pool_cap * 2 : 64;
+            if (cap > POOL_MAX)
+                cap = POOL_MAX;
+            gw_value_t *np = realloc(pool, cap * sizeof(*pool));
+            uint16_t *nf = realloc(pool_free, cap * sizeof(*pool_free));
+            if (np) pool = np;
+            if (nf) pool_free = nf;
+            if (!np || !nf)
+                return -1;
+            pool_cap = cap;
+        }
+        idx = pool_len++;
+    }
+    pool[idx] = *v;
+    return (int)idx;
+}
+
+gw_value_t gw_fold_const(const uint8_t *p)
+{
+    return pool[p[0] | (p[1] << 8)];
+}
+
+/* ================================================================
+ * Token walking
+ * ================================================================ */
+
+static bool is_const_tok(uint8_t c)
+{
+    return (c >= 0x11 && c <= 0x1A) || c == TOK_INT1 || c == TOK_INT2
+        || c == TOK_CONST_SNG || c == TOK_CONST_DBL;
+}
+
+static gw_value_t decode_const(const uint8_t *p)
+{
+    gw_value_t v;
+    v.type = VT_INT;
+    if (*p >= 0x11 && *p <= 0x1A) {
+        v.ival = *p - 0x11;
+    } else if (*p == TOK_INT1) {
+        v.ival = p[1];
+    } else if (*p == TOK_INT2) {
+        v.ival = (int16_t)(p[1] | (p[2] << 8));
+    } else if (*p == TOK_CONST_SNG) {
+        v.type = VT_SNG;
+        memcpy(&v.fval, p + 1, 4);
+    } else {
+        v.type = VT_DBL;
+        memcpy(&v.dval, p + 1, 8);
+    }
+    return v;
+}
+
+/* Value of the numeric constant token at p, folded ones included;
+ * false if p is not a constant */
+bool gw_const_value(const uint8_t *p, gw_value_t *out)
+{
+    if (*p == TOK_CONST_FOLD) {
+        *out = gw_fold_const(p + 1);
+        return true;
+    }
+    if (!is_const_tok(*p))
+        return false;
+    *out = decode_const(p);
+    return true;
+}
+
+/* Statements whose arguments are line numbers or ranges rather than
+ * expressions: their text is left exactly as entered */
+static bool is_linenum_stmt(const uint8_t *p)
+{
+    switch (*p) {
+    case TOK_GOTO: case TOK_GOSUB: case TOK_RETURN: case TOK_RESTORE:
+    case TOK_RESUME: case TOK_RUN: case TOK_LIST: case TOK_LLIST:
+    case TOK_DELETE: case TOK_AUTO: case TOK_RENUM: case TOK_EDIT:
+        return true;
+    case TOK_PREFIX_FE:
+        return p[1] == XSTMT_CHAIN;
+    default:
+        return false;
+    }
+}
+
+/* ================================================================
+ * Folding
+ * ================================================================ */
+
+enum {
+    IT_CONST,       /* numeric constant (possibly already folded) */
+    IT_OP,          /* operator token */
+    IT_OPEN,        /* ( */
+    IT_CLOSE,       /* ) */
+    IT_BOUND,       /* line start, : , ; or a keyword */
+    IT_OPERAND,     /* anything else that yields a value */
+    IT_NOT
+};
+
+typedef struct {
+    uint8_t kind;
+    uint8_t tok;        /* operator token for IT_OP */
+    uint16_t start;     /* span in the line */
+    uint16_t end;
+    uint16_t folds;     /* operations folded into an IT_CONST */
+    gw_value_t val;
+} fold_item_t;
+
+#define FOLD_ITEMS_MAX 320
+
+static fold_item_t items[FOLD_ITEMS_MAX];
+static int nitems;
+
+static int op_prec(uint8_t tok)
+{
+    switch (tok) {
+    case TOK_IMP:   return 40;
+    case TOK_EQV:   return 42;
+    case TOK_XOR:   return 44;
+    case TOK_OR:    return 46;
+    case TOK_AND:   return 48;
+    case TOK_GT:
+    case TOK_EQ:
+    case TOK_LT:    return 64;
+    case TOK_PLUS:
+    case TOK_MINUS: return 121;
+    case TOK_MOD:   return 122;
+    case TOK_IDIV:  return 123;
+    case TOK_MUL:
+    case TOK_DIV:   return 124;
+    case TOK_POW:   return 127;
+    default:        return -1;
+    }
+}
+
+#define PREC_NONE  (-1)     /* no operator binds from this side */
+#define PREC_BLOCK 1000     /* folding across this side is unsafe */
+
+/* The item before i, or NULL at line start */
+static fold_item_t *prev_item(int i)
+{
+    return i > 0 ? &items[i - 1] : NULL;
+}
+
+static bool yields_value(const fold_item_t *it)
+{
+    return it && (it->kind == IT_CONST || it->kind == IT_CLOSE
+                  || it->kind == IT_OPERAND);
+}
+
+/* A + or - with no value before it is unary */
+static bool is_unary(int i)
+{
+    return items[i].kind == IT_OP
+        && (items[i].tok == TOK_PLUS || items[i].tok == TOK_MINUS)
+        && !yields_value(prev_item(i));
+}
+
+/* How tightly the item before position i binds to its right */
+static int left_prec(int i)
+{
+    fold_item_t *p = prev_item(i);
+    if (!p || p->kind == IT_OPEN || p->kind == IT_BOUND)
+        return PREC_NONE;
+    if (p->kind == IT_NOT)
+        return 49;                      /* NOT's operand binds at 50 */
+    if (p->kind == IT_OP && !is_unary(i - 1))
+        return op_prec(p->tok);
+    return PREC_BLOCK;
+}
+
+/* How tightly the item at position i binds to its left */
+static int right_prec(int i)
+{
+    if (i >= nitems)
+        return PREC_NONE;
+    fold_item_t *n = &items[i];
+    if (n->kind == IT_CLOSE || n->kind == IT_BOUND)
+        return PREC_NONE;
+    if (n->kind == IT_OP)
+        return op_prec(n->tok);
+    return PREC_BLOCK;
+}
+
+static bool is_foldable_op(uint8_t tok)
+{
+    return tok >= TOK_PLUS && tok <= TOK_IDIV;
+}
+
+/* Evaluate l op r exactly as the evaluator would; false if that would
+ * raise an error (the error is then left to happen at run time) */
+static bool fold_binop(uint8_t op, gw_value_t l, gw_value_t r,
+                       gw_value_t *out)
+{
+    /* -32768 \ -1 and MOD -1 overflow the host's 16-bit division */
+    if (op == TOK_IDIV || op == TOK_MOD) {
+        double d = gw_to_dbl(&r);
+        if (d <= -0.5 && d > -1.5)
+            return false;
+    }
+
+    jmp_buf catch_jmp;
+    jmp_buf *saved = gw_error_catch;
+    gw_error_catch = &catch_jmp;
+    if (setjmp(catch_jmp) != 0) {
+        gw_error_catch = saved;
+        return false;
+    }
+    *out = gw_eval_binop(op, l, r);
+    gw_error_catch = saved;
+    return true;
+}
+
+static bool fold_negate(gw_value_t *v)
+{
+    switch (v->type) {
+    case VT_INT:
+        if (v->ival == -32768)
+            return false;
+        v->ival = -v->ival;
+        return true;
+    case VT_SNG: v->fval = -v->fval; return true;
+    case VT_DBL: v->dval = -v->dval; return true;
+    default:     return false;
+    }
+}
+
+static void remove_items(int at, int count)
+{
+    memmove(&items[at], &items[at + count],
+            (nitems - at - count) * sizeof(items[0]));
+    nitems -= count;
+}
+
+/* One pass of rewrites; returns true if anything changed */
+static bool fold_pass(void)
+{
+    bool changed = false;
+
+    for (int i = 0; i < nitems; i++) {
+        /* Unary sign directly before a constant */
+        if (is_unary(i) && i + 1 < nitems && items[i + 1].kind == IT_CONST) {
+            gw_value_t v = items[i + 1].val;
+            if (items[i].tok == TOK_MINUS && !fold_negate(&v))
+                continue;
+            items[i + 1].val = v;
+            items[i + 1].start = items[i].start;
+            remove_items(i, 1);
+            changed = true;
+            continue;
+        }
+
+        /* ( constant ) used as an operand */
+        if (items[i].kind == IT_OPEN && i + 2 < nitems
+            && items[i + 1].kind == IT_CONST
+            && items[i + 2].kind == IT_CLOSE) {
+            fold_item_t *p = prev_item(i);
+            if (p && (p->kind == IT_OP || p->kind == IT_OPEN
+                      || p->kind == IT_NOT)) {
+                items[i + 1].start = items[i].start;
+                items[i + 1].end = items[i + 2].end;
+                items[i + 1].folds++;
+                remove_items(i + 2, 1);
+                remove_items(i, 1);
+                changed = true;
+                continue;
+            }
+        }
+
+        /* constant op constant, where precedence groups exactly them */
+        if (items[i].kind == IT_CONST && i + 2 < nitems
+            && items[i + 1].kind == IT_OP && is_foldable_op(items[i + 1].tok)
+            && items[i + 2].kind == IT_CONST) {
+            int prec = op_prec(items[i + 1].tok);
+            if (prec > left_prec(i) && prec >= right_prec(i + 3)) {
+                gw_value_t r;
+                if (fold_binop(items[i + 1].tok, items[i].val,
+                               items[i + 2].val, &r)) {
+                    items[i].val = r;
+                    items[i].end = items[i + 2].end;
+                    items[i].folds += items[i + 2].folds + 1;
+                    remove_items(i + 1, 2);
+                    changed = true;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+static void add_item(int kind, uint8_t tok, int start, int end)
+{
+    if (nitems >= FOLD_ITEMS_MAX)
+        return;
+    fold_item_t *it = &items[nitems++];
+    it->kind = (uint8_t)kind;
+    it->tok = tok;
+    it->start = (uint16_t)start;
+    it->end = (uint16_t)end;
+    it->folds = 0;
+}
+
+/* Statements that begin with an assignment target: LET, FOR, DEF FN,
+ * DEF SEG, MID$, LSET/RSET, DATE$/TIME$ and implied LET */
+static bool starts_assignment(const uint8_t *p)
+{
+    return (*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')
+        || *p == TOK_LET || *p == TOK_FOR || *p == TOK_DEF
+        || *p == TOK_PREFIX_FE || *p == TOK_PREFIX_FF;
+}
+
+/* Split the line into items; false if it cannot be folded safely */
+static bool scan_items(const uint8_t *t, int len)
+{
+    nitems = 0;
+    add_item(IT_BOUND, 0, 0, 0);
+
+    bool at_stmt = true;        /* next token begins a statement */
+    bool assign = false;        /* first '=' at depth 0 assigns */
+    int depth = 0;
+
+    int i = 0;
+    while (i < len) {
+        uint8_t c = t[i];
+
+        if (c == ' ') {
+            i++;
+            continue;
+        }
+        if (at_stmt) {
+            assign = starts_assignment(t + i);
+            depth = 0;
+        }
+        at_stmt = c == ':' || c == TOK_THEN || c == TOK_ELSE;
+        if (c == '(')
+            depth++;
+        else if (c == ')')
+            depth--;
+        if (c == TOK_EQ && assign && depth == 0) {
+            add_item(IT_BOUND, c, i, i + 1);
+            assign = false;
+            i++;
+            continue;
+        }
+        if (c == TOK_REM || c == TOK_SQUOTE)
+            break;
+        if (c == TOK_DATA) {
+            while (i < len && t[i] != ':')
+                i++;
+            continue;
+        }
+        if (is_linenum_stmt(t + i)) {
+            while (i < len && t[i] != ':') {
+                if (t[i] == '"') {
+                    i++;
+                    while (i < len && t[i] != '"')
+                        i++;
+                    if (i < len) i++;
+                } else {
+                    i += gw_token_len(t + i);
+                }
+            }
+            continue;
+        }
+        if (c == '"') {
+            int start = i++;
+            while (i < len && t[i] != '"')
+                i++;
+            if (i < len) i++;
+            add_item(IT_OPERAND, 0, start, i);
+            continue;
+        }
+        if (is_const_tok(c)) {
+            int n = gw_token_len(t + i);
+            if (i + n > len)
+                return false;
+            /* THEN/ELSE followed by a number is a line reference */
+            fold_item_t *p = prev_item(nitems);
+            if (p && p->kind == IT_BOUND
+                && (p->tok == TOK_THEN || p->tok == TOK_ELSE)) {
+                add_item(IT_OPERAND, 0, i, i + n);
+            } else {
+                add_item(IT_CONST, 0, i, i + n);
+                items[nitems - 1].val = decode_const(t + i);
+            }
+            i += n;
+            continue;
+        }
+        if (c == TOK_CONST_FOLD)
+            return false;
+
+        int n = gw_token_len(t + i);
+        if (c == '(')
+            add_item(IT_OPEN, c, i, i + 1);
+        else if (c == ')')
+            add_item(IT_CLOSE, c, i, i + 1);
+        else if (c == ':' || c == ',' || c == ';')
+            add_item(IT_BOUND, c, i, i + 1);
+        else if (c == TOK_NOT)
+            add_item(IT_NOT, c, i, i + 1);
+        else if (op_prec(c) >= 0)
+            add_item(IT_OP, c, i, i + 1);
+        else if (c == TOK_ERL || c == TOK_ERR || c == TOK_CSRLIN
+                 || c == TOK_INKEYS || c >= TOK_PREFIX_FD)
+            add_item(IT_OPERAND, c, i, i + n);
+        else if (c >= 0x80)
+            add_item(IT_BOUND, c, i, i + 1);
+        else
+            add_item(IT_OPERAND, c, i, i + 1);
+        i += n;
+    }
+
+    if (nitems >= FOLD_ITEMS_MAX)
+        return false;
+    return true;
+}
+
+/* Encode v into dst (at most room bytes); returns the length or 0 */
+static int encode_const(const gw_value_t *v, uint8_t *dst, int room)
+{
+    if (v->type == VT_INT) {
+        int16_t n = v->ival;
+        if (n >= 0 && n <= 9) {
+            dst[0] = (uint8_t)(0x11 + n);
+            return 1;
+        }
+        if (n > 9 && n <= 255 && room >= 2) {
+            dst[0] = TOK_INT1;
+            dst[1] = (uint8_t)n;
+            return 2;
+        }
+        if (room >= 3) {
+            dst[0] = TOK_INT2;
+            dst[1] = (uint8_t)(n & 0xFF);
+            dst[2] = (uint8_t)((uint16_t)n >> 8);
+            return 3;
+        }
+        return 0;
+    }
+    if (v->type == VT_SNG && room >= 5) {
+        dst[0] = TOK_CONST_SNG;
+        memcpy(dst + 1, &v->fval, 4);
+        return 5;
+    }
+    if (v->type == VT_DBL && room >= 9) {
+        dst[0] = TOK_CONST_DBL;
+        memcpy(dst + 1, &v->dval, 8);
+        return 9;
+    }
+    return 0;
+}
+
+void gw_fold_line(program_line_t *line)
+{
+    if (!fold_enabled || line->source || line->len > FOLD_ITEMS_MAX)
+        return;
+    if (!scan_items(line->tokens, line->len))
+        return;
+    while (fold_pass())
+        ;
+
+    for (int i = 0; i < nitems; i++) {
+        fold_item_t *it = &items[i];
+        if (it->kind != IT_CONST || it->folds == 0)
+            continue;
+
+        uint8_t *dst = line->tokens + it->start;
+        int room = it->end - it->start;
+        uint8_t enc[9];
+        int n = encode_const(&it->val, enc, room);
+        if (n == 0) {
+            int idx = pool_add(&it->val);
+            if (idx < 0)
+                continue;
+            enc[0] = TOK_CONST_FOLD;
+            enc[1] = (uint8_t)(idx & 0xFF);
+            enc[2] = (uint8_t)(idx >> 8);
+            n = 3;
+        }
+
+        if (!line->source) {
+            line->source = malloc(line->len + 1);
+            if (!line->source)
+                return;
+            memcpy(line->source, line->tokens, line->len + 1);
+        }
+        memcpy(dst, enc, n);
+        memset(dst + n, ' ', room - n);
+    }
+}
+
+void gw_unfold_line(program_line_t *line)
+{
+    if (!line->source)
+        return;
+
+    /* Return the line's pool entries */
+    const uint8_t *t = line->tokens;
+    int i = 0;
+    while (i < line->len) {
+        uint8_t c = t[i];
+        if (c == TOK_REM || c == TOK_SQUOTE)
+            break;
+        if (c == TOK_CONST_FOLD) {
+            pool_free[pool_nfree++] = (uint16_t)(t[i + 1] | (t[i + 2] << 8));
+        } else if (c == TOK_DATA) {
+            while (i < line->len && t[i] != ':')
+                i++;
+            continue;
+        } else if (c == '"') {
+            i++;
+            while (i < line->len && t[i] != '"')
+                i++;
+        }
+        i += gw_token_len(t + i);
+    }
+
+    memcpy(line->tokens, line->source, line->len);
+    free(line->source);
+    line->source = NULL;
+}
+
+uint8_t *gw_line_text(program_line_t *line)
+{
+    return line->source ? line->source : line->tokens;
+}
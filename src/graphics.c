@@ -5,27 +5,115 @@
 #include <stdio.h>
 #include <math.h>
 #include <ctype.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
-static uint8_t *framebuf;
+static uint8_t *framebuf;        /* one byte per pixel in every mode */
 static int fb_width, fb_height;
+static int fb_colors;
 static int screen_mode;
 static int current_color = 1;
-static int last_x, last_y;
+static double last_x, last_y;   /* world coordinates */
 
-/* CGA default palette (RGBI) */
-static uint32_t palette[16] = {
+/*
+ * VIEW and WINDOW. Drawing is clipped to the viewport clip_x1..clip_x2,
+ * clip_y1..clip_y2 (the whole screen by default). A world point maps to
+ * the pixel rint(world * scale + off) + org, where org is the viewport
+ * corner for VIEW without SCREEN and 0 otherwise; without WINDOW the
+ * scale is 1 and off is 0. The terms are recomputed by each VIEW and
+ * WINDOW statement, so drawing pays one multiply-add per coordinate.
+ */
+static int clip_x1, clip_y1, clip_x2 = -1, clip_y2 = -1;
+static bool view_screen = true;
+static bool window_on, window_screen;
+static double win_x1, win_y1, win_x2, win_y2;
+static double scale_x = 1, scale_y = 1, off_x, off_y;
+static int org_x, org_y;
+
+/* Graphics modes: resolution, colors and default foreground */
+typedef struct {
+    int mode;
+    int width, height;
+    int colors;
+    int color;
+} gfx_mode_t;
+
+static const gfx_mode_t gfx_modes[] = {
+    {  1, 320, 200,   4,  3 },
+    {  2, 640, 200,   2,  1 },
+    {  7, 320, 200,  16, 15 },
+    {  8, 640, 200,  16, 15 },
+    {  9, 640, 350,  16, 15 },
+    { 12, 640, 480,  16, 15 },
+    { 13, 320, 200, 256, 15 },
+};
+
+/* CGA/EGA default palette (RGBI); entries 16-255 are the VGA defaults,
+ * filled in by init_palette() */
+static uint32_t palette[256] = {
     0x000000, 0x0000AA, 0x00AA00, 0x00AAAA,
     0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
     0x555555, 0x5555FF, 0x55FF55, 0x55FFFF,
     0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
 };
 
+/* VGA mode 13h palette: 16 grays, then 24 hues around the color wheel
+ * at three intensities and three saturations each, then 8 blacks */
+static void init_palette(void)
+{
+    static const uint8_t grays[16] = {
+        0, 5, 8, 11, 14, 17, 20, 24, 28, 32, 36, 40, 45, 50, 56, 63
+    };
+    /* Component levels (6-bit DAC values) from low to full, per
+     * intensity and saturation */
+    static const uint8_t levels[9][5] = {
+        { 0, 16, 31, 47, 63 }, { 31, 39, 47, 55, 63 }, { 45, 49, 54, 58, 63 },
+        { 0,  7, 14, 21, 28 }, { 14, 17, 21, 24, 28 }, { 20, 22, 24, 26, 28 },
+        { 0,  4,  8, 12, 16 }, {  8, 10, 12, 14, 16 }, { 11, 12, 13, 15, 16 },
+    };
+    /* Each hue as (r, g, b) level indices: blue to magenta to red to
+     * yellow to green to cyan and back */
+    static const uint8_t hues[24][3] = {
+        {0,0,4}, {1,0,4}, {2,0,4}, {3,0,4}, {4,0,4}, {4,0,3}, {4,0,2}, {4,0,1},
+        {4,0,0}, {4,1,0}, {4,2,0}, {4,3,0}, {4,4,0}, {3,4,0}, {2,4,0}, {1,4,0},
+        {0,4,0}, {0,4,1}, {0,4,2}, {0,4,3}, {0,4,4}, {0,3,4}, {0,2,4}, {0,1,4},
+    };
+
+    static bool done;
+    if (done)
+        return;
+    done = true;
+    for (int i = 0; i < 16; i++) {
+        uint32_t v = (grays[i] * 255 + 31) / 63;
+        palette[16 + i] = v << 16 | v << 8 | v;
+    }
+    int n = 32;
+    for (int set = 0; set < 9; set++)
+        for (int h = 0; h < 24; h++) {
+            uint32_t rgb = 0;
+            for (int k = 0; k < 3; k++)
+                rgb = rgb << 8 | (levels[set][hues[h][k]] * 255 + 31) / 63;
+            palette[n++] = rgb;
+        }
+}
+
+/* Where flushed frames go: the terminal as Sixel by default, or files */
+typedef struct {
+    void (*frame)(void);        /* after each drawing statement */
+    void (*close)(void);        /* before the framebuffer goes away */
+} gfx_sink_t;
+
+static const gfx_sink_t *sink;
+static const gfx_sink_t sixel_sink, file_sink;
+static const char *out_path, *stream_path;
+
 bool gfx_active(void) { return framebuf != NULL; }
 int  gfx_get_mode(void) { return screen_mode; }
 void gfx_set_color(int c) { current_color = c; }
 int  gfx_get_color(void) { return current_color; }
-void gfx_get_last(int *x, int *y) { *x = last_x; *y = last_y; }
-void gfx_set_last(int x, int y) { last_x = x; last_y = y; }
+void gfx_get_last(double *x, double *y) { *x = last_x; *y = last_y; }
+void gfx_set_last(double x, double y) { last_x = x; last_y = y; }
 int  gfx_get_width(void) { return fb_width; }
 int  gfx_get_height(void) { return fb_height; }
 
@@ -33,86 +121,338 @@ void gfx_init(int mode)
 {
     gfx_shutdown();
     screen_mode = mode;
-    switch (mode) {
-    case 1: fb_width = 320; fb_height = 200; break;
-    case 2: fb_width = 640; fb_height = 200; break;
-    default: return;  /* text mode, no framebuffer */
-    }
+    const gfx_mode_t *m = NULL;
+    for (size_t i = 0; i < sizeof(gfx_modes) / sizeof(gfx_modes[0]); i++)
+        if (gfx_modes[i].mode == mode)
+            m = &gfx_modes[i];
+    if (!m)
+        return;  /* text mode, no framebuffer */
+    fb_width = m->width;
+    fb_height = m->height;
+    fb_colors = m->colors;
+    if (fb_colors > 16)
+        init_palette();
     framebuf = calloc(fb_width * fb_height, 1);
-    current_color = (mode == 2) ? 1 : 3;
+    sink = out_path || stream_path ? &file_sink : &sixel_sink;
+    current_color = m->color;
     last_x = 0;
     last_y = 0;
+    gfx_view_reset();
+    gfx_window_reset();
 }
 
 void gfx_shutdown(void)
 {
+    if (framebuf && sink->close)
+        sink->close();
     free(framebuf);
     framebuf = NULL;
     fb_width = 0;
     fb_height = 0;
+    fb_colors = 0;
     screen_mode = 0;
+    gfx_view_reset();
+    gfx_window_reset();
 }
 
-void gfx_cls(void)
+static inline bool in_view(int x, int y)
 {
-    if (framebuf)
-        memset(framebuf, 0, fb_width * fb_height);
+    return x >= clip_x1 && x <= clip_x2 && y >= clip_y1 && y <= clip_y2;
 }
 
 static inline void set_pixel(int x, int y, int color)
 {
-    if (x >= 0 && x < fb_width && y >= 0 && y < fb_height)
+    if (in_view(x, y))
         framebuf[y * fb_width + x] = color;
 }
 
-static inline int get_pixel(int x, int y)
+/* Horizontal run of pixels, clipped to the viewport */
+static void hspan(int y, int xa, int xb, int color)
+{
+    if (xa > xb) { int t = xa; xa = xb; xb = t; }
+    if (y < clip_y1 || y > clip_y2 || xb < clip_x1 || xa > clip_x2) return;
+    if (xa < clip_x1) xa = clip_x1;
+    if (xb > clip_x2) xb = clip_x2;
+    memset(framebuf + (size_t)y * fb_width + xa, (uint8_t)color, xb - xa + 1);
+}
+
+/* Vertical run of pixels, clipped to the viewport */
+static void vspan(int x, int ya, int yb, int color)
+{
+    if (ya > yb) { int t = ya; ya = yb; yb = t; }
+    if (x < clip_x1 || x > clip_x2 || yb < clip_y1 || ya > clip_y2) return;
+    if (ya < clip_y1) ya = clip_y1;
+    if (yb > clip_y2) yb = clip_y2;
+    uint8_t *p = framebuf + (size_t)ya * fb_width + x;
+    for (int y = ya; y <= yb; y++, p += fb_width)
+        *p = (uint8_t)color;
+}
+
+/* Clear the viewport */
+void gfx_cls(void)
+{
+    if (!framebuf)
+        return;
+    for (int y = clip_y1; y <= clip_y2; y++)
+        hspan(y, clip_x1, clip_x2, 0);
+}
+
+/* ================================================================
+ * World to screen mapping
+ * ================================================================ */
+
+/* Round to a pixel, saturating far outside the screen. Only WINDOW
+ * coordinates get this far out; plain pixel coordinates are already
+ * range-checked by the interpreter */
+static int to_pixel(double v)
+{
+    v = rint(v);
+    if (!(v >= -32768.0))
+        return -32768;
+    if (v > 32767.0)
+        return 32767;
+    return (int)v;
+}
+
+void gfx_map(double x, double y, int *px, int *py)
+{
+    *px = to_pixel(x * scale_x + off_x) + org_x;
+    *py = to_pixel(y * scale_y + off_y) + org_y;
+}
+
+static void unmap(int px, int py, double *x, double *y)
+{
+    *x = (px - org_x - off_x) / scale_x;
+    *y = (py - org_y - off_y) / scale_y;
+}
+
+static void update_transform(void)
+{
+    org_x = view_screen ? 0 : clip_x1;
+    org_y = view_screen ? 0 : clip_y1;
+    if (!window_on) {
+        scale_x = scale_y = 1;
+        off_x = off_y = 0;
+        return;
+    }
+    scale_x = (clip_x2 - clip_x1) / (win_x2 - win_x1);
+    off_x = clip_x1 - org_x - win_x1 * scale_x;
+    if (window_screen) {
+        scale_y = (clip_y2 - clip_y1) / (win_y2 - win_y1);
+        off_y = clip_y1 - org_y - win_y1 * scale_y;
+    } else {
+        /* y grows upwards: win_y1 is the bottom of the viewport */
+        scale_y = -(clip_y2 - clip_y1) / (win_y2 - win_y1);
+        off_y = clip_y2 - org_y - win_y1 * scale_y;
+    }
+}
+
+void gfx_view_reset(void)
+{
+    clip_x1 = 0;
+    clip_y1 = 0;
+    clip_x2 = fb_width - 1;
+    clip_y2 = fb_height - 1;
+    view_screen = true;
+    update_transform();
+}
+
+/* VIEW [SCREEN] (x1,y1)-(x2,y2) [,fill [,border]]: fill and border are
+ * -1 when omitted. Fails unless the corners are on the screen. */
+bool gfx_view(int x1, int y1, int x2, int y2, bool screen,
+              int fill, int border)
+{
+    if (x1 > x2) { int t = x1; x1 = x2; x2 = t; }
+    if (y1 > y2) { int t = y1; y1 = y2; y2 = t; }
+    if (!framebuf || x1 < 0 || y1 < 0 || x2 >= fb_width || y2 >= fb_height)
+        return false;
+    if (border >= 0) {
+        /* One pixel outside the viewport, where the screen allows */
+        gfx_view_reset();
+        hspan(y1 - 1, x1 - 1, x2 + 1, border);
+        hspan(y2 + 1, x1 - 1, x2 + 1, border);
+        vspan(x1 - 1, y1, y2, border);
+        vspan(x2 + 1, y1, y2, border);
+    }
+    clip_x1 = x1;
+    clip_y1 = y1;
+    clip_x2 = x2;
+    clip_y2 = y2;
+    view_screen = screen;
+    update_transform();
+    if (fill >= 0)
+        for (int y = y1; y <= y2; y++)
+            hspan(y, x1, x2, fill);
+    return true;
+}
+
+void gfx_window_reset(void)
+{
+    window_on = false;
+    update_transform();
+}
+
+bool gfx_window_active(void)
 {
-    if (x >= 0 && x < fb_width && y >= 0 && y < fb_height)
-        return framebuf[y * fb_width + x];
-    return 0;
+    return window_on;
 }
 
-void gfx_pset(int x, int y, int color)
+/* WINDOW [SCREEN] (x1,y1)-(x2,y2); fails on an empty range */
+bool gfx_window(double x1, double y1, double x2, double y2, bool screen)
 {
-    set_pixel(x, y, color);
+    if (x1 == x2 || y1 == y2)
+        return false;
+    if (x1 > x2) { double t = x1; x1 = x2; x2 = t; }
+    if (y1 > y2) { double t = y1; y1 = y2; y2 = t; }
+    window_on = true;
+    window_screen = screen;
+    win_x1 = x1;
+    win_y1 = y1;
+    win_x2 = x2;
+    win_y2 = y2;
+    update_transform();
+    return true;
+}
+
+/* PMAP: 0 and 1 map world x and y to physical, 2 and 3 map back;
+ * physical coordinates are relative to the viewport as VIEW sets them */
+double gfx_pmap(double v, int fn)
+{
+    switch (fn) {
+    case 0:  return to_pixel(v * scale_x + off_x);
+    case 1:  return to_pixel(v * scale_y + off_y);
+    case 2:  return (v - off_x) / scale_x;
+    default: return (v - off_y) / scale_y;
+    }
+}
+
+/* ================================================================
+ * Drawing primitives
+ * ================================================================ */
+
+void gfx_pset(double x, double y, int color)
+{
+    int px, py;
+    gfx_map(x, y, &px, &py);
+    set_pixel(px, py, color);
     last_x = x;
     last_y = y;
 }
 
-int gfx_point(int x, int y)
+/* Color at a world point, or -1 outside the viewport */
+int gfx_point(double x, double y)
 {
-    return get_pixel(x, y);
+    int px, py;
+    gfx_map(x, y, &px, &py);
+    if (!framebuf || !in_view(px, py))
+        return -1;
+    return framebuf[py * fb_width + px];
 }
 
-/* Bresenham line */
+/* Cohen-Sutherland outcodes */
+enum { CLIP_LEFT = 1, CLIP_RIGHT = 2, CLIP_TOP = 4, CLIP_BOTTOM = 8 };
+
+static int outcode(int x, int y)
+{
+    int code = 0;
+    if (x < clip_x1) code |= CLIP_LEFT;
+    else if (x > clip_x2) code |= CLIP_RIGHT;
+    if (y < clip_y1) code |= CLIP_TOP;
+    else if (y > clip_y2) code |= CLIP_BOTTOM;
+    return code;
+}
+
+/* Smallest integer >= n / d, for d > 0 */
+static int64_t ceil_div(int64_t n, int64_t d)
+{
+    return n >= 0 ? (n + d - 1) / d : -((-n) / d);
+}
+
+/*
+ * Bresenham line. Step i along the major axis moves the minor axis by
+ * floor((2 i dmin + dmaj) / (2 dmaj)), which is what the usual error
+ * term produces, so a line partly off screen is drawn from the first to
+ * the last visible step only, with the same pixels it would have had
+ * unclipped. Outcodes reject lines wholly to one side of the viewport
+ * and skip the clip arithmetic for lines wholly inside it.
+ */
 static void draw_line(int x0, int y0, int x1, int y1, int color)
 {
-    int dx = abs(x1 - x0);
-    int dy = -abs(y1 - y0);
-    int sx = x0 < x1 ? 1 : -1;
-    int sy = y0 < y1 ? 1 : -1;
-    int err = dx + dy;
+    if (y0 == y1) { hspan(y0, x0, x1, color); return; }
+    if (x0 == x1) { vspan(x0, y0, y1, color); return; }
+
+    int c0 = outcode(x0, y0), c1 = outcode(x1, y1);
+    if (c0 & c1)
+        return;
+
+    int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+    int adx = abs(x1 - x0), ady = abs(y1 - y0);
+    bool xmajor = adx >= ady;
+    int64_t dmaj = xmajor ? adx : ady, dmin = xmajor ? ady : adx;
 
-    for (;;) {
-        set_pixel(x0, y0, color);
-        if (x0 == x1 && y0 == y1) break;
-        int e2 = 2 * err;
-        if (e2 >= dy) { err += dy; x0 += sx; }
-        if (e2 <= dx) { err += dx; y0 += sy; }
+    /* Range of major steps that stay in the viewport */
+    int64_t i0 = 0, i1 = dmaj;
+    if (c0 | c1) {
+        int maj0 = xmajor ? x0 : y0, min0 = xmajor ? y0 : x0;
+        int smaj = xmajor ? sx : sy, smin = xmajor ? sy : sx;
+        int maj_lo = xmajor ? clip_x1 : clip_y1, maj_hi = xmajor ? clip_x2 : clip_y2;
+        int min_lo = xmajor ? clip_y1 : clip_x1, min_hi = xmajor ? clip_y2 : clip_x2;
+
+        /* Major coordinate in [maj_lo, maj_hi] */
+        int64_t lo = smaj > 0 ? maj_lo - maj0 : maj0 - maj_hi;
+        int64_t hi = smaj > 0 ? maj_hi - maj0 : maj0 - maj_lo;
+        if (lo > i0) i0 = lo;
+        if (hi < i1) i1 = hi;
+
+        /* Minor offset floor((2 i dmin + dmaj) / (2 dmaj)) in [lo, hi] */
+        lo = smin > 0 ? min_lo - min0 : min0 - min_hi;
+        hi = smin > 0 ? min_hi - min0 : min0 - min_lo;
+        lo = ceil_div((2 * lo - 1) * dmaj, 2 * dmin);
+        hi = ceil_div((2 * hi + 1) * dmaj, 2 * dmin) - 1;
+        if (lo > i0) i0 = lo;
+        if (hi < i1) i1 = hi;
+        if (i0 > i1)
+            return;
+    }
+
+    /* Minor offset and remainder at step i0 */
+    int64_t r = 2 * i0 * dmin + dmaj;
+    int64_t m = r / (2 * dmaj);
+    r -= m * 2 * dmaj;
+
+    int step_x = sx, step_y = sy * fb_width;
+    int step_maj = xmajor ? step_x : step_y;
+    int step_min = xmajor ? step_y : step_x;
+    int64_t px = xmajor ? x0 + sx * i0 : x0 + sx * m;
+    int64_t py = xmajor ? y0 + sy * m : y0 + sy * i0;
+    uint8_t *p = framebuf + py * fb_width + px;
+    for (int64_t i = i0; i <= i1; i++) {
+        *p = (uint8_t)color;
+        p += step_maj;
+        r += 2 * dmin;
+        if (r >= 2 * dmaj) {
+            r -= 2 * dmaj;
+            p += step_min;
+        }
     }
 }
 
-void gfx_line(int x1, int y1, int x2, int y2, int color, int style)
+void gfx_line(double wx1, double wy1, double wx2, double wy2,
+              int color, int style)
 {
+    int x1, y1, x2, y2;
+    gfx_map(wx1, wy1, &x1, &y1);
+    gfx_map(wx2, wy2, &x2, &y2);
     if (style == GFX_BOXF) {
-        /* Filled box */
+        /* Filled box: one clipped run per row */
         int xlo = x1 < x2 ? x1 : x2;
         int xhi = x1 > x2 ? x1 : x2;
         int ylo = y1 < y2 ? y1 : y2;
         int yhi = y1 > y2 ? y1 : y2;
+        if (ylo < clip_y1) ylo = clip_y1;
+        if (yhi > clip_y2) yhi = clip_y2;
         for (int y = ylo; y <= yhi; y++)
-            for (int x = xlo; x <= xhi; x++)
-                set_pixel(x, y, color);
+            hspan(y, xlo, xhi, color);
     } else if (style == GFX_BOX) {
         /* Box outline */
         draw_line(x1, y1, x2, y1, color);
@@ -122,108 +462,444 @@ void gfx_line(int x1, int y1, int x2, int y2, int color, int style)
     } else {
         draw_line(x1, y1, x2, y2, color);
     }
-    last_x = x2;
-    last_y = y2;
+    last_x = wx2;
+    last_y = wy2;
 }
 
-/* Midpoint circle with aspect ratio */
-void gfx_circle(int cx, int cy, int r, int color,
-                double start, double end, double aspect)
+/*
+ * CIRCLE: midpoint ellipse with integer semi-axes rx and ry. The aspect
+ * is the ratio of y to x radius; below 1 the radius is rx, otherwise
+ * ry. The ellipse is traced once in the first quadrant and mirrored.
+ *
+ * Arcs are clipped without trigonometry per pixel: each quadrant is
+ * classified once as wholly inside the arc, wholly outside, or cut by
+ * it, and only pixels of cut quadrants are tested, with cross products
+ * against the start and end directions. Angles are those of the
+ * ellipse's parametric form (rx cos t, ry sin t), so a pixel (dx, dy)
+ * is compared through the direction (dx ry, dy rx).
+ */
+enum { ARC_NONE, ARC_ALL, ARC_TEST };
+
+typedef struct {
+    int cx, cy, rx, ry;
+    uint8_t color;
+    int quad[4];                /* counterclockwise from +x */
+    double sx, sy, ex, ey;      /* start and end directions */
+    bool wide;                  /* arc spans more than half a turn */
+    bool full;                  /* every quadrant is ARC_ALL */
+    bool inside;                /* no clipping needed */
+} arc_t;
+
+static bool arc_has(const arc_t *a, int dx, int dy)
 {
-    if (r <= 0) return;
-
-    if (start == 0.0 && end == 0.0) {
-        /* Full circle */
-        double ax = (aspect > 0) ? aspect : (5.0 / 6.0); /* CGA aspect */
-        int x = 0, y = r;
-        int d = 1 - r;
-        while (x <= y) {
-            int px, py;
-            /* 8 octants with aspect adjustment */
-            px = (int)(x * ax); py = y;
-            set_pixel(cx + px, cy + py, color);
-            set_pixel(cx - px, cy + py, color);
-            set_pixel(cx + px, cy - py, color);
-            set_pixel(cx - px, cy - py, color);
-            px = (int)(y * ax); py = x;
-            set_pixel(cx + px, cy + py, color);
-            set_pixel(cx - px, cy + py, color);
-            set_pixel(cx + px, cy - py, color);
-            set_pixel(cx - px, cy - py, color);
-            if (d < 0) {
-                d += 2 * x + 3;
-            } else {
-                d += 2 * (x - y) + 5;
-                y--;
-            }
+    double px = (double)dx * a->ry, py = (double)dy * a->rx;
+    double cs = a->sx * py - a->sy * px;
+    double ce = px * a->ey - py * a->ex;
+    if (a->wide)
+        return cs >= 0 || ce >= 0;
+    return cs >= 0 && ce >= 0
+        && (px * a->sx + py * a->sy >= 0 || px * a->ex + py * a->ey >= 0);
+}
+
+/* Plot (x, y) of the first quadrant, y up, in all four quadrants */
+static void arc_plot4(const arc_t *a, int x, int y)
+{
+    static const int mx[4] = { 1, -1, -1, 1 }, my[4] = { 1, 1, -1, -1 };
+    if (a->full && a->inside) {
+        uint8_t c = a->color;
+        uint8_t *up = framebuf + (size_t)(a->cy - y) * fb_width + a->cx;
+        uint8_t *down = framebuf + (size_t)(a->cy + y) * fb_width + a->cx;
+        up[x] = c;
+        up[-x] = c;
+        down[x] = c;
+        down[-x] = c;
+        return;
+    }
+    for (int q = 0; q < 4; q++) {
+        int dx = mx[q] * x, dy = my[q] * y;
+        if (a->quad[q] == ARC_NONE
+            || (a->quad[q] == ARC_TEST && !arc_has(a, dx, dy)))
+            continue;
+        set_pixel(a->cx + dx, a->cy - dy, a->color);
+    }
+}
+
+static void arc_trace(const arc_t *a)
+{
+    int64_t rx = a->rx, ry = a->ry;
+    if (rx == 0 || ry == 0) {
+        /* Flattened to a line */
+        for (int i = 0; i <= rx; i++) arc_plot4(a, i, 0);
+        for (int i = 0; i <= ry; i++) arc_plot4(a, 0, i);
+        return;
+    }
+
+    /* Decision terms are kept four times their usual value to stay
+     * integral */
+    int64_t a2 = rx * rx, b2 = ry * ry;
+    int64_t x = 0, y = ry;
+    int64_t dx = 0, dy = 2 * a2 * y;
+    int64_t d = 4 * b2 - 4 * a2 * ry + a2;
+    while (dx < dy) {
+        arc_plot4(a, (int)x, (int)y);
+        x++;
+        dx += 2 * b2;
+        if (d < 0) {
+            d += 4 * (dx + b2);
+        } else {
+            y--;
+            dy -= 2 * a2;
+            d += 4 * (dx - dy + b2);
+        }
+    }
+    d = b2 * (2 * x + 1) * (2 * x + 1) + 4 * a2 * (y - 1) * (y - 1)
+        - 4 * a2 * b2;
+    while (y >= 0) {
+        arc_plot4(a, (int)x, (int)y);
+        y--;
+        dy -= 2 * a2;
+        if (d > 0) {
+            d += 4 * (a2 - dy);
+        } else {
             x++;
+            dx += 2 * b2;
+            d += 4 * (dx - dy + a2);
         }
+    }
+}
+
+/* Where the arc meets quadrant q: ARC_ALL, ARC_NONE or ARC_TEST */
+static int arc_quadrant(double s, double sweep, int q)
+{
+    const double eps = 1e-9;
+    double qa = q * M_PI / 2;
+    double from_start = fmod(qa - s + 2 * M_PI, 2 * M_PI);
+    double to_start = fmod(s - qa + 2 * M_PI, 2 * M_PI);
+    if (from_start + M_PI / 2 <= sweep - eps)
+        return ARC_ALL;
+    if (from_start > sweep + eps && to_start > M_PI / 2 + eps)
+        return ARC_NONE;
+    return ARC_TEST;
+}
+
+/* CIRCLE in world coordinates: the radius is in world x units, start
+ * and end are in radians, and a negative angle also draws a line from
+ * the center to that end of the arc. The whole ellipse is drawn when
+ * the arc spans a full turn. */
+void gfx_circle(double wx, double wy, double wr, int color,
+                double start, double end, double aspect)
+{
+    int cx, cy;
+    gfx_map(wx, wy, &cx, &cy);
+    last_x = wx;
+    last_y = wy;
+    int r = to_pixel(wr * fabs(scale_x));
+    if (r <= 0 || !framebuf) return;
+
+    /* Default aspect makes circles round on a 4:3 display */
+    if (aspect <= 0)
+        aspect = 4.0 * fb_height / (3.0 * fb_width);
+    arc_t a = { .cx = cx, .cy = cy, .color = (uint8_t)color };
+    if (aspect < 1) {
+        a.rx = r;
+        a.ry = to_pixel(r * aspect);
     } else {
-        /* Arc: parametric with aspect */
-        double ax = (aspect > 0) ? aspect : (5.0 / 6.0);
-        double step = 1.0 / r;
-        if (step > 0.05) step = 0.05;
-        for (double a = start; a <= end; a += step) {
-            int px = cx + (int)(r * cos(a) * ax);
-            int py = cy - (int)(r * sin(a));
-            set_pixel(px, py, color);
+        a.rx = to_pixel(r / aspect);
+        a.ry = r;
+    }
+
+    double s = fabs(start), e = fabs(end);
+    double sweep = e - s;
+    if (sweep < 0)
+        sweep += 2 * M_PI;
+    a.sx = cos(s);
+    a.sy = sin(s);
+    a.ex = cos(e);
+    a.ey = sin(e);
+    a.wide = sweep > M_PI;
+    a.inside = cx - a.rx >= clip_x1 && cx + a.rx <= clip_x2
+        && cy - a.ry >= clip_y1 && cy + a.ry <= clip_y2;
+    a.full = true;
+    for (int q = 0; q < 4; q++) {
+        a.quad[q] = sweep >= 2 * M_PI ? ARC_ALL : arc_quadrant(s, sweep, q);
+        a.full = a.full && a.quad[q] == ARC_ALL;
+    }
+    arc_trace(&a);
+
+    /* Sector edges */
+    if (start < 0)
+        draw_line(cx, cy, cx + to_pixel(a.rx * a.sx),
+                  cy - to_pixel(a.ry * a.sy), color);
+    if (end < 0)
+        draw_line(cx, cy, cx + to_pixel(a.rx * a.ex),
+                  cy - to_pixel(a.ry * a.ey), color);
+}
+
+/*
+ * PAINT: scanline fill. Each stack entry is a span of a row that was
+ * just filled together with the direction of the row to scan next; the
+ * scan fills every run of paintable pixels touching the span and pushes
+ * one entry per run, plus the parts of a run that overhang the span
+ * back towards the row it came from. Work is proportional to the number
+ * of runs rather than pixels.
+ *
+ * The stack has a fixed size. When it is full, the span to scan is
+ * recorded in a bitmap of pending pixels instead, and the bitmap is
+ * swept once the stack drains, so the fill is always complete.
+ */
+#define PAINT_STACK 1024
+
+typedef struct {
+    int y, xl, xr, dy;
+} paint_span_t;
+
+typedef struct {
+    bool stop[256];             /* border and fill colors end a run */
+    uint8_t fill;
+    paint_span_t stack[PAINT_STACK];
+    int sp;
+    uint8_t *pending;           /* one bit per pixel, on overflow only */
+    bool any_pending;
+} paint_t;
+
+static void paint_push(paint_t *pt, int y, int xl, int xr, int dy)
+{
+    if (y < clip_y1 || y > clip_y2)
+        return;
+    if (xl < clip_x1) xl = clip_x1;
+    if (xr > clip_x2) xr = clip_x2;
+    if (pt->sp < PAINT_STACK) {
+        pt->stack[pt->sp++] = (paint_span_t){ y, xl, xr, dy };
+        return;
+    }
+    if (!pt->pending) {
+        pt->pending = calloc(((size_t)fb_width * fb_height + 7) / 8, 1);
+        if (!pt->pending)
+            return;
+    }
+    size_t base = (size_t)y * fb_width;
+    for (int x = xl; x <= xr; x++)
+        pt->pending[(base + x) >> 3] |= (uint8_t)(1 << ((base + x) & 7));
+    pt->any_pending = true;
+}
+
+/* Fill the run of row y containing x (x must be paintable) and return
+ * its ends */
+static void paint_run(paint_t *pt, int y, int x, int *l, int *r)
+{
+    uint8_t *row = framebuf + (size_t)y * fb_width;
+    int a = x, b = x;
+    while (a > clip_x1 && !pt->stop[row[a - 1]])
+        a--;
+    while (b < clip_x2 && !pt->stop[row[b + 1]])
+        b++;
+    memset(row + a, pt->fill, b - a + 1);
+    *l = a;
+    *r = b;
+}
+
+/* Fill every run of row s->y that touches [s->xl, s->xr] */
+static void paint_scan(paint_t *pt, const paint_span_t *s)
+{
+    const uint8_t *row = framebuf + (size_t)s->y * fb_width;
+    int x = s->xl;
+    while (x <= s->xr) {
+        while (x <= s->xr && pt->stop[row[x]])
+            x++;
+        if (x > s->xr)
+            break;
+        int l, r;
+        paint_run(pt, s->y, x, &l, &r);
+        paint_push(pt, s->y + s->dy, l, r, s->dy);
+        if (l < s->xl)
+            paint_push(pt, s->y - s->dy, l, s->xl - 1, -s->dy);
+        if (r > s->xr)
+            paint_push(pt, s->y - s->dy, s->xr + 1, r, -s->dy);
+        x = r + 2;
+    }
+}
+
+static void paint_drain(paint_t *pt)
+{
+    while (pt->sp > 0) {
+        paint_span_t s = pt->stack[--pt->sp];
+        paint_scan(pt, &s);
+    }
+}
+
+/* Scan the pending pixels left behind by a full stack, in both
+ * directions since the direction was not kept */
+static void paint_sweep(paint_t *pt)
+{
+    pt->any_pending = false;
+    for (int y = clip_y1; y <= clip_y2; y++) {
+        const uint8_t *row = framebuf + (size_t)y * fb_width;
+        size_t base = (size_t)y * fb_width;
+        for (int x = clip_x1; x <= clip_x2; x++) {
+            size_t i = base + x;
+            if (!(pt->pending[i >> 3] & (1 << (i & 7))))
+                continue;
+            pt->pending[i >> 3] &= (uint8_t)~(1 << (i & 7));
+            if (pt->stop[row[x]])
+                continue;
+            int l, r;
+            paint_run(pt, y, x, &l, &r);
+            paint_push(pt, y - 1, l, r, -1);
+            paint_push(pt, y + 1, l, r, 1);
+            paint_drain(pt);
         }
     }
-    last_x = cx;
-    last_y = cy;
 }
 
-/* Flood fill (stack-based) */
-void gfx_paint(int x, int y, int fill_color, int border_color)
+void gfx_paint(double wx, double wy, int fill_color, int border_color)
 {
     if (!framebuf) return;
-    if (x < 0 || x >= fb_width || y < 0 || y >= fb_height) return;
+    int x, y;
+    gfx_map(wx, wy, &x, &y);
+    last_x = wx;
+    last_y = wy;
+    if (!in_view(x, y)) return;
 
-    int start = get_pixel(x, y);
+    int start = framebuf[y * fb_width + x];
     if (start == fill_color || start == border_color) return;
 
-    /* Simple stack-based flood fill */
-    int stack_cap = 4096;
-    int *stack = malloc(stack_cap * 2 * sizeof(int));
-    if (!stack) return;
-    int sp = 0;
-
-    #define PUSH(px, py) do { \
-        if (sp < stack_cap) { stack[sp*2] = (px); stack[sp*2+1] = (py); sp++; } \
-    } while(0)
-    #define POP(px, py) do { sp--; (px) = stack[sp*2]; (py) = stack[sp*2+1]; } while(0)
-
-    PUSH(x, y);
-    while (sp > 0) {
-        int cx, cy;
-        POP(cx, cy);
-        if (cx < 0 || cx >= fb_width || cy < 0 || cy >= fb_height) continue;
-        int c = get_pixel(cx, cy);
-        if (c == fill_color || c == border_color) continue;
-        set_pixel(cx, cy, fill_color);
-        /* Grow stack if needed */
-        if (sp + 4 >= stack_cap) {
-            stack_cap *= 2;
-            int *ns = realloc(stack, stack_cap * 2 * sizeof(int));
-            if (!ns) break;
-            stack = ns;
-        }
-        PUSH(cx + 1, cy);
-        PUSH(cx - 1, cy);
-        PUSH(cx, cy + 1);
-        PUSH(cx, cy - 1);
+    static paint_t pt;
+    memset(pt.stop, 0, sizeof(pt.stop));
+    pt.fill = (uint8_t)fill_color;
+    pt.stop[pt.fill] = true;
+    if (border_color >= 0 && border_color < 256)
+        pt.stop[border_color] = true;
+    if (pt.stop[start]) return;
+    pt.sp = 0;
+    pt.pending = NULL;
+    pt.any_pending = false;
+
+    int l, r;
+    paint_run(&pt, y, x, &l, &r);
+    paint_push(&pt, y - 1, l, r, -1);
+    paint_push(&pt, y + 1, l, r, 1);
+    paint_drain(&pt);
+    while (pt.any_pending)
+        paint_sweep(&pt);
+    free(pt.pending);
+}
+
+/*
+ * GET/PUT blocks. The layout is GW-BASIC's: a 16-bit width in bits and
+ * a 16-bit height, then the rows, each packed most significant bits
+ * first at the mode's bits per pixel and padded to a whole byte.
+ */
+int gfx_block_bpp(void)
+{
+    int bpp = 1;
+    while ((1 << bpp) < fb_colors)
+        bpp++;
+    return bpp;
+}
+
+static size_t block_row_bytes(int w)
+{
+    return ((size_t)w * gfx_block_bpp() + 7) / 8;
+}
+
+size_t gfx_block_size(int w, int h)
+{
+    return 4 + block_row_bytes(w) * h;
+}
+
+/* Pack one row of pixels; bpp 8 is a plain copy */
+static void pack_row(const uint8_t *px, int w, int bpp, uint8_t *out)
+{
+    if (bpp == 8) {
+        memcpy(out, px, w);
+        return;
     }
+    int per = 8 / bpp, mask = (1 << bpp) - 1;
+    for (int x = 0; x < w; x += per) {
+        int b = 0;
+        for (int k = 0; k < per; k++)
+            b = b << bpp | (x + k < w ? px[x + k] & mask : 0);
+        *out++ = (uint8_t)b;
+    }
+}
+
+static void unpack_row(const uint8_t *in, int w, int bpp, uint8_t *px)
+{
+    if (bpp == 8) {
+        memcpy(px, in, w);
+        return;
+    }
+    int per = 8 / bpp, mask = (1 << bpp) - 1;
+    for (int x = 0; x < w; x++)
+        px[x] = (in[x / per] >> (8 - bpp * (x % per + 1))) & mask;
+}
+
+/* Copy the w x h block at (x, y), which must be on screen, to data */
+void gfx_get_block(int x, int y, int w, int h, uint8_t *data)
+{
+    int bpp = gfx_block_bpp();
+    int bits = w * bpp;
+    data[0] = (uint8_t)bits;
+    data[1] = (uint8_t)(bits >> 8);
+    data[2] = (uint8_t)h;
+    data[3] = (uint8_t)(h >> 8);
+    size_t rb = block_row_bytes(w);
+    for (int r = 0; r < h; r++)
+        pack_row(framebuf + (size_t)(y + r) * fb_width + x, w, bpp,
+                 data + 4 + r * rb);
+}
+
+/* Draw a block made by gfx_get_block at (x, y), combining it with the
+ * screen by op. Fails if the data is short or the block does not fit
+ * on the screen. */
+bool gfx_put_block(int x, int y, const uint8_t *data, size_t len, int op)
+{
+    if (!framebuf || len < 4)
+        return false;
+    int bpp = gfx_block_bpp();
+    int bits = data[0] | data[1] << 8;
+    int h = data[2] | data[3] << 8;
+    int w = bits / bpp;
+    size_t rb = block_row_bytes(w);
+    if (w <= 0 || h <= 0 || len < 4 + rb * h)
+        return false;
+    if (x < 0 || y < 0 || x + w > fb_width || y + h > fb_height)
+        return false;
 
-    #undef PUSH
-    #undef POP
-    free(stack);
+    uint8_t row[1024];
+    int mask = bpp == 8 ? 0xFF : (1 << bpp) - 1;
+    for (int r = 0; r < h; r++) {
+        uint8_t *dst = framebuf + (size_t)(y + r) * fb_width + x;
+        const uint8_t *src = data + 4 + r * rb;
+        if (op == GFX_PSET) {
+            unpack_row(src, w, bpp, dst);
+            continue;
+        }
+        unpack_row(src, w, bpp, row);
+        switch (op) {
+        case GFX_PRESET:
+            for (int i = 0; i < w; i++) dst[i] = (uint8_t)(~row[i] & mask);
+            break;
+        case GFX_AND:
+            for (int i = 0; i < w; i++) dst[i] &= row[i];
+            break;
+        case GFX_OR:
+            for (int i = 0; i < w; i++) dst[i] |= row[i];
+            break;
+        default:
+            for (int i = 0; i < w; i++) dst[i] ^= row[i];
+            break;
+        }
+    }
+    return true;
 }
 
 /* DRAW mini-language parser */
 void gfx_draw(const char *cmd)
 {
     if (!framebuf) return;
-    int x = last_x, y = last_y;
+    int x, y;
+    gfx_map(last_x, last_y, &x, &y);
     int draw_color = current_color;
     int scale = 4;  /* default scale factor (C4) */
     const char *p = cmd;
@@ -287,7 +963,7 @@ void gfx_draw(const char *cmd)
             while (isdigit((unsigned char)*p)) { my = my * 10 + (*p - '0'); p++; }
             if (mneg) my = -my;
             if (relative) { nx = x + mx; ny = y + my; }
-            else { nx = mx; ny = my; }
+            else { nx = mx + org_x; ny = my + org_y; }
             break;
         }
         case 'C':
@@ -316,148 +992,429 @@ void gfx_draw(const char *cmd)
         while (*p == ' ' || *p == ';') p++;
     }
 
-    last_x = x;
-    last_y = y;
+    unmap(x, y, &last_x, &last_y);
 }
 
 /* Sixel output encoder */
-void gfx_flush(void)
+/*
+ * Sixel output. Each band of six rows is encoded one color at a time:
+ * the color's six-pixel column masks for the whole band are built in a
+ * single pass over the band's pixels, then run-length coded.
+ */
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    bool failed;
+} sixel_out_t;
+
+static void sixel_put(sixel_out_t *o, const char *s, size_t n)
+{
+    if (o->failed)
+        return;
+    if (o->len + n > o->cap) {
+        size_t cap = o->cap ? o->cap : 64 * 1024;
+        while (o->len + n > cap)
+            cap *= 2;
+        char *nb = realloc(o->buf, cap);
+        if (!nb) {
+            o->failed = true;
+            return;
+        }
+        o->buf = nb;
+        o->cap = cap;
+    }
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static void sixel_printf(sixel_out_t *o, const char *fmt, int a, int b,
+                         int c, int d)
 {
-    if (!framebuf || !gw_hal) return;
+    char tmp[48];
+    int n = snprintf(tmp, sizeof(tmp), fmt, a, b, c, d);
+    sixel_put(o, tmp, n);
+}
+
+/* A run of n identical columns: repeated when short, !n otherwise */
+static void sixel_run(sixel_out_t *o, int sixel, int n)
+{
+    char ch = (char)(sixel + 63);
+    if (n > 3) {
+        sixel_printf(o, "!%d%c", n, ch, 0, 0);
+    } else {
+        for (int i = 0; i < n; i++)
+            sixel_put(o, &ch, 1);
+    }
+}
+
+static void sixel_frame(void)
+{
+    if (!gw_hal) return;
+
+    /* Palette entries the encoder knows; pixels beyond it are not shown */
+    int ncolors = fb_colors > 16 ? 256 : 16;
+    size_t npix = (size_t)fb_width * fb_height;
 
     /* Determine which colors are used */
-    int color_used[16] = {0};
-    for (int i = 0; i < fb_width * fb_height; i++)
-        color_used[framebuf[i] & 0x0F] = 1;
-
-    /* Build Sixel output in a buffer */
-    int buf_cap = 1024 * 64;
-    char *buf = malloc(buf_cap);
-    if (!buf) return;
-    int pos = 0;
-
-    #define EMIT(s) do { \
-        int _l = strlen(s); \
-        if (pos + _l >= buf_cap) { \
-            buf_cap *= 2; \
-            char *nb = realloc(buf, buf_cap); \
-            if (!nb) { free(buf); return; } \
-            buf = nb; \
-        } \
-        memcpy(buf + pos, s, _l); pos += _l; \
-    } while(0)
+    bool color_used[256] = { false };
+    for (size_t i = 0; i < npix; i++)
+        color_used[framebuf[i] & (ncolors - 1)] = true;
+
+    /* Column masks for each color present in the current band */
+    uint8_t *masks = malloc((size_t)ncolors * fb_width);
+    if (!masks) return;
+    int slot[256];
+
+    sixel_out_t out = { 0 };
 
     /* DCS q - enter Sixel mode */
-    EMIT("\033Pq");
+    sixel_put(&out, "\033Pq", 3);
 
     /* Define palette */
-    for (int c = 0; c < 16; c++) {
+    for (int c = 0; c < ncolors; c++) {
         if (!color_used[c]) continue;
         uint32_t rgb = palette[c];
         int r = ((rgb >> 16) & 0xFF) * 100 / 255;
         int g = ((rgb >> 8) & 0xFF) * 100 / 255;
         int b = (rgb & 0xFF) * 100 / 255;
-        char pal[32];
-        snprintf(pal, sizeof(pal), "#%d;2;%d;%d;%d", c, r, g, b);
-        EMIT(pal);
+        sixel_printf(&out, "#%d;2;%d;%d;%d", c, r, g, b);
     }
 
     /* Output Sixel bands (6 rows each) */
     for (int band = 0; band < fb_height; band += 6) {
         int band_h = (band + 6 <= fb_height) ? 6 : fb_height - band;
 
-        for (int c = 0; c < 16; c++) {
-            if (!color_used[c]) continue;
-
-            /* Check if this color appears in this band */
-            int has_color = 0;
-            for (int y2 = band; y2 < band + band_h && !has_color; y2++)
-                for (int x2 = 0; x2 < fb_width && !has_color; x2++)
-                    if (framebuf[y2 * fb_width + x2] == c)
-                        has_color = 1;
-            if (!has_color) continue;
-
-            /* Emit color selector */
-            char cs[8];
-            snprintf(cs, sizeof(cs), "#%d", c);
-            EMIT(cs);
-
-            /* Emit Sixel data for this color in this band */
-            /* Use RLE for runs of same byte */
-            int prev_sixel = -1;
-            int run_len = 0;
-
-            for (int x2 = 0; x2 < fb_width; x2++) {
-                int sixel = 0;
-                for (int bit = 0; bit < band_h; bit++) {
-                    int y2 = band + bit;
-                    if (framebuf[y2 * fb_width + x2] == c)
-                        sixel |= (1 << bit);
-                }
-
-                if (sixel == prev_sixel) {
-                    run_len++;
-                } else {
-                    /* Flush previous run */
-                    if (prev_sixel >= 0) {
-                        char sc[16];
-                        if (run_len > 3) {
-                            snprintf(sc, sizeof(sc), "!%d%c", run_len, prev_sixel + 63);
-                        } else {
-                            for (int r2 = 0; r2 < run_len; r2++) {
-                                sc[0] = prev_sixel + 63;
-                                sc[1] = '\0';
-                                EMIT(sc);
-                            }
-                            sc[0] = '\0';
-                        }
-                        EMIT(sc);
-                    }
-                    prev_sixel = sixel;
-                    run_len = 1;
-                }
+        /* Colors present in this band, in ascending order */
+        for (int c = 0; c < ncolors; c++)
+            slot[c] = -1;
+        for (int y = band; y < band + band_h; y++) {
+            const uint8_t *row = framebuf + (size_t)y * fb_width;
+            for (int x = 0; x < fb_width; x++)
+                if (row[x] < ncolors)
+                    slot[row[x]] = 0;
+        }
+        int nslots = 0;
+        int order[256];
+        for (int c = 0; c < ncolors; c++)
+            if (slot[c] == 0) {
+                slot[c] = nslots;
+                order[nslots++] = c;
             }
-            /* Flush last run */
-            if (prev_sixel >= 0) {
-                char sc[16];
-                if (run_len > 3) {
-                    snprintf(sc, sizeof(sc), "!%d%c", run_len, prev_sixel + 63);
+        if (nslots == 0) {
+            sixel_put(&out, "-", 1);
+            continue;
+        }
+
+        memset(masks, 0, (size_t)nslots * fb_width);
+        for (int bit = 0; bit < band_h; bit++) {
+            const uint8_t *row = framebuf + (size_t)(band + bit) * fb_width;
+            for (int x = 0; x < fb_width; x++)
+                if (row[x] < ncolors)
+                    masks[(size_t)slot[row[x]] * fb_width + x] |= (uint8_t)(1 << bit);
+        }
+
+        for (int k = 0; k < nslots; k++) {
+            /* Emit color selector, then the run-length coded columns */
+            sixel_printf(&out, "#%d", order[k], 0, 0, 0);
+            const uint8_t *m = masks + (size_t)k * fb_width;
+            int run = 1;
+            for (int x = 1; x < fb_width; x++) {
+                if (m[x] == m[x - 1]) {
+                    run++;
                 } else {
-                    for (int r2 = 0; r2 < run_len; r2++) {
-                        sc[0] = prev_sixel + 63;
-                        sc[1] = '\0';
-                        EMIT(sc);
-                    }
-                    sc[0] = '\0';
+                    sixel_run(&out, m[x - 1], run);
+                    run = 1;
                 }
-                EMIT(sc);
             }
+            sixel_run(&out, m[fb_width - 1], run);
 
-            /* GNL ($/- selectors): $ = CR (reuse row), - = newline */
-            /* If more colors in this band, use $; else use - for next band */
-            /* Check if there's another color to render in this band */
-            int more = 0;
-            for (int nc = c + 1; nc < 16; nc++) {
-                if (!color_used[nc]) continue;
-                for (int y2 = band; y2 < band + band_h && !more; y2++)
-                    for (int x2 = 0; x2 < fb_width && !more; x2++)
-                        if (framebuf[y2 * fb_width + x2] == nc)
-                            more = 1;
-                if (more) break;
-            }
-            if (more) {
-                EMIT("$");  /* CR - overlay next color on same band */
-            }
+            /* $ = CR, overlay the next color on the same band */
+            if (k + 1 < nslots)
+                sixel_put(&out, "$", 1);
         }
-        EMIT("-");  /* LF - advance to next band */
+        sixel_put(&out, "-", 1);  /* LF - advance to next band */
     }
 
     /* ST - string terminator */
-    EMIT("\033\\");
-
-    #undef EMIT
+    sixel_put(&out, "\033\\", 2);
+    free(masks);
 
     /* Write out via HAL raw output */
-    gw_hal->write_raw(buf, pos);
-    free(buf);
+    if (!out.failed)
+        gw_hal->write_raw(out.buf, out.len);
+    free(out.buf);
+}
+
+/* ================================================================
+ * Frame output
+ * ================================================================ */
+
+/* Headless output (--gfx-out, --gfx-stream, --gfx-skip). A frame is
+ * what one flush would have shown; --gfx-skip N keeps one flush in N,
+ * and the last state of the screen is always written when it leaves
+ * graphics mode or the program ends. */
+static FILE *stream_fp;
+static bool stream_failed;
+static int frame_skip = 1;
+static unsigned long flushes;       /* flushes since the sink was set up */
+static unsigned long frame_number;  /* next %d */
+static bool frame_pending;          /* drawn since the last frame written */
+
+void gfx_set_output(const char *path)
+{
+    out_path = path;
+}
+
+void gfx_set_stream(const char *path)
+{
+    stream_path = path;
+}
+
+void gfx_set_frame_skip(int n)
+{
+    frame_skip = n > 0 ? n : 1;
+}
+
+static void output_failed(const char *path)
+{
+    fprintf(stderr, "Cannot write graphics to %s\n", path);
+}
+
+/* Position and width of a %d or %0Nd in the pattern, if any */
+static const char *number_field(const char *pattern, int *width)
+{
+    for (const char *p = pattern; (p = strchr(p, '%')); p++) {
+        const char *q = p + 1;
+        int w = 0;
+        while (isdigit((unsigned char)*q))
+            w = w * 10 + (*q++ - '0');
+        if (*q == 'd') {
+            *width = w;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* 24-bit color of each framebuffer value; values past the palette the
+ * Sixel encoder uses are black */
+static void color_table(uint32_t rgb[256])
+{
+    int ncolors = fb_colors > 16 ? 256 : 16;
+    for (int i = 0; i < 256; i++)
+        rgb[i] = i < ncolors ? palette[i] : 0;
+}
+
+static bool write_ppm(FILE *fp)
+{
+    uint32_t rgb[256];
+    color_table(rgb);
+    fprintf(fp, "P6\n%d %d\n255\n", fb_width, fb_height);
+    uint8_t row[3 * 640];
+    for (int y = 0; y < fb_height; y++) {
+        const uint8_t *px = framebuf + (size_t)y * fb_width;
+        for (int x = 0; x < fb_width; x++) {
+            row[3 * x] = (uint8_t)(rgb[px[x]] >> 16);
+            row[3 * x + 1] = (uint8_t)(rgb[px[x]] >> 8);
+            row[3 * x + 2] = (uint8_t)rgb[px[x]];
+        }
+        if (fwrite(row, 3, fb_width, fp) != (size_t)fb_width)
+            return false;
+    }
+    return true;
+}
+
+/* ---------------- PNG ---------------- */
+
+static uint32_t crc_table[256];
+
+static uint32_t png_crc(uint32_t crc, const uint8_t *p, size_t n)
+{
+    if (!crc_table[1])
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    crc = ~crc;
+    while (n--)
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static bool png_chunk(FILE *fp, const char *type, const uint8_t *data,
+                      size_t len)
+{
+    uint8_t hdr[8];
+    put_be32(hdr, (uint32_t)len);
+    memcpy(hdr + 4, type, 4);
+    uint8_t crc[4];
+    put_be32(crc, png_crc(png_crc(0, hdr + 4, 4), data, len));
+    return fwrite(hdr, 1, 8, fp) == 8
+        && (len == 0 || fwrite(data, 1, len, fp) == len)
+        && fwrite(crc, 1, 4, fp) == 4;
+}
+
+/* zlib stream of raw: deflated when zlib is available, else in stored
+ * blocks. Returns a malloc'd buffer. */
+static uint8_t *png_deflate(const uint8_t *raw, size_t n, size_t *out_len)
+{
+#ifdef HAVE_ZLIB
+    uLongf len = compressBound(n);
+    uint8_t *z = malloc(len);
+    if (z && compress2(z, &len, raw, n, Z_BEST_SPEED) != Z_OK) {
+        free(z);
+        z = NULL;
+    }
+    *out_len = len;
+    return z;
+#else
+    size_t blocks = n / 65535 + 1;
+    uint8_t *z = malloc(2 + n + 5 * blocks + 4);
+    if (!z)
+        return NULL;
+    size_t o = 0;
+    z[o++] = 0x78;
+    z[o++] = 0x01;
+    size_t i = 0;
+    do {
+        size_t len = n - i < 65535 ? n - i : 65535;
+        z[o++] = i + len == n;
+        z[o++] = (uint8_t)len;
+        z[o++] = (uint8_t)(len >> 8);
+        z[o++] = (uint8_t)~len;
+        z[o++] = (uint8_t)(~len >> 8);
+        memcpy(z + o, raw + i, len);
+        o += len;
+        i += len;
+    } while (i < n);
+    uint32_t a = 1, b = 0;
+    for (size_t k = 0; k < n; k++) {
+        a = (a + raw[k]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_be32(z + o, b << 16 | a);
+    *out_len = o + 4;
+    return z;
+#endif
+}
+
+/* Indexed-color PNG with the whole 256-entry palette */
+static bool write_png(FILE *fp)
+{
+    static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t ihdr[13];
+    put_be32(ihdr, fb_width);
+    put_be32(ihdr + 4, fb_height);
+    ihdr[8] = 8;        /* bit depth */
+    ihdr[9] = 3;        /* indexed color */
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    uint32_t rgb[256];
+    color_table(rgb);
+    uint8_t plte[768];
+    for (int i = 0; i < 256; i++) {
+        plte[3 * i] = (uint8_t)(rgb[i] >> 16);
+        plte[3 * i + 1] = (uint8_t)(rgb[i] >> 8);
+        plte[3 * i + 2] = (uint8_t)rgb[i];
+    }
+
+    /* Rows with filter type 0 */
+    size_t n = (size_t)(fb_width + 1) * fb_height;
+    uint8_t *raw = malloc(n);
+    if (!raw)
+        return false;
+    for (int y = 0; y < fb_height; y++) {
+        raw[(size_t)y * (fb_width + 1)] = 0;
+        memcpy(raw + (size_t)y * (fb_width + 1) + 1,
+               framebuf + (size_t)y * fb_width, fb_width);
+    }
+    size_t zlen;
+    uint8_t *z = png_deflate(raw, n, &zlen);
+    free(raw);
+    if (!z)
+        return false;
+
+    bool ok = fwrite(sig, 1, 8, fp) == 8
+        && png_chunk(fp, "IHDR", ihdr, sizeof(ihdr))
+        && png_chunk(fp, "PLTE", plte, sizeof(plte))
+        && png_chunk(fp, "IDAT", z, zlen)
+        && png_chunk(fp, "IEND", NULL, 0);
+    free(z);
+    return ok;
+}
+
+/* ---------------- File sink ---------------- */
+
+static void write_image(const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        output_failed(path);
+        return;
+    }
+    const char *ext = strrchr(path, '.');
+    bool png = ext && tolower((unsigned char)ext[1]) == 'p'
+        && tolower((unsigned char)ext[2]) == 'n'
+        && tolower((unsigned char)ext[3]) == 'g' && !ext[4];
+    bool ok = png ? write_png(fp) : write_ppm(fp);
+    if (fclose(fp) != 0 || !ok)
+        output_failed(path);
+}
+
+static void write_frame(void)
+{
+    int width;
+    const char *field = out_path ? number_field(out_path, &width) : NULL;
+    if (field) {
+        char name[4096];
+        const char *rest = strchr(field, 'd') + 1;
+        snprintf(name, sizeof(name), "%.*s%0*lu%s", (int)(field - out_path),
+                 out_path, width, frame_number, rest);
+        write_image(name);
+    }
+    if (stream_path && !stream_failed) {
+        if (!stream_fp)
+            stream_fp = fopen(stream_path, "wb");
+        if (!stream_fp || !write_ppm(stream_fp) || fflush(stream_fp) != 0) {
+            output_failed(stream_path);
+            stream_failed = true;
+        }
+    }
+    frame_number++;
+    frame_pending = false;
+}
+
+static void file_frame(void)
+{
+    frame_pending = true;
+    if (flushes++ % frame_skip == 0)
+        write_frame();
+}
+
+static void file_close(void)
+{
+    if (frame_pending)
+        write_frame();
+    int width;
+    if (out_path && !number_field(out_path, &width))
+        write_image(out_path);
+}
+
+static const gfx_sink_t sixel_sink = { sixel_frame, NULL };
+static const gfx_sink_t file_sink = { file_frame, file_close };
+
+void gfx_flush(void)
+{
+    if (framebuf)
+        sink->frame();
 }
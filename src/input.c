@@ -30,6 +30,56 @@ static char *read_input_line(void)
     return buf;
 }
 
+/* Parse one item of the given type from the input line at p; returns
+ * where it ends */
+static const char *parse_item(const char *p, const char *line_end,
+                              gw_valtype_t type, gw_value_t *val)
+{
+    if (type != VT_STR)
+        return gw_scan_number(p, line_end, true, type == VT_DBL, val);
+
+    /* Read string: until comma or end of line */
+    const char *start = p;
+    if (*p == '"') {
+        /* Quoted string */
+        p++;
+        start = p;
+        while (*p && *p != '"') p++;
+        int len = p - start;
+        val->type = VT_STR;
+        val->sval = gw_str_alloc(len);
+        memcpy(val->sval.data, start, len);
+        if (*p == '"') p++;
+    } else {
+        while (*p && *p != ',') p++;
+        int len = p - start;
+        /* Trim trailing spaces */
+        while (len > 0 && start[len - 1] == ' ') len--;
+        val->type = VT_STR;
+        val->sval = gw_str_alloc(len);
+        memcpy(val->sval.data, start, len);
+    }
+    return p;
+}
+
+/* Store an input item into an array element */
+static void store_item(gw_value_t *elem, gw_valtype_t type, gw_value_t *val)
+{
+    if (type == VT_STR) {
+        gw_str_free(&elem->sval);
+        elem->sval = val->sval;
+        elem->type = VT_STR;
+    } else {
+        switch (type) {
+        case VT_INT: elem->ival = gw_to_int(val); break;
+        case VT_SNG: elem->fval = gw_to_sng(val); break;
+        case VT_DBL: elem->dval = gw_to_dbl(val); break;
+        default: break;
+        }
+        elem->type = type;
+    }
+}
+
 void gw_stmt_input(void)
 {
     gw_skip_spaces();
@@ -73,6 +123,7 @@ retry:;
     if (!line) return;
 
     const char *p = line;
+    const char *line_end = line + strlen(line);
 
     /* Parse variable list and assign values */
     int var_idx = 0;
@@ -99,51 +150,10 @@ retry:;
 
         /* Parse value from input line */
         gw_value_t val;
-        if (type == VT_STR) {
-            /* Read string: until comma or end of line */
-            const char *start = p;
-            if (*p == '"') {
-                /* Quoted string */
-                p++;
-                start = p;
-                while (*p && *p != '"') p++;
-                int len = p - start;
-                val.type = VT_STR;
-                val.sval = gw_str_alloc(len);
-                memcpy(val.sval.data, start, len);
-                if (*p == '"') p++;
-            } else {
-                while (*p && *p != ',') p++;
-                int len = p - start;
-                /* Trim trailing spaces */
-                while (len > 0 && start[len - 1] == ' ') len--;
-                val.type = VT_STR;
-                val.sval = gw_str_alloc(len);
-                memcpy(val.sval.data, start, len);
-            }
-        } else {
-            char *end;
-            double d = strtod(p, &end);
-            if (end == p) d = 0;
-            p = end;
-            val.type = VT_DBL;
-            val.dval = d;
-        }
+        p = parse_item(p, line_end, type, &val);
 
         if (arr_elem) {
-            if (type == VT_STR) {
-                gw_str_free(&arr_elem->sval);
-                arr_elem->sval = val.sval;
-                arr_elem->type = VT_STR;
-            } else {
-                switch (type) {
-                case VT_INT: arr_elem->ival = gw_to_int(&val); break;
-                case VT_SNG: arr_elem->fval = gw_to_sng(&val); break;
-                case VT_DBL: arr_elem->dval = gw_to_dbl(&val); break;
-                default: break;
-                }
-                arr_elem->type = type;
-            }
+            store_item(arr_elem, type, &val);
         } else {
             gw_var_assign(var, &val);
         }
@@ -169,6 +179,40 @@ retry:;
     }
 }
 
+/*
+ * MAT INPUT: read n values into elems, as many per line as are typed,
+ * prompting "? " and then "?? " while more are needed.
+ */
+void gw_input_values(gw_value_t **elems, int n, gw_valtype_t type)
+{
+    const char *prompt = "? ";
+    int i = 0;
+    while (i < n) {
+        if (gw_hal) gw_hal->puts(prompt);
+        else fputs(prompt, stdout);
+        fflush(stdout);
+        prompt = "?? ";
+
+        char *line = read_input_line();
+        if (!line) return;
+        const char *p = line;
+        const char *line_end = line + strlen(line);
+
+        while (i < n) {
+            while (*p == ' ') p++;
+            if (!*p)
+                break;
+            gw_value_t val;
+            p = parse_item(p, line_end, type, &val);
+            store_item(elems[i++], type, &val);
+            while (*p == ' ') p++;
+            if (*p != ',')
+                break;
+            p++;
+        }
+    }
+}
+
 void gw_stmt_line_input(void)
 {
     gw_skip_spaces();
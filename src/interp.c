@@ -20,6 +20,8 @@
 
 jmp_buf gw_run_jmp;
 
+static void events_update(void);
+
 static int ci_strcmp(const char *a, const char *b)
 {
     for (;; a++, b++) {
@@ -48,6 +50,9 @@ void gw_store_line(uint16_t num, uint8_t *tokens, int len)
     if (!line->tokens) { free(line); gw_error(ERR_OM); }
     memcpy(line->tokens, tokens, len);
     line->tokens[len] = 0;
+    line->source = NULL;
+    line->ecache = NULL;
+    gw_fold_line(line);
 
     /* Insert in sorted order */
     program_line_t **pp = &gw.prog_head;
@@ -64,6 +69,8 @@ void gw_delete_line(uint16_t num)
         if ((*pp)->num == num) {
             program_line_t *del = *pp;
             *pp = del->next;
+            gw_unfold_line(del);
+            gw_eval_free_cache(del);
             free(del->tokens);
             free(del);
             return;
@@ -90,6 +97,8 @@ void gw_free_program(void)
     program_line_t *p = gw.prog_head;
     while (p) {
         program_line_t *next = p->next;
+        gw_unfold_line(p);
+        gw_eval_free_cache(p);
         free(p->tokens);
         free(p);
         p = next;
@@ -154,7 +163,8 @@ static void stmt_list(void)
     program_line_t *p = gw.prog_head;
     while (p) {
         if (p->num >= start && p->num <= end) {
-            gw_list_line(p->tokens, p->len, listbuf, sizeof(listbuf));
+            gw_list_line(gw_line_text(p), p->len, listbuf,
+                         sizeof(listbuf));
             char line[560];
             snprintf(line, sizeof(line), "%u %s\n", p->num, listbuf);
             if (gw_hal) gw_hal->puts(line);
@@ -206,7 +216,9 @@ static bool advance_data_ptr(void)
             /* Skip REM to end of line */
             if (*gw.data_ptr == TOK_REM || *gw.data_ptr == TOK_SQUOTE)
                 break;
-            gw.data_ptr++;
+            /* Step over whole tokens so constant data is never
+             * mistaken for DATA or end of line */
+            gw.data_ptr += gw_token_len(gw.data_ptr);
         }
 
         /* Move to next program line */
@@ -217,8 +229,10 @@ static bool advance_data_ptr(void)
     }
 }
 
-/* Read one data item as a string (raw text from DATA statement) */
-static void read_data_item(char *buf, int bufsize)
+/* Locate the next data item in the DATA text and step past it. The
+ * item's raw text (without quotes or trailing spaces) is left in the
+ * program line; returns its start and sets *len. */
+static const char *read_data_item(int *len)
 {
     if (!gw.data_ptr || !*gw.data_ptr || *gw.data_ptr == ':') {
         if (!advance_data_ptr())
@@ -228,28 +242,29 @@ static void read_data_item(char *buf, int bufsize)
     /* Skip spaces */
     while (*gw.data_ptr == ' ') gw.data_ptr++;
 
-    int i = 0;
-    if (*gw.data_ptr == '"') {
+    const char *start;
+    const char *p = (const char *)gw.data_ptr;
+    if (*p == '"') {
         /* Quoted string */
-        gw.data_ptr++;
-        while (*gw.data_ptr && *gw.data_ptr != '"' && i < bufsize - 1)
-            buf[i++] = *gw.data_ptr++;
-        if (*gw.data_ptr == '"') gw.data_ptr++;
+        start = ++p;
+        while (*p && *p != '"') p++;
+        *len = p - start;
+        if (*p == '"') p++;
     } else {
         /* Unquoted: read until comma, colon, or end */
-        while (*gw.data_ptr && *gw.data_ptr != ',' && *gw.data_ptr != ':'
-               && i < bufsize - 1) {
-            buf[i++] = *gw.data_ptr++;
-        }
+        start = p;
+        while (*p && *p != ',' && *p != ':') p++;
+        *len = p - start;
         /* Trim trailing spaces */
-        while (i > 0 && buf[i - 1] == ' ') i--;
+        while (*len > 0 && start[*len - 1] == ' ') (*len)--;
     }
-    buf[i] = '\0';
 
     /* Skip comma separator */
-    while (*gw.data_ptr == ' ') gw.data_ptr++;
-    if (*gw.data_ptr == ',')
-        gw.data_ptr++;
+    while (*p == ' ') p++;
+    if (*p == ',')
+        p++;
+    gw.data_ptr = (uint8_t *)p;
+    return start;
 }
 
 static void stmt_read(void)
@@ -269,18 +284,17 @@ static void stmt_read(void)
             var = gw_var_find_or_create(name, type);
         }
 
-        char item[256];
-        read_data_item(item, sizeof(item));
+        int len;
+        const char *item = read_data_item(&len);
 
         gw_value_t val;
         if (type == VT_STR) {
+            if (len > 255) len = 255;
             val.type = VT_STR;
-            val.sval = gw_str_from_cstr(item);
+            val.sval = gw_str_alloc(len);
+            memcpy(val.sval.data, item, len);
         } else {
-            char *end;
-            double d = strtod(item, &end);
-            val.type = VT_DBL;
-            val.dval = d;
+            gw_scan_number(item, item + len, true, type == VT_DBL, &val);
         }
 
         if (arr_elem) {
@@ -371,6 +385,7 @@ static void skip_to_else_or_eol(void)
         if (ch >= 0x11 && ch <= 0x1A) { gw.text_ptr++; continue; }
         if (ch == TOK_CONST_SNG) { gw.text_ptr += 5; continue; }
         if (ch == TOK_CONST_DBL) { gw.text_ptr += 9; continue; }
+        if (ch == TOK_CONST_FOLD) { gw.text_ptr += 3; continue; }
 
         /* Skip string literals */
         if (ch == '"') {
@@ -392,6 +407,246 @@ static void skip_to_else_or_eol(void)
     }
 }
 
+/* ================================================================
+ * Graphics coordinates, VIEW and WINDOW
+ * ================================================================ */
+
+/* One coordinate. Without WINDOW it is a pixel and, as in GW-BASIC,
+ * must fit an INTEGER; world coordinates are saturated when mapped */
+static double eval_coord(void)
+{
+    gw_value_t v = gw_eval_num();
+    double d = gw_to_dbl(&v);
+    return gfx_window_active() ? d : gw_cint(d);
+}
+
+/* (x,y) in world coordinates */
+static void eval_point(double *x, double *y)
+{
+    gw_expect('(');
+    *x = eval_coord();
+    gw_expect(',');
+    *y = eval_coord();
+    gw_expect_rparen();
+}
+
+/* Optional [SCREEN] (x1,y1)-(x2,y2) of VIEW and WINDOW; false if the
+ * statement has no arguments */
+static bool eval_view_box(bool *screen, double box[4])
+{
+    gw_skip_spaces();
+    *screen = gw_chrgot() == TOK_SCREEN;
+    if (*screen) {
+        gw_chrget();
+        gw_skip_spaces();
+    }
+    if (!*screen && gw_chrgot() != '(')
+        return false;
+    eval_point(&box[0], &box[1]);
+    gw_skip_spaces();
+    gw_expect(TOK_MINUS);
+    eval_point(&box[2], &box[3]);
+    return true;
+}
+
+/* VIEW [[SCREEN] (x1,y1)-(x2,y2) [,[fill][,border]]] */
+static void stmt_view(void)
+{
+    bool screen;
+    double box[4];
+    if (!eval_view_box(&screen, box)) {
+        gfx_view_reset();
+        return;
+    }
+    int fill = -1, border = -1;
+    gw_skip_spaces();
+    if (gw_chrgot() == ',') {
+        gw_chrget();
+        gw_skip_spaces();
+        if (gw_chrgot() != ',')
+            fill = gw_eval_int();
+        gw_skip_spaces();
+        if (gw_chrgot() == ',') {
+            gw_chrget();
+            border = gw_eval_int();
+        }
+    }
+    if (!gfx_active())
+        gw_error(ERR_FC);
+    if (!gfx_view(gw_cint(box[0]), gw_cint(box[1]), gw_cint(box[2]),
+                  gw_cint(box[3]), screen, fill, border))
+        gw_error(ERR_FC);
+    if (fill >= 0 || border >= 0)
+        gfx_flush();
+}
+
+/* WINDOW [[SCREEN] (x1,y1)-(x2,y2)] */
+static void stmt_window(void)
+{
+    bool screen;
+    double box[4];
+    if (!eval_view_box(&screen, box)) {
+        gfx_window_reset();
+        return;
+    }
+    if (!gfx_active() || !gfx_window(box[0], box[1], box[2], box[3], screen))
+        gw_error(ERR_FC);
+}
+
+/* ================================================================
+ * Graphics GET / PUT
+ * ================================================================ */
+
+/* The array operand of graphics GET/PUT, optionally with the element
+ * to start at. Blocks are stored as raw bytes in consecutive elements:
+ * two per INTEGER, four per SINGLE and eight per DOUBLE. */
+typedef struct {
+    gw_value_t *first;
+    size_t count;
+    int size;
+} block_array_t;
+
+static block_array_t block_array(void)
+{
+    char name[2];
+    gw_valtype_t type = gw_parse_varname(name);
+    if (type == VT_STR)
+        gw_error(ERR_TM);
+    block_array_t b;
+    gw_skip_spaces();
+    array_entry_t *a;
+    if (gw_chrgot() == '(') {
+        b.first = gw_array_element(name, type);
+        a = gw_array_find(name, type);
+    } else {
+        a = gw_array_get(name, type, 1);
+        b.first = a->data;
+    }
+    b.count = a->total_elements - (size_t)(b.first - a->data);
+    b.size = type == VT_INT ? 2 : type == VT_SNG ? 4 : 8;
+    return b;
+}
+
+static void block_store(block_array_t *b, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i * b->size < len; i++) {
+        uint8_t raw[8] = { 0 };
+        size_t n = len - i * b->size < (size_t)b->size ? len - i * b->size : (size_t)b->size;
+        memcpy(raw, data + i * b->size, n);
+        gw_value_t *v = &b->first[i];
+        if (b->size == 2)
+            v->ival = (int16_t)(raw[0] | raw[1] << 8);
+        else if (b->size == 4)
+            memcpy(&v->fval, raw, 4);
+        else
+            memcpy(&v->dval, raw, 8);
+    }
+}
+
+/* The first len bytes held by the array, which must have them */
+static void block_load(const block_array_t *b, uint8_t *data, size_t len)
+{
+    if (len > b->count * b->size)
+        gw_error(ERR_FC);
+    for (size_t i = 0; i * b->size < len; i++) {
+        const gw_value_t *v = &b->first[i];
+        uint8_t raw[8];
+        if (b->size == 2) {
+            raw[0] = (uint8_t)v->ival;
+            raw[1] = (uint8_t)((uint16_t)v->ival >> 8);
+        } else if (b->size == 4) {
+            memcpy(raw, &v->fval, 4);
+        } else {
+            memcpy(raw, &v->dval, 8);
+        }
+        size_t n = len - i * b->size < (size_t)b->size ? len - i * b->size : (size_t)b->size;
+        memcpy(data + i * b->size, raw, n);
+    }
+}
+
+/* GET (x1,y1)-(x2,y2), array[(subscripts)] */
+static void stmt_gfx_get(void)
+{
+    double wx1, wy1, wx2, wy2;
+    eval_point(&wx1, &wy1);
+    gw_skip_spaces();
+    gw_expect(TOK_MINUS);
+    eval_point(&wx2, &wy2);
+    gw_skip_spaces();
+    gw_expect(',');
+    block_array_t b = block_array();
+
+    if (!gfx_active())
+        gw_error(ERR_FC);
+    int x1, y1, x2, y2;
+    gfx_map(wx1, wy1, &x1, &y1);
+    gfx_map(wx2, wy2, &x2, &y2);
+    if (x1 > x2) { int t = x1; x1 = x2; x2 = t; }
+    if (y1 > y2) { int t = y1; y1 = y2; y2 = t; }
+    if (x1 < 0 || y1 < 0 || x2 >= gfx_get_width() || y2 >= gfx_get_height())
+        gw_error(ERR_FC);
+    int w = x2 - x1 + 1, h = y2 - y1 + 1;
+    size_t len = gfx_block_size(w, h);
+    if (len > b.count * b.size)
+        gw_error(ERR_FC);
+
+    uint8_t *data = malloc(len);
+    if (!data)
+        gw_error(ERR_OM);
+    gfx_get_block(x1, y1, w, h, data);
+    block_store(&b, data, len);
+    free(data);
+}
+
+/* PUT (x,y), array[(subscripts)] [,PSET|PRESET|AND|OR|XOR] */
+static void stmt_gfx_put(void)
+{
+    double wx, wy;
+    eval_point(&wx, &wy);
+    gw_skip_spaces();
+    gw_expect(',');
+    block_array_t b = block_array();
+
+    int op = GFX_XOR;
+    gw_skip_spaces();
+    if (gw_chrgot() == ',') {
+        gw_chrget();
+        gw_skip_spaces();
+        switch (gw_chrgot()) {
+        case TOK_PSET:   op = GFX_PSET; break;
+        case TOK_PRESET: op = GFX_PRESET; break;
+        case TOK_AND:    op = GFX_AND; break;
+        case TOK_OR:     op = GFX_OR; break;
+        case TOK_XOR:    op = GFX_XOR; break;
+        default:         gw_error(ERR_SN);
+        }
+        gw_chrget();
+    }
+
+    if (!gfx_active())
+        gw_error(ERR_FC);
+    int x, y;
+    gfx_map(wx, wy, &x, &y);
+    uint8_t hdr[4];
+    block_load(&b, hdr, 4);
+    int w = (hdr[0] | hdr[1] << 8) / gfx_block_bpp();
+    int h = hdr[2] | hdr[3] << 8;
+    size_t len = gfx_block_size(w, h);
+    if (len > b.count * b.size)
+        gw_error(ERR_FC);
+
+    uint8_t *data = malloc(len);
+    if (!data)
+        gw_error(ERR_OM);
+    block_load(&b, data, len);
+    bool ok = gfx_put_block(x, y, data, len, op);
+    free(data);
+    if (!ok)
+        gw_error(ERR_FC);
+    gfx_set_last(wx, wy);
+    gfx_flush();
+}
+
 /* ================================================================
  * DEF FN
  * ================================================================ */
@@ -426,6 +681,7 @@ static void stmt_def_fn(void)
     fn->param_name[0] = '\0';
     fn->param_name[1] = '\0';
     fn->param_type = VT_SNG;
+    fn->param_slot = -1;
 
     gw_skip_spaces();
     if (gw_chrgot() == '(') {
@@ -495,25 +751,58 @@ gw_value_t gw_eval_fn_call(void)
         has_arg = true;
     }
 
-    /* Save/restore text pointer around body evaluation */
+    return gw_fn_invoke(fn, &arg_val, has_arg);
+}
+
+/* The parameter's variable, found once and remembered in the entry */
+static var_entry_t *fn_param_var(fn_def_t *fn)
+{
+    int slot = fn->param_slot;
+    if (slot >= 0 && slot < gw.var_count) {
+        var_entry_t *v = &gw.vars[slot];
+        if (v->name[0] == fn->param_name[0] && v->name[1] == fn->param_name[1]
+            && v->type == fn->param_type)
+            return v;
+    }
+    var_entry_t *v = gw_var_find_or_create(fn->param_name, fn->param_type);
+    fn->param_slot = (int16_t)(v - gw.vars);
+    return v;
+}
+
+/* Evaluate a DEF FN body for an evaluated argument. As in GW-BASIC the
+ * parameter is bound in its variable for the duration of the call, so
+ * FN bodies called from this one see it too; the variable's previous
+ * value is moved into this frame and moved back afterwards, which keeps
+ * nested and recursive calls independent. Called from eval.c for FN
+ * calls in compiled expressions. */
+gw_value_t gw_fn_invoke(fn_def_t *fn, gw_value_t *arg, bool has_arg)
+{
     uint8_t *save_text = gw.text_ptr;
     program_line_t *save_line = gw.cur_line;
 
-    /* Set parameter if function has one */
     var_entry_t *param_var = NULL;
     gw_value_t saved_val = {0};
     if (fn->param_name[0] && has_arg) {
-        param_var = gw_var_find_or_create(fn->param_name, fn->param_type);
+        param_var = fn_param_var(fn);
         saved_val = param_var->val;
-        if (fn->param_type == VT_STR && saved_val.type == VT_STR)
-            saved_val.sval = gw_str_copy(&param_var->val.sval);
-        gw_var_assign(param_var, &arg_val);
+        if (fn->param_type == VT_STR) {
+            param_var->val.sval.data = NULL;
+            param_var->val.sval.len = 0;
+        }
+        gw_var_assign(param_var, arg);
+    } else if (has_arg && arg->type == VT_STR) {
+        gw_str_free(&arg->sval);
     }
 
+    if (gw.fn_depth >= MAX_FN_DEPTH)
+        gw_error(ERR_OM);
+    gw.fn_depth++;
+
     /* Evaluate the body expression */
     gw.text_ptr = fn->body_text;
     gw.cur_line = fn->body_line;
     gw_value_t result = gw_eval();
+    gw.fn_depth--;
 
     /* Restore parameter */
     if (param_var) {
@@ -789,6 +1078,10 @@ void gw_exec_stmt(void)
         uint8_t xstmt = gw_chrgot();
         if (xstmt == XSTMT_SYSTEM) {
             gw_file_close_all();
+            gfx_shutdown();
+            snd_shutdown();
+            if (gw.show_stats)
+                gw_eval_report();
             if (gw_hal) gw_hal->shutdown();
             exit(0);
         }
@@ -829,6 +1122,11 @@ void gw_exec_stmt(void)
             gw_stmt_field();
             return;
         }
+        if (xstmt == XSTMT_MAT) {
+            gw_chrget();
+            gw_stmt_mat();
+            return;
+        }
         if (xstmt == XSTMT_LSET) {
             gw_chrget();
             gw_stmt_lset();
@@ -841,12 +1139,20 @@ void gw_exec_stmt(void)
         }
         if (xstmt == XSTMT_PUT) {
             gw_chrget();
-            gw_stmt_put();
+            gw_skip_spaces();
+            if (gw_chrgot() == '(')
+                stmt_gfx_put();
+            else
+                gw_stmt_put();
             return;
         }
         if (xstmt == XSTMT_GET) {
             gw_chrget();
-            gw_stmt_get();
+            gw_skip_spaces();
+            if (gw_chrgot() == '(')
+                stmt_gfx_get();
+            else
+                gw_stmt_get();
             return;
         }
         if (xstmt == XSTMT_KILL) {
@@ -883,16 +1189,13 @@ void gw_exec_stmt(void)
         if (xstmt == XSTMT_CIRCLE) {
             gw_chrget();
             gw_skip_spaces();
-            gw_expect('(');
-            int cx = gw_eval_int();
-            gw_expect(',');
-            int cy = gw_eval_int();
-            gw_expect_rparen();
+            double cx, cy;
+            eval_point(&cx, &cy);
             gw_expect(',');
-            int radius = gw_eval_int();
+            gw_value_t tmp = gw_eval_num();
+            double radius = gw_to_dbl(&tmp);
             int color = gfx_get_color();
-            double start_a = 0, end_a = 0, aspect = 0;
-            gw_value_t tmp;
+            double start_a = 0, end_a = 2 * M_PI, aspect = 0;
             gw_skip_spaces();
             if (gw_chrgot() == ',') {
                 gw_chrget();
@@ -921,6 +1224,8 @@ void gw_exec_stmt(void)
                     }
                 }
             }
+            if (fabs(start_a) > 2 * M_PI + 1e-5 || fabs(end_a) > 2 * M_PI + 1e-5)
+                gw_error(ERR_FC);
             gfx_circle(cx, cy, radius, color, start_a, end_a, aspect);
             gfx_flush();
             return;
@@ -940,11 +1245,8 @@ void gw_exec_stmt(void)
         if (xstmt == XSTMT_PAINT) {
             gw_chrget();
             gw_skip_spaces();
-            gw_expect('(');
-            int px = gw_eval_int();
-            gw_expect(',');
-            int py = gw_eval_int();
-            gw_expect_rparen();
+            double px, py;
+            eval_point(&px, &py);
             int fill_c = gfx_get_color(), border_c = 0;
             gw_skip_spaces();
             if (gw_chrgot() == ',') {
@@ -960,9 +1262,29 @@ void gw_exec_stmt(void)
             gfx_flush();
             return;
         }
-        /* PLAY mml-string */
+        /* PLAY ON/OFF/STOP, PLAY mml-string */
         if (xstmt == XSTMT_PLAY) {
             gw_chrget();
+            gw_skip_spaces();
+            if (gw_chrgot() == TOK_ON) {
+                gw_chrget();
+                gw.play_trap.mode = TRAP_ON;
+                events_update();
+                return;
+            }
+            if (gw_chrgot() == TOK_OFF) {
+                gw_chrget();
+                gw.play_trap.mode = TRAP_OFF;
+                gw.play_trap.pending = false;
+                events_update();
+                return;
+            }
+            if (gw_chrgot() == TOK_STOP) {
+                gw_chrget();
+                gw.play_trap.mode = TRAP_STOP;
+                events_update();
+                return;
+            }
             gw_value_t s = gw_eval_str();
             char *cmd = gw_str_to_cstr(&s.sval);
             gw_str_free(&s.sval);
@@ -1031,10 +1353,17 @@ void gw_exec_stmt(void)
             free(pattern);
             return;
         }
+        /* RESET - flush and close all files */
+        if (xstmt == XSTMT_RESET) {
+            gw_chrget();
+            gw_file_close_all();
+            return;
+        }
         /* SHELL [command$] */
         if (xstmt == XSTMT_SHELL) {
             gw_chrget();
             gw_skip_spaces();
+            gw_file_flush_all();
             if (gw_chrgot() && gw_chrgot() != ':' && gw_chrgot() != TOK_ELSE) {
                 gw_value_t v = gw_eval_str();
                 char *cmd = gw_str_to_cstr(&v.sval);
@@ -1095,24 +1424,36 @@ void gw_exec_stmt(void)
             if (gw_chrgot() == TOK_ON) {
                 gw_chrget();
                 gw.timer_trap.trap.mode = TRAP_ON;
+                events_update();
                 return;
             }
             if (gw_chrgot() == TOK_OFF) {
                 gw_chrget();
                 gw.timer_trap.trap.mode = TRAP_OFF;
                 gw.timer_trap.trap.pending = false;
+                events_update();
                 return;
             }
             if (gw_chrgot() == TOK_STOP) {
                 gw_chrget();
                 gw.timer_trap.trap.mode = TRAP_STOP;
+                events_update();
                 return;
             }
             gw_error(ERR_SN);
         }
-        /* Stubs: VIEW, WINDOW, PALETTE */
-        if (xstmt == XSTMT_VIEW ||
-            xstmt == XSTMT_WINDOW || xstmt == XSTMT_PALETTE) {
+        if (xstmt == XSTMT_VIEW) {
+            gw_chrget();
+            stmt_view();
+            return;
+        }
+        if (xstmt == XSTMT_WINDOW) {
+            gw_chrget();
+            stmt_window();
+            return;
+        }
+        /* Stub: PALETTE */
+        if (xstmt == XSTMT_PALETTE) {
             gw_chrget();
             while (gw_chrgot() && gw_chrgot() != ':' && gw_chrgot() != TOK_ELSE)
                 gw.text_ptr++;
@@ -1241,6 +1582,9 @@ void gw_exec_stmt(void)
         gw.option_base = 0;
         memset(&gw.timer_trap, 0, sizeof(gw.timer_trap));
         memset(gw.key_traps, 0, sizeof(gw.key_traps));
+        memset(&gw.play_trap, 0, sizeof(gw.play_trap));
+        snd_set_play_trap(0);
+        events_update();
 
         gw.cur_line = start;
         gw.text_ptr = start->tokens;
@@ -1329,7 +1673,8 @@ void gw_exec_stmt(void)
         program_line_t *line = gw_find_line(num);
         if (!line) gw_error(ERR_UL);
         char listbuf[512];
-        gw_list_line(line->tokens, line->len, listbuf, sizeof(listbuf));
+        gw_list_line(gw_line_text(line), line->len, listbuf,
+                     sizeof(listbuf));
         char formatted[560];
         snprintf(formatted, sizeof(formatted), "%u %s", line->num, listbuf);
         if (tui.active) {
@@ -1415,7 +1760,10 @@ void gw_exec_stmt(void)
             }
         }
 
-        /* Patch line number references in all program lines */
+        /* Patch line number references in all program lines, working
+         * on the text as entered and folding it again afterwards */
+        for (program_line_t *p = gw.prog_head; p; p = p->next)
+            gw_unfold_line(p);
         for (program_line_t *p = gw.prog_head; p; p = p->next) {
             uint8_t *t = p->tokens;
             while (*t) {
@@ -1547,7 +1895,9 @@ void gw_exec_stmt(void)
             if (p->num >= old_start) {
                 p->num = new_nums[idx++];
             }
+            gw_fold_line(p);
         }
+        gw_eval_invalidate();
 
         free(old_nums);
         free(new_nums);
@@ -1600,8 +1950,10 @@ void gw_exec_stmt(void)
         gw.cur_line_num = gw.gosub_stack[gw.gosub_sp].line_num;
 
         /* Clear event handler flag if returning from event trap */
-        if (gw.gosub_stack[gw.gosub_sp].event_source)
+        if (gw.gosub_stack[gw.gosub_sp].event_source) {
             gw.gosub_stack[gw.gosub_sp].event_source->in_handler = false;
+            gw.event_budget = 0;
+        }
 
         /* Optional line number: RETURN <linenum> */
         gw_skip_spaces();
@@ -1674,6 +2026,9 @@ void gw_exec_stmt(void)
         f->loop_text = gw.text_ptr;
         f->loop_line = gw.cur_line;
         f->line_num = gw.cur_line_num;
+
+        /* Fill, copy and reduction loops run as array kernels */
+        gw_array_loop(f);
         return;
     }
 
@@ -1867,6 +2222,7 @@ void gw_exec_stmt(void)
                 if (ch2 >= 0x11 && ch2 <= 0x1A) { gw.text_ptr++; continue; }
                 if (ch2 == TOK_CONST_SNG) { gw.text_ptr += 5; continue; }
                 if (ch2 == TOK_CONST_DBL) { gw.text_ptr += 9; continue; }
+                if (ch2 == TOK_CONST_FOLD) { gw.text_ptr += 3; continue; }
                 if (ch2 == '"') {
                     gw.text_ptr++;
                     while (*gw.text_ptr && *gw.text_ptr != '"')
@@ -1946,6 +2302,26 @@ void gw_exec_stmt(void)
             struct timespec ts;
             clock_gettime(CLOCK_MONOTONIC, &ts);
             gw.timer_trap.last_fire = ts.tv_sec + ts.tv_nsec / 1e9;
+            events_update();
+            return;
+        }
+
+        /* ON PLAY(n) GOSUB line */
+        if (gw_chrgot() == TOK_PREFIX_FE && gw.text_ptr[1] == XSTMT_PLAY) {
+            gw.text_ptr += 2;
+            gw_expect('(');
+            int n = gw_eval_int();
+            if (n < 1 || n > 32) gw_error(ERR_FC);
+            gw_expect(')');
+            gw_skip_spaces();
+            if (gw_chrgot() != TOK_GOSUB) gw_error(ERR_SN);
+            gw_chrget();
+            uint16_t line = gw_eval_uint16();
+            gw.play_trap.gosub_line = line;
+            gw.play_trap.pending = false;
+            gw.play_trap.in_handler = false;
+            snd_set_play_trap(line ? n : 0);
+            events_update();
             return;
         }
 
@@ -1963,6 +2339,7 @@ void gw_exec_stmt(void)
             gw.key_traps[n - 1].gosub_line = line;
             gw.key_traps[n - 1].pending = false;
             gw.key_traps[n - 1].in_handler = false;
+            events_update();
             return;
         }
 
@@ -2065,25 +2442,16 @@ void gw_exec_stmt(void)
         }
         /* LINE (x1,y1)-(x2,y2) [,[color][,B[F]]] */
         if (gw_chrgot() == '(' || gw_chrgot() == TOK_MINUS || gw_chrgot() == TOK_STEP) {
-            int x1, y1, x2, y2;
+            double x1, y1, x2, y2;
             /* First point is optional (uses last point) */
             gw_skip_spaces();
-            if (gw_chrgot() == '(') {
-                gw_chrget();
-                x1 = gw_eval_int();
-                gw_expect(',');
-                y1 = gw_eval_int();
-                gw_expect_rparen();
-            } else {
+            if (gw_chrgot() == '(')
+                eval_point(&x1, &y1);
+            else
                 gfx_get_last(&x1, &y1);
-            }
             gw_skip_spaces();
             gw_expect(TOK_MINUS);
-            gw_expect('(');
-            x2 = gw_eval_int();
-            gw_expect(',');
-            y2 = gw_eval_int();
-            gw_expect_rparen();
+            eval_point(&x2, &y2);
             int color = gfx_get_color();
             int style = GFX_LINE;
             gw_skip_spaces();
@@ -2214,8 +2582,17 @@ void gw_exec_stmt(void)
                 gw.cur_line = gw.err_resume_line;
                 gw.cur_line_num = gw.err_resume_line->num;
                 /* Advance past current statement */
-                while (*gw.text_ptr && *gw.text_ptr != ':')
-                    gw.text_ptr++;
+                while (*gw.text_ptr && *gw.text_ptr != ':') {
+                    if (*gw.text_ptr == '"') {
+                        gw.text_ptr++;
+                        while (*gw.text_ptr && *gw.text_ptr != '"')
+                            gw.text_ptr++;
+                        if (*gw.text_ptr == '"')
+                            gw.text_ptr++;
+                        continue;
+                    }
+                    gw.text_ptr += gw_token_len(gw.text_ptr);
+                }
             }
             return;
         }
@@ -2343,11 +2720,8 @@ void gw_exec_stmt(void)
         int is_preset = (tok == TOK_PRESET);
         gw_chrget();
         gw_skip_spaces();
-        gw_expect('(');
-        int px = gw_eval_int();
-        gw_expect(',');
-        int py = gw_eval_int();
-        gw_expect_rparen();
+        double px, py;
+        eval_point(&px, &py);
         int color = is_preset ? 0 : gfx_get_color();
         gw_skip_spaces();
         if (gw_chrgot() == ',') {
@@ -2372,12 +2746,13 @@ void gw_exec_stmt(void)
         int freq = gw_eval_int();
         gw_skip_spaces();
         gw_expect(',');
-        int dur = gw_eval_int();
+        gw_value_t dv = gw_eval_num();
+        double dur = gw_to_dbl(&dv);    /* ticks; fractions allowed */
         if (freq < 37 || freq > 32767)
             gw_error(ERR_FC);
         if (dur < 0 || dur > 65535)
             gw_error(ERR_FC);
-        snd_tone_sync(freq, dur);
+        snd_tone(freq, dur);
         return;
     }
 
@@ -2395,17 +2770,20 @@ void gw_exec_stmt(void)
             if (gw_chrgot() == TOK_ON) {
                 gw_chrget();
                 gw.key_traps[n - 1].mode = TRAP_ON;
+                events_update();
                 return;
             }
             if (gw_chrgot() == TOK_OFF) {
                 gw_chrget();
                 gw.key_traps[n - 1].mode = TRAP_OFF;
                 gw.key_traps[n - 1].pending = false;
+                events_update();
                 return;
             }
             if (gw_chrgot() == TOK_STOP) {
                 gw_chrget();
                 gw.key_traps[n - 1].mode = TRAP_STOP;
+                events_update();
                 return;
             }
             gw_error(ERR_SN);
@@ -2587,6 +2965,26 @@ void gw_exec_stmt(void)
  * Event Trapping
  * ================================================================ */
 
+/* Statements executed between event polls while a trap is armed.
+ * Keeps clock_gettime/kbhit off the per-statement path. */
+#define EVENT_POLL_STMTS 128
+
+/* Recompute the armed flags after any trap state change, and force a
+ * poll before the next statement so pending events fire immediately. */
+static void events_update(void)
+{
+    gw.key_traps_armed = false;
+    for (int i = 0; i < 10; i++) {
+        if (gw.key_traps[i].gosub_line) {
+            gw.key_traps_armed = true;
+            break;
+        }
+    }
+    gw.events_armed = gw.timer_trap.trap.gosub_line || gw.key_traps_armed
+        || gw.play_trap.gosub_line;
+    gw.event_budget = 0;
+}
+
 static void fire_event_trap(event_trap_t *trap)
 {
     trap->in_handler = true;
@@ -2626,25 +3024,31 @@ static void gw_check_events(void)
                 gw.timer_trap.trap.pending = true;
             }
         }
-    }
 
-    /* Check for pending timer event after TIMER ON */
-    if (gw.timer_trap.trap.pending && gw.timer_trap.trap.mode == TRAP_ON &&
-        !gw.timer_trap.trap.in_handler) {
-        struct timespec ts;
-        clock_gettime(CLOCK_MONOTONIC, &ts);
-        gw.timer_trap.last_fire = ts.tv_sec + ts.tv_nsec / 1e9;
-        fire_event_trap(&gw.timer_trap.trap);
-        return;
+        /* Check for pending timer event after TIMER ON */
+        if (gw.timer_trap.trap.pending && gw.timer_trap.trap.mode == TRAP_ON) {
+            gw.timer_trap.last_fire = now;
+            fire_event_trap(&gw.timer_trap.trap);
+            return;
+        }
     }
 
-    /* Key traps: only consume keystrokes when at least one trap is configured */
-    bool any_key_trap = false;
-    for (int i = 0; i < 10; i++) {
-        if (gw.key_traps[i].gosub_line) { any_key_trap = true; break; }
+    /* Play trap: the background music queue fell below its threshold */
+    if (gw.play_trap.gosub_line) {
+        event_trap_t *pt = &gw.play_trap;
+        if (snd_play_event() && pt->mode != TRAP_OFF)
+            pt->pending = true;
+        if (pt->pending && pt->mode == TRAP_ON && !pt->in_handler) {
+            fire_event_trap(pt);
+            return;
+        }
     }
 
-    if (any_key_trap && gw_hal && gw_hal->kbhit()) {
+    if (!gw.key_traps_armed)
+        return;
+
+    /* Key traps: only consume keystrokes when at least one trap is configured */
+    if (gw_hal && gw_hal->kbhit()) {
         int ch = gw_hal->getch();
         int fkey = -1;
         if (ch == 27 && gw_hal->kbhit()) {
@@ -2754,8 +3158,12 @@ void gw_run_loop(void)
         if (tui.active)
             tui_check_break();
 
-        /* Check event traps (ON TIMER, ON KEY) */
-        gw_check_events();
+        /* Check event traps (ON TIMER, ON KEY), throttled to one poll
+         * every EVENT_POLL_STMTS statements */
+        if (gw.events_armed && --gw.event_budget <= 0) {
+            gw.event_budget = EVENT_POLL_STMTS;
+            gw_check_events();
+        }
 
         gw_skip_spaces();
         uint8_t ch = gw_chrgot();
@@ -2789,5 +3197,6 @@ void gw_run_loop(void)
         if (!gw.running) break;
     }
 
+    gw_file_flush_all();
     if (gw_hal) gw_hal->disable_raw();
 }
@@ -1,5 +1,6 @@
 #include "gwbasic.h"
 #include "tui.h"
+#include "graphics.h"
 #include "sound.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -179,9 +180,23 @@ int main(int argc, char **argv)
             printf("Usage: gwbasic [options] [file.bas]\n"
                    "Options:\n"
                    "  -f, --full         Use full terminal size (default: 25x80)\n"
+                   "  --gfx-out FILE     Write graphics to FILE (.png or .ppm) instead of\n"
+                   "                     the terminal; %%d in the name numbers each frame\n"
+                   "  --gfx-skip N       Write one graphics frame in N (default: 1)\n"
+                   "  --gfx-stream FILE  Append graphics frames to FILE as a PPM stream\n"
                    "  -h, --help         Show this help\n"
+                   "  --iobuf BYTES      Buffer size for sequential files (default: 65536)\n"
                    "  --lpt DEVICE|FILE  Printer output destination (default: LPT1.TXT)\n"
                    "                     Use LPT1 or /dev/lp0 for real hardware\n"
+                   "  --mmap             Memory-map random-access files\n"
+                   "  --nocache          Do not cache compiled expressions\n"
+                   "  --nofold           Do not fold constant expressions\n"
+                   "  --nokernels        Interpret array fill/copy/sum loops normally\n"
+                   "  --reccache N       Records cached per random file (default: 256, 0 = off)\n"
+                   "  --snd-out FILE     Write sound to FILE (.wav, else raw 16-bit PCM;\n"
+                   "                     - for stdout) instead of the audio device\n"
+                   "  --snd-realtime     Play --snd-out sound in real time, not at full speed\n"
+                   "  --stats            Report cache statistics on stderr\n"
                    "  -v, --version      Show version\n");
             return 0;
         }
@@ -193,10 +208,58 @@ int main(int argc, char **argv)
             fullscreen = true;
             continue;
         }
+        if (strcmp(argv[i], "--mmap") == 0) {
+            gw_file_set_mmap(true);
+            continue;
+        }
+        if (strcmp(argv[i], "--nocache") == 0) {
+            gw_eval_set_cache(false);
+            continue;
+        }
+        if (strcmp(argv[i], "--nofold") == 0) {
+            gw_fold_set_enabled(false);
+            continue;
+        }
+        if (strcmp(argv[i], "--nokernels") == 0) {
+            gw_array_set_kernels(false);
+            continue;
+        }
+        if (strcmp(argv[i], "--reccache") == 0 && i + 1 < argc) {
+            gw_file_set_cache(atoi(argv[++i]));
+            continue;
+        }
+        if (strcmp(argv[i], "--stats") == 0) {
+            gw.show_stats = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--gfx-out") == 0 && i + 1 < argc) {
+            gfx_set_output(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--gfx-stream") == 0 && i + 1 < argc) {
+            gfx_set_stream(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--gfx-skip") == 0 && i + 1 < argc) {
+            gfx_set_frame_skip(atoi(argv[++i]));
+            continue;
+        }
+        if (strcmp(argv[i], "--snd-out") == 0 && i + 1 < argc) {
+            snd_set_output(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--snd-realtime") == 0) {
+            snd_set_realtime(true);
+            continue;
+        }
         if (strcmp(argv[i], "--lpt") == 0 && i + 1 < argc) {
             gw_lpt_set_path(argv[++i]);
             continue;
         }
+        if (strcmp(argv[i], "--iobuf") == 0 && i + 1 < argc) {
+            gw_file_set_bufsize(strtoul(argv[++i], NULL, 0));
+            continue;
+        }
         if (argv[i][0] != '-') {
             filename = argv[i];
         }
@@ -232,7 +295,10 @@ int main(int argc, char **argv)
         }
 
         if (!interactive) {
+            if (gw.show_stats)
+                gw_eval_report();
             gw_lpt_close();
+            gfx_shutdown();
             snd_shutdown();
             if (gw_hal) gw_hal->shutdown();
             return 0;
@@ -300,7 +366,10 @@ int main(int argc, char **argv)
 
     if (interactive)
         tui_shutdown();
+    if (gw.show_stats)
+        gw_eval_report();
     gw_lpt_close();
+    gfx_shutdown();
     snd_shutdown();
     if (gw_hal)
         gw_hal->shutdown();
@@ -0,0 +1,447 @@
+#include "gwbasic.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * MAT statements: whole-array arithmetic in the style of Dartmouth BASIC.
+ *
+ *     MAT A = B                     copy
+ *     MAT A = B + C, MAT A = B - C  elementwise sum and difference
+ *     MAT A = B * C                 matrix product
+ *     MAT A = (k) * B               scalar multiple
+ *     MAT A = TRN(B)                transpose
+ *     MAT A = ZER | CON | IDN [(m[,n])]  zeros, ones, identity
+ *     MAT PRINT A [{,|;} B ...]
+ *     MAT INPUT A [, B ...]
+ *
+ * A two-dimensional array is a matrix whose first subscript is the row;
+ * a one-dimensional array is a column vector. Every element from OPTION
+ * BASE up takes part. The result array is created with the shape of the
+ * result if it does not exist, and must already have that shape if it
+ * does.
+ *
+ * The arithmetic is done in double precision on contiguous copies of the
+ * operands, which are column-major like the arrays themselves, and the
+ * result is rounded to the target's type once as it is stored. The
+ * product is blocked so the panels of both operands stay in cache, with
+ * unit-stride inner loops the compiler can vectorise.
+ */
+
+/* Product blocking: rows of the result and depth of each panel */
+#define MAT_ROWS  256
+#define MAT_DEPTH 64
+
+/* Transpose tile size */
+#define MAT_TILE  32
+
+typedef struct {
+    int ndims;
+    int rows, cols;
+} shape_t;
+
+/* Scratch space, kept between statements (an error can leave a MAT
+ * statement at any point, so nothing is allocated per statement) */
+static double *scratch;
+static size_t scratch_cap;
+
+static double *scratch_get(size_t n)
+{
+    if (n > scratch_cap) {
+        double *p = realloc(scratch, n * sizeof(double));
+        if (!p)
+            gw_error(ERR_OM);
+        scratch = p;
+        scratch_cap = n;
+    }
+    return scratch;
+}
+
+/* Element pointers for MAT INPUT, kept the same way */
+static gw_value_t **elem_scratch;
+static size_t elem_cap;
+
+static gw_value_t **elem_scratch_get(size_t n)
+{
+    if (n > elem_cap) {
+        gw_value_t **p = realloc(elem_scratch, n * sizeof(*p));
+        if (!p)
+            gw_error(ERR_OM);
+        elem_scratch = p;
+        elem_cap = n;
+    }
+    return elem_scratch;
+}
+
+static shape_t shape_of(const array_entry_t *a)
+{
+    shape_t s;
+    s.ndims = a->ndims;
+    if (a->ndims == 1) {
+        s.rows = a->dims[0] - gw.option_base + 1;
+        s.cols = 1;
+    } else if (a->ndims == 2) {
+        s.rows = a->dims[0] - gw.option_base + 1;
+        s.cols = a->dims[1] - gw.option_base + 1;
+    } else {
+        gw_error(ERR_BS);
+    }
+    return s;
+}
+
+static size_t shape_size(shape_t s)
+{
+    return (size_t)s.rows * s.cols;
+}
+
+/* ---------------- Operands ---------------- */
+
+/* An array name; an undeclared one is a 10 x 10 matrix, as a reference
+ * with two subscripts would make it */
+static array_entry_t *mat_array(bool numeric)
+{
+    char name[2];
+    gw_valtype_t type = gw_parse_varname(name);
+    if (numeric && type == VT_STR)
+        gw_error(ERR_TM);
+    array_entry_t *a = gw_array_get(name, type, 2);
+    shape_of(a);
+    return a;
+}
+
+/* The target of MAT A = ...: an existing array must have the result's
+ * shape; a missing one is created with it */
+static array_entry_t *mat_target(const char name[2], gw_valtype_t type,
+                                 shape_t s)
+{
+    array_entry_t *a = gw_array_find(name, type);
+    if (a) {
+        shape_t t = shape_of(a);
+        if (t.ndims != s.ndims || t.rows != s.rows || t.cols != s.cols)
+            gw_error(ERR_BS);
+        return a;
+    }
+    int dims[2] = { s.rows - 1 + gw.option_base, s.cols - 1 + gw.option_base };
+    return gw_array_create(name, type, s.ndims, dims);
+}
+
+static void load(const array_entry_t *a, double *buf)
+{
+    const gw_value_t *v = a->data;
+    int n = a->total_elements;
+    switch (a->type) {
+    case VT_INT:
+        for (int i = 0; i < n; i++) buf[i] = v[i].ival;
+        break;
+    case VT_SNG:
+        for (int i = 0; i < n; i++) buf[i] = v[i].fval;
+        break;
+    default:
+        for (int i = 0; i < n; i++) buf[i] = v[i].dval;
+        break;
+    }
+}
+
+/* Round buf to a's type and store it. Every value is checked before
+ * any is written, so an overflow leaves the array as it was. */
+static void store(array_entry_t *a, const double *buf)
+{
+    gw_value_t *v = a->data;
+    int n = a->total_elements;
+    for (int i = 0; i < n; i++) {
+        double x = buf[i];
+        bool ok;
+        switch (a->type) {
+        case VT_INT: ok = x <= 32767.0 && x >= -32768.0; break;
+        case VT_SNG: ok = isfinite((float)x); break;
+        default:     ok = isfinite(x); break;
+        }
+        if (!ok)
+            gw_error(ERR_OV);
+    }
+    switch (a->type) {
+    case VT_INT:
+        for (int i = 0; i < n; i++) v[i].ival = (int16_t)rint(buf[i]);
+        break;
+    case VT_SNG:
+        for (int i = 0; i < n; i++) v[i].fval = (float)buf[i];
+        break;
+    default:
+        for (int i = 0; i < n; i++) v[i].dval = buf[i];
+        break;
+    }
+}
+
+/* ---------------- Kernels ---------------- */
+
+/* c (m x p) = a (m x n) * b (n x p), all column-major. Each element's
+ * products are summed in order of k, as a plain dot product would. */
+static void mat_mul(const double *a, const double *b, double *c,
+                    int m, int n, int p)
+{
+    memset(c, 0, (size_t)m * p * sizeof(double));
+    for (int i0 = 0; i0 < m; i0 += MAT_ROWS) {
+        int i1 = i0 + MAT_ROWS < m ? i0 + MAT_ROWS : m;
+        for (int k0 = 0; k0 < n; k0 += MAT_DEPTH) {
+            int k1 = k0 + MAT_DEPTH < n ? k0 + MAT_DEPTH : n;
+            for (int j = 0; j < p; j++) {
+                double *cj = c + (size_t)j * m;
+                const double *bj = b + (size_t)j * n;
+                for (int k = k0; k < k1; k++) {
+                    const double *ak = a + (size_t)k * m;
+                    double bkj = bj[k];
+                    for (int i = i0; i < i1; i++)
+                        cj[i] += ak[i] * bkj;
+                }
+            }
+        }
+    }
+}
+
+/* c (n x m) = transpose of a (m x n) */
+static void mat_trn(const double *a, double *c, int m, int n)
+{
+    for (int j0 = 0; j0 < n; j0 += MAT_TILE) {
+        int j1 = j0 + MAT_TILE < n ? j0 + MAT_TILE : n;
+        for (int i0 = 0; i0 < m; i0 += MAT_TILE) {
+            int i1 = i0 + MAT_TILE < m ? i0 + MAT_TILE : m;
+            for (int j = j0; j < j1; j++)
+                for (int i = i0; i < i1; i++)
+                    c[j + (size_t)i * n] = a[i + (size_t)j * m];
+        }
+    }
+}
+
+/* ---------------- MAT A = ... ---------------- */
+
+static bool at_end(void)
+{
+    gw_skip_spaces();
+    uint8_t ch = gw_chrgot();
+    return ch == 0 || ch == ':' || ch == TOK_ELSE;
+}
+
+/* ZER, CON, IDN or TRN at the text pointer: consumes it and returns the
+ * word's first letter, else 0 */
+static char mat_function(void)
+{
+    static const char *const words[] = { "ZER", "CON", "IDN", "TRN" };
+    uint8_t *p = gw.text_ptr;
+    for (int w = 0; w < 4; w++) {
+        int k = 0;
+        while (k < 3 && toupper(p[k]) == words[w][k])
+            k++;
+        if (k == 3 && !isalnum(p[3]) && p[3] != '.' && p[3] != '%'
+            && p[3] != '!' && p[3] != '#' && p[3] != '$') {
+            gw.text_ptr += 3;
+            return words[w][0];
+        }
+    }
+    return 0;
+}
+
+/* MAT A = ZER | CON | IDN [(m[,n])] */
+static void mat_fill(const char name[2], gw_valtype_t type, char fn)
+{
+    array_entry_t *a;
+    gw_skip_spaces();
+    if (gw_chrgot() == '(') {
+        gw_chrget();
+        int dims[2], ndims = 0;
+        for (;;) {
+            if (ndims == 2)
+                gw_error(ERR_BS);
+            dims[ndims++] = gw_eval_int();
+            gw_skip_spaces();
+            if (gw_chrgot() != ',')
+                break;
+            gw_chrget();
+        }
+        gw_expect_rparen();
+        shape_t s = { ndims, dims[0] - gw.option_base + 1,
+                      ndims == 2 ? dims[1] - gw.option_base + 1 : 1 };
+        if (s.rows < 1 || s.cols < 1)
+            gw_error(ERR_FC);
+        a = mat_target(name, type, s);
+    } else {
+        a = gw_array_get(name, type, 2);
+    }
+
+    shape_t s = shape_of(a);
+    if (fn == 'I' && (s.ndims != 2 || s.rows != s.cols))
+        gw_error(ERR_BS);
+
+    double *c = scratch_get(shape_size(s));
+    for (size_t i = 0; i < shape_size(s); i++)
+        c[i] = fn == 'C' ? 1.0 : 0.0;
+    if (fn == 'I')
+        for (int i = 0; i < s.rows; i++)
+            c[i + (size_t)i * s.rows] = 1.0;
+    store(a, c);
+}
+
+static void mat_assign(void)
+{
+    char name[2];
+    gw_valtype_t type = gw_parse_varname(name);
+    if (type == VT_STR)
+        gw_error(ERR_TM);
+    gw_skip_spaces();
+    gw_expect(TOK_EQ);
+    gw_skip_spaces();
+
+    /* (k) * B */
+    if (gw_chrgot() == '(') {
+        gw_chrget();
+        gw_value_t kv = gw_eval_num();
+        double k = gw_to_dbl(&kv);
+        gw_expect_rparen();
+        gw_skip_spaces();
+        gw_expect(TOK_MUL);
+        gw_skip_spaces();
+        array_entry_t *b = mat_array(true);
+        shape_t s = shape_of(b);
+        size_t n = shape_size(s);
+        double *buf = scratch_get(n);
+        load(b, buf);
+        for (size_t i = 0; i < n; i++)
+            buf[i] *= k;
+        store(mat_target(name, type, s), buf);
+        return;
+    }
+
+    char fn = mat_function();
+    if (fn == 'T') {
+        gw_skip_spaces();
+        gw_expect('(');
+        array_entry_t *b = mat_array(true);
+        gw_expect_rparen();
+        shape_t s = shape_of(b);
+        if (s.ndims != 2)
+            gw_error(ERR_BS);
+        size_t n = shape_size(s);
+        double *buf = scratch_get(2 * n);
+        load(b, buf);
+        mat_trn(buf, buf + n, s.rows, s.cols);
+        shape_t t = { 2, s.cols, s.rows };
+        store(mat_target(name, type, t), buf + n);
+        return;
+    }
+    if (fn) {
+        mat_fill(name, type, fn);
+        return;
+    }
+
+    array_entry_t *b = mat_array(true);
+    shape_t sb = shape_of(b);
+    gw_skip_spaces();
+    uint8_t op = gw_chrgot();
+    if (op != TOK_PLUS && op != TOK_MINUS && op != TOK_MUL) {
+        /* Copy */
+        double *buf = scratch_get(shape_size(sb));
+        load(b, buf);
+        store(mat_target(name, type, sb), buf);
+        return;
+    }
+    gw_chrget();
+    array_entry_t *c = mat_array(true);
+    shape_t sc = shape_of(c);
+
+    if (op == TOK_MUL) {
+        /* (m x n) * (n x p); a vector on the right gives a vector */
+        if (sb.cols != sc.rows)
+            gw_error(ERR_BS);
+        shape_t s = { sc.ndims, sb.rows, sc.cols };
+        size_t nb = shape_size(sb), nc = shape_size(sc);
+        double *buf = scratch_get(nb + nc + shape_size(s));
+        load(b, buf);
+        load(c, buf + nb);
+        mat_mul(buf, buf + nb, buf + nb + nc, sb.rows, sb.cols, sc.cols);
+        store(mat_target(name, type, s), buf + nb + nc);
+        return;
+    }
+
+    if (sb.ndims != sc.ndims || sb.rows != sc.rows || sb.cols != sc.cols)
+        gw_error(ERR_BS);
+    size_t n = shape_size(sb);
+    double *buf = scratch_get(2 * n);
+    load(b, buf);
+    load(c, buf + n);
+    if (op == TOK_PLUS)
+        for (size_t i = 0; i < n; i++) buf[i] += buf[n + i];
+    else
+        for (size_t i = 0; i < n; i++) buf[i] -= buf[n + i];
+    store(mat_target(name, type, sb), buf);
+}
+
+/* ---------------- MAT PRINT / MAT INPUT ---------------- */
+
+/* One row per line; a comma after the name prints in zones, a
+ * semicolon packs the values */
+static void mat_print_array(const array_entry_t *a, bool packed)
+{
+    shape_t s = shape_of(a);
+    for (int i = 0; i < s.rows; i++) {
+        for (int j = 0; j < s.cols; j++) {
+            if (j > 0 && !packed)
+                gw_print_zone();
+            gw_value_t v = a->data[i + (size_t)j * s.rows];
+            if (v.type == VT_STR)
+                v.sval = gw_str_copy(&a->data[i + (size_t)j * s.rows].sval);
+            gw_print_value(&v);
+        }
+        gw_print_newline();
+    }
+}
+
+static void mat_print(void)
+{
+    for (;;) {
+        array_entry_t *a = mat_array(false);
+        gw_skip_spaces();
+        bool packed = gw_chrgot() == ';';
+        if (gw_chrgot() == ',' || packed)
+            gw_chrget();
+        mat_print_array(a, packed);
+        if (at_end())
+            break;
+        gw_print_newline();
+    }
+}
+
+static void mat_input(void)
+{
+    for (;;) {
+        array_entry_t *a = mat_array(false);
+        shape_t s = shape_of(a);
+        gw_value_t **elems = elem_scratch_get(shape_size(s));
+        int n = 0;
+        for (int i = 0; i < s.rows; i++)
+            for (int j = 0; j < s.cols; j++)
+                elems[n++] = &a->data[i + (size_t)j * s.rows];
+        gw_input_values(elems, n, a->type);
+
+        gw_skip_spaces();
+        if (gw_chrgot() != ',')
+            break;
+        gw_chrget();
+    }
+}
+
+void gw_stmt_mat(void)
+{
+    gw_skip_spaces();
+    uint8_t tok = gw_chrgot();
+    if (tok == TOK_PRINT) {
+        gw_chrget();
+        mat_print();
+    } else if (tok == TOK_INPUT) {
+        gw_chrget();
+        mat_input();
+    } else {
+        mat_assign();
+    }
+    if (!at_end())
+        gw_error(ERR_SN);
+}
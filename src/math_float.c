@@ -2,7 +2,6 @@
 #include <math.h>
 #include <float.h>
 #include <string.h>
-#include <stdio.h>
 
 static void check_overflow(double r)
 {
@@ -111,135 +110,20 @@ double gw_cdbl(gw_value_t *v)
     return gw_to_dbl(v);
 }
 
-/* Number formatting for PRINT - matches GW-BASIC's FOUT */
+/* Number formatting for PRINT - matches GW-BASIC's FOUT.
+ * The digits come from gw_num_to_text (num_format.c). */
 void gw_format_number(gw_value_t *v, char *buf, int bufsize)
 {
-    switch (v->type) {
-    case VT_INT:
-        snprintf(buf, bufsize, "% d", v->ival);
-        break;
-    case VT_SNG: {
-        /* GW-BASIC prints up to 7 significant digits for single */
-        double d = v->fval;
-        if (d == 0.0) {
-            snprintf(buf, bufsize, " 0");
-            break;
-        }
-        double ad = fabs(d);
-        if (ad >= 0.01 && ad < 1e7) {
-            /* Try fixed notation */
-            char tmp[32];
-            for (int prec = 7; prec >= 0; prec--) {
-                snprintf(tmp, sizeof(tmp), "%.*f", prec, d);
-                /* Count significant digits */
-                int sig = 0;
-                for (char *p = tmp; *p; p++) {
-                    if (*p == '-' || *p == ' ') continue;
-                    if (*p == '.') continue;
-                    if (sig == 0 && *p == '0') continue;
-                    sig++;
-                }
-                if (sig <= 7) {
-                    /* Remove trailing zeros after decimal point */
-                    char *dot = strchr(tmp, '.');
-                    if (dot) {
-                        char *end = tmp + strlen(tmp) - 1;
-                        while (end > dot && *end == '0') *end-- = '\0';
-                        if (end == dot) *end = '\0';
-                    }
-                    if (d >= 0)
-                        snprintf(buf, bufsize, " %s", tmp);
-                    else
-                        snprintf(buf, bufsize, "%s", tmp);
-                    return;
-                }
-            }
-        }
-        /* Scientific notation - GW-BASIC uses format like 1.234E+10 */
-        {
-            char tmp[32];
-            snprintf(tmp, sizeof(tmp), "%.6E", fabs(d));
-            /* Strip trailing zeros before E: 1.000000E+10 -> 1E+10 */
-            char *e = strchr(tmp, 'E');
-            if (e) {
-                char *p = e - 1;
-                while (p > tmp && *p == '0') p--;
-                if (*p == '.') p--;  /* remove dot if no fractional part */
-                memmove(p + 1, e, strlen(e) + 1);
-                e = strchr(tmp, 'E');
-            }
-            /* Convert 3-digit exponent to 2-digit: E+010 -> E+10 */
-            if (e && strlen(e) >= 5 && e[2] == '0') {
-                memmove(e + 2, e + 3, strlen(e + 3) + 1);
-            }
-            if (d < 0)
-                snprintf(buf, bufsize, "-%s", tmp);
-            else
-                snprintf(buf, bufsize, " %s", tmp);
-        }
-        break;
-    }
-    case VT_DBL: {
-        double d = v->dval;
-        if (d == 0.0) {
-            snprintf(buf, bufsize, " 0");
-            break;
-        }
-        double ad = fabs(d);
-        if (ad >= 0.01 && ad < 1e16) {
-            char tmp[32];
-            for (int prec = 16; prec >= 0; prec--) {
-                snprintf(tmp, sizeof(tmp), "%.*f", prec, d);
-                int sig = 0;
-                for (char *p = tmp; *p; p++) {
-                    if (*p == '-' || *p == ' ') continue;
-                    if (*p == '.') continue;
-                    if (sig == 0 && *p == '0') continue;
-                    sig++;
-                }
-                if (sig <= 16) {
-                    char *dot = strchr(tmp, '.');
-                    if (dot) {
-                        char *end = tmp + strlen(tmp) - 1;
-                        while (end > dot && *end == '0') *end-- = '\0';
-                        if (end == dot) *end = '\0';
-                    }
-                    if (d >= 0)
-                        snprintf(buf, bufsize, " %s", tmp);
-                    else
-                        snprintf(buf, bufsize, "%s", tmp);
-                    return;
-                }
-            }
-        }
-        /* Scientific with D exponent for double precision */
-        {
-            char tmp[32];
-            snprintf(tmp, sizeof(tmp), "%.15E", fabs(d));
-            /* Strip trailing zeros before E: 1.000000000000000E+10 -> 1E+10 */
-            char *e = strchr(tmp, 'E');
-            if (e) {
-                char *p = e - 1;
-                while (p > tmp && *p == '0') p--;
-                if (*p == '.') p--;
-                memmove(p + 1, e, strlen(e) + 1);
-                e = strchr(tmp, 'E');
-            }
-            if (e) *e = 'D';  /* GW-BASIC uses D for double */
-            /* Convert 3-digit exponent to 2-digit: D+010 -> D+10 */
-            if (e && strlen(e) >= 5 && e[2] == '0') {
-                memmove(e + 2, e + 3, strlen(e + 3) + 1);
-            }
-            if (d < 0)
-                snprintf(buf, bufsize, "-%s", tmp);
-            else
-                snprintf(buf, bufsize, " %s", tmp);
-        }
-        break;
-    }
-    default:
-        snprintf(buf, bufsize, "?");
+    if (bufsize >= GW_NUM_TEXT_MAX) {
+        gw_num_to_text(v, buf);
+        return;
     }
+    char tmp[GW_NUM_TEXT_MAX];
+    int n = gw_num_to_text(v, tmp);
+    if (n >= bufsize)
+        n = bufsize - 1;
+    memcpy(buf, tmp, n);
+    buf[n] = '\0';
 }
 
 /* MBF conversion routines */
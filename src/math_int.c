@@ -3,26 +3,26 @@
 
 int16_t gw_int_add(int16_t a, int16_t b)
 {
-    int32_t r = (int32_t)a + (int32_t)b;
-    if (r < -32768 || r > 32767)
+    int16_t r;
+    if (__builtin_add_overflow(a, b, &r))
         gw_error(ERR_OV);
-    return (int16_t)r;
+    return r;
 }
 
 int16_t gw_int_sub(int16_t a, int16_t b)
 {
-    int32_t r = (int32_t)a - (int32_t)b;
-    if (r < -32768 || r > 32767)
+    int16_t r;
+    if (__builtin_sub_overflow(a, b, &r))
         gw_error(ERR_OV);
-    return (int16_t)r;
+    return r;
 }
 
 int16_t gw_int_mul(int16_t a, int16_t b)
 {
-    int32_t r = (int32_t)a * (int32_t)b;
-    if (r < -32768 || r > 32767)
+    int16_t r;
+    if (__builtin_mul_overflow(a, b, &r))
         gw_error(ERR_OV);
-    return (int16_t)r;
+    return r;
 }
 
 int16_t gw_int_div(int16_t a, int16_t b)
@@ -35,6 +35,7 @@ int16_t gw_int_div(int16_t a, int16_t b)
 int16_t gw_int_mod(int16_t a, int16_t b)
 {
     if (b == 0) gw_error(ERR_DZ);
+    if (b == -1) return 0;      /* -32768 MOD -1 would trap */
     return a % b;
 }
 
@@ -0,0 +1,403 @@
+#include "gw_math.h"
+#include <math.h>
+#include <string.h>
+#include <stdbool.h>
+
+/*
+ * Number-to-text conversion without libc formatting.
+ *
+ * Produces exactly the text of gw_format_number: a leading space or
+ * minus sign, up to 7 (single) or 16 (double) significant digits in
+ * fixed notation between 0.01 and 10^7 / 10^16, scientific notation
+ * with an E or D exponent otherwise. Rounding is done on the exact
+ * binary value, ties to even, as printf does, so the two agree digit
+ * for digit.
+ */
+
+static const uint64_t pow10_u64[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL
+};
+
+/* ================================================================
+ * Minimal unsigned bignum for exact decimal scaling
+ * ================================================================ */
+
+/* Enough for a 53-bit mantissa times 10^340, the extreme needed for
+ * subnormal doubles */
+#define BN_WORDS 48
+
+typedef struct {
+    int n;                  /* words in use; w[n-1] != 0 unless n == 0 */
+    uint32_t w[BN_WORDS];
+} bignum_t;
+
+static void bn_set_u64(bignum_t *a, uint64_t v)
+{
+    a->n = 0;
+    while (v) {
+        a->w[a->n++] = (uint32_t)v;
+        v >>= 32;
+    }
+}
+
+static void bn_mul_u32(bignum_t *a, uint32_t m)
+{
+    if (m == 0) {
+        a->n = 0;
+        return;
+    }
+    uint64_t carry = 0;
+    for (int i = 0; i < a->n; i++) {
+        uint64_t t = (uint64_t)a->w[i] * m + carry;
+        a->w[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    if (carry)
+        a->w[a->n++] = (uint32_t)carry;
+}
+
+static void bn_mul_pow10(bignum_t *a, int k)
+{
+    while (k >= 9) {
+        bn_mul_u32(a, 1000000000u);
+        k -= 9;
+    }
+    if (k > 0)
+        bn_mul_u32(a, (uint32_t)pow10_u64[k]);
+}
+
+static void bn_shl(bignum_t *a, int bits)
+{
+    if (a->n == 0 || bits == 0)
+        return;
+    int words = bits / 32, b = bits % 32;
+    if (b) {
+        uint32_t carry = 0;
+        for (int i = 0; i < a->n; i++) {
+            uint32_t v = a->w[i];
+            a->w[i] = (v << b) | carry;
+            carry = v >> (32 - b);
+        }
+        if (carry)
+            a->w[a->n++] = carry;
+    }
+    if (words) {
+        memmove(a->w + words, a->w, a->n * sizeof(uint32_t));
+        memset(a->w, 0, words * sizeof(uint32_t));
+        a->n += words;
+    }
+}
+
+static int bn_cmp(const bignum_t *a, const bignum_t *b)
+{
+    if (a->n != b->n)
+        return a->n < b->n ? -1 : 1;
+    for (int i = a->n - 1; i >= 0; i--) {
+        if (a->w[i] != b->w[i])
+            return a->w[i] < b->w[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void bn_add(bignum_t *a, const bignum_t *b)
+{
+    int n = a->n > b->n ? a->n : b->n;
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t t = carry;
+        if (i < a->n) t += a->w[i];
+        if (i < b->n) t += b->w[i];
+        a->w[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    a->n = n;
+    if (carry)
+        a->w[a->n++] = (uint32_t)carry;
+}
+
+/* a -= b; requires a >= b */
+static void bn_sub(bignum_t *a, const bignum_t *b)
+{
+    uint32_t borrow = 0;
+    for (int i = 0; i < a->n; i++) {
+        uint64_t sub = (uint64_t)(i < b->n ? b->w[i] : 0) + borrow;
+        borrow = a->w[i] < sub;
+        a->w[i] = (uint32_t)(a->w[i] - sub);
+    }
+    while (a->n > 0 && a->w[a->n - 1] == 0)
+        a->n--;
+}
+
+/* r = a * m */
+static void bn_mul_u64(bignum_t *r, const bignum_t *a, uint64_t m)
+{
+    *r = *a;
+    bn_mul_u32(r, (uint32_t)m);
+    if (m >> 32) {
+        bignum_t hi = *a;
+        bn_mul_u32(&hi, (uint32_t)(m >> 32));
+        bn_shl(&hi, 32);
+        bn_add(r, &hi);
+    }
+}
+
+/* ================================================================
+ * Exact rounding
+ * ================================================================ */
+
+/* 64x64 -> 128-bit product from 32-bit halves (no __int128 needed) */
+static void mul_64x64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+    uint64_t a0 = (uint32_t)a, a1 = a >> 32;
+    uint64_t b0 = (uint32_t)b, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+    *lo = (mid << 32) | (uint32_t)p00;
+    *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+}
+
+/* floor(x * 10^k) for finite x > 0, computed on the exact binary
+ * value; *up is set if rounding to nearest, ties to even, would add
+ * one. The result must fit in 64 bits. */
+static uint64_t scale_floor(double x, int k, bool *up)
+{
+    int e;
+    uint64_t m = (uint64_t)ldexp(frexp(x, &e), 53);
+    e -= 53;
+    while (!(m & 1)) {
+        m >>= 1;
+        e++;
+    }
+
+    /* Fast path: m * 10^k as a 128-bit hi:lo pair, shifted right by
+     * the binary exponent. Covers every fixed-notation value. */
+    if (k >= 0 && k < 20) {
+        uint64_t hi, lo;
+        mul_64x64(m, pow10_u64[k], &hi, &lo);
+        if (e >= 0) {
+            if (hi == 0 && e < 64 && lo <= (UINT64_MAX >> e)) {
+                *up = false;
+                return lo << e;
+            }
+        } else if (e > -128 && (e <= -64 || (hi >> -e) == 0)) {
+            int s = -e;
+            uint64_t q, r_hi, r_lo, h_hi, h_lo;
+            if (s < 64) {
+                q = (lo >> s) | (hi << (64 - s));
+                r_hi = 0;
+                r_lo = lo & ((1ULL << s) - 1);
+                h_hi = 0;
+                h_lo = 1ULL << (s - 1);
+            } else if (s == 64) {
+                q = hi;
+                r_hi = 0;
+                r_lo = lo;
+                h_hi = 0;
+                h_lo = 1ULL << 63;
+            } else {
+                q = hi >> (s - 64);
+                r_hi = hi & ((1ULL << (s - 64)) - 1);
+                r_lo = lo;
+                h_hi = 1ULL << (s - 65);
+                h_lo = 0;
+            }
+            bool gt = r_hi > h_hi || (r_hi == h_hi && r_lo > h_lo);
+            bool eq = r_hi == h_hi && r_lo == h_lo;
+            *up = gt || (eq && (q & 1));
+            return q;
+        }
+    }
+
+    /* x * 10^k = num / den exactly */
+    bignum_t num, den, t;
+    bn_set_u64(&num, m);
+    bn_set_u64(&den, 1);
+    if (k >= 0)
+        bn_mul_pow10(&num, k);
+    else
+        bn_mul_pow10(&den, -k);
+    if (e >= 0)
+        bn_shl(&num, e);
+    else
+        bn_shl(&den, -e);
+
+    /* Estimate the quotient in floating point, then correct it */
+    long double est = (long double)x * powl(10.0L, k / 2)
+                      * powl(10.0L, k - k / 2);
+    uint64_t q = est < 1.8e19L ? (uint64_t)est : UINT64_MAX;
+    bn_mul_u64(&t, &den, q);
+    while (bn_cmp(&t, &num) > 0) {
+        bn_sub(&t, &den);
+        q--;
+    }
+    for (;;) {
+        bignum_t u = t;
+        bn_add(&u, &den);
+        if (bn_cmp(&u, &num) > 0)
+            break;
+        t = u;
+        q++;
+    }
+
+    /* Remainder against half the divisor */
+    bn_sub(&num, &t);
+    bn_shl(&num, 1);
+    int c = bn_cmp(&num, &den);
+    *up = c > 0 || (c == 0 && (q & 1));
+    return q;
+}
+
+static uint64_t scale_round(double x, int k)
+{
+    bool up;
+    uint64_t q = scale_floor(x, k, &up);
+    return q + up;
+}
+
+/* ================================================================
+ * Text assembly
+ * ================================================================ */
+
+/* Write v as exactly `width` digits, zero-padded; returns end */
+static char *put_digits(char *p, uint64_t v, int width)
+{
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = (char)('0' + v % 10);
+        v /= 10;
+    }
+    return p + width;
+}
+
+static int count_digits(uint64_t v)
+{
+    int n = 1;
+    while (n < 20 && v >= pow10_u64[n])
+        n++;
+    return n;
+}
+
+/* Single or double: `sig` significant digits, fixed notation below
+ * 10^sig, `expch` ('E' or 'D') in scientific notation */
+static int format_float(double d, int sig, char expch, char *out)
+{
+    char *p = out;
+
+    if (d == 0.0) {
+        memcpy(out, " 0", 3);
+        return 2;
+    }
+    double x = fabs(d);
+    if (isnan(x) || isinf(x)) {
+        *p++ = (d < 0) ? '-' : ' ';
+        memcpy(p, isnan(x) ? "NAN" : "INF", 4);
+        return (int)(p - out) + 3;
+    }
+
+    if (x >= 0.01 && x < (double)pow10_u64[sig]) {
+        /* Most decimals that still leave at most `sig` digits */
+        int prec = sig;
+        if (x >= 1.0) {
+            int e10 = (int)log10(x);
+            while (e10 > 0 && x < (double)pow10_u64[e10])
+                e10--;
+            while (e10 + 1 < sig && x >= (double)pow10_u64[e10 + 1])
+                e10++;
+            prec = sig - 1 - e10;
+        }
+        for (; prec >= 0; prec--) {
+            uint64_t s = scale_round(x, prec);
+            if (s >= pow10_u64[sig])
+                continue;       /* rounding carried into another digit */
+
+            if (d < 0)
+                *p++ = '-';
+            else
+                *p++ = ' ';
+            uint64_t ip = s / pow10_u64[prec];
+            uint64_t fp = s % pow10_u64[prec];
+            p = put_digits(p, ip, count_digits(ip));
+            if (fp) {
+                int fd = prec;
+                while (fp % 10 == 0) {
+                    fp /= 10;
+                    fd--;
+                }
+                *p++ = '.';
+                /* leading zeros of the fraction come from the width */
+                p = put_digits(p, fp, fd);
+            }
+            *p = '\0';
+            return (int)(p - out);
+        }
+    }
+
+    /* Scientific: find the exact decimal exponent from the truncated
+     * digits (log10 can be off by one), then round; a carry out of the
+     * last digit moves the exponent as printf does */
+    int e10 = (int)floor(log10(x));
+    uint64_t s;
+    bool up;
+    for (;;) {
+        s = scale_floor(x, sig - 1 - e10, &up);
+        if (s >= pow10_u64[sig])
+            e10++;
+        else if (s < pow10_u64[sig - 1])
+            e10--;
+        else
+            break;
+    }
+    s += up;
+    if (s == pow10_u64[sig]) {
+        s = pow10_u64[sig - 1];
+        e10++;
+    }
+
+    *p++ = (d < 0) ? '-' : ' ';
+    uint64_t lead = s / pow10_u64[sig - 1];
+    uint64_t rest = s % pow10_u64[sig - 1];
+    *p++ = (char)('0' + lead);
+    if (rest) {
+        int rd = sig - 1;
+        while (rest % 10 == 0) {
+            rest /= 10;
+            rd--;
+        }
+        *p++ = '.';
+        p = put_digits(p, rest, rd);
+    }
+    *p++ = expch;
+    *p++ = (e10 < 0) ? '-' : '+';
+    int ae = e10 < 0 ? -e10 : e10;
+    p = put_digits(p, (uint64_t)ae, ae >= 100 ? 3 : 2);
+    *p = '\0';
+    return (int)(p - out);
+}
+
+/* Format a numeric value as PRINT shows it (without the trailing
+ * space). `out` must hold GW_NUM_TEXT_MAX bytes; returns the length. */
+int gw_num_to_text(const gw_value_t *v, char *out)
+{
+    switch (v->type) {
+    case VT_INT: {
+        int n = v->ival;
+        unsigned u = n < 0 ? (unsigned)-n : (unsigned)n;
+        char *p = out;
+        *p++ = n < 0 ? '-' : ' ';
+        p = put_digits(p, u, count_digits(u));
+        *p = '\0';
+        return (int)(p - out);
+    }
+    case VT_SNG:
+        return format_float(v->fval, 7, 'E', out);
+    case VT_DBL:
+        return format_float(v->dval, 16, 'D', out);
+    default:
+        memcpy(out, "?", 2);
+        return 1;
+    }
+}
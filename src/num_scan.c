@@ -0,0 +1,245 @@
+#include "gwbasic.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Text-to-number scanner shared by VAL, INPUT, INPUT# and READ.
+ *
+ * Accepts GW-BASIC numeric syntax: an optional sign, &H hex, &O or &
+ * octal, decimal digits with an optional point, an E (single) or D
+ * (double) exponent, and a %, ! or # type suffix. The result type
+ * follows the rules for numeric constants: INTEGER when there is no
+ * point, exponent or suffix and the value fits in 16 bits, DOUBLE for
+ * a D exponent, # suffix or more than 7 significant digits, SINGLE
+ * otherwise, and DOUBLE again if a SINGLE would overflow. When the
+ * value is for a DOUBLE variable (READ, INPUT and INPUT# into a #
+ * variable), a non-INTEGER result is DOUBLE unless it has a ! suffix.
+ *
+ * Scanning works on the source bytes in place. Decimal values of up to
+ * 15 significant digits and powers of ten up to 10^22 are converted
+ * exactly with one multiply or divide; anything else goes through
+ * strtod on a compacted copy of the digits.
+ */
+
+static const double pow10_dbl[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Digits kept for the strtod fallback; more cannot change a double */
+#define SCAN_DIGITS_MAX 800
+
+typedef struct {
+    const char *p, *end;
+    bool blanks;            /* skip embedded blanks, as VAL does */
+} scan_t;
+
+static int peek(scan_t *s)
+{
+    if (s->blanks)
+        while (s->p < s->end && *s->p == ' ')
+            s->p++;
+    return s->p < s->end ? (unsigned char)*s->p : 0;
+}
+
+static int upper(int c)
+{
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+/* &H / &O / & radix constants: 16-bit INTEGER, Overflow beyond */
+static void scan_radix(scan_t *s, bool neg, gw_value_t *out)
+{
+    int base = 8;
+    s->p++;                                     /* & */
+    int c = upper(peek(s));
+    if (c == 'H') {
+        base = 16;
+        s->p++;
+    } else if (c == 'O') {
+        s->p++;
+    }
+
+    uint32_t v = 0;
+    for (;;) {
+        c = upper(peek(s));
+        int d;
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if (base == 16 && c >= 'A' && c <= 'F')
+            d = c - 'A' + 10;
+        else
+            break;
+        if (d >= base)
+            break;
+        v = v * base + d;
+        if (v > 0xFFFF)
+            gw_error(ERR_OV);
+        s->p++;
+    }
+
+    int32_t iv = (int16_t)v;
+    if (neg)
+        iv = -iv;
+    if (iv > 32767) {
+        out->type = VT_SNG;
+        out->fval = (float)iv;
+    } else {
+        out->type = VT_INT;
+        out->ival = (int16_t)iv;
+    }
+}
+
+const char *gw_scan_number(const char *p, const char *end, bool blanks,
+                           bool dbl, gw_value_t *out)
+{
+    scan_t s = { p, end, blanks };
+    bool neg = false;
+
+    int c = peek(&s);
+    if (c == '+' || c == '-') {
+        neg = c == '-';
+        s.p++;
+        c = peek(&s);
+    }
+
+    if (c == '&') {
+        scan_radix(&s, neg, out);
+        return s.p;
+    }
+
+    /* Mantissa: significant digits are gathered into mant while they
+     * fit, and also into digits[] for the slow path */
+    char digits[SCAN_DIGITS_MAX + 1];
+    int ndig = 0;               /* significant digits seen */
+    int kept = 0;               /* digits stored in digits[] */
+    uint64_t mant = 0;
+    int dexp = 0;               /* decimal exponent of mant */
+    bool dot = false, any = false;
+    bool is_dbl = false, is_sng = false;
+
+    for (;;) {
+        c = peek(&s);
+        if (c >= '0' && c <= '9') {
+            any = true;
+            if (ndig > 0 || c != '0') {
+                if (ndig < 19)
+                    mant = mant * 10 + (c - '0');
+                else
+                    dexp++;
+                if (kept < SCAN_DIGITS_MAX)
+                    digits[kept++] = (char)c;
+                ndig++;
+            }
+            if (dot)
+                dexp--;
+            s.p++;
+        } else if (c == '.' && !dot) {
+            dot = true;
+            s.p++;
+        } else {
+            break;
+        }
+    }
+
+    /* Exponent */
+    int exp10 = 0;
+    c = upper(peek(&s));
+    if (any && (c == 'E' || c == 'D')) {
+        is_dbl = c == 'D';
+        is_sng = c == 'E';
+        s.p++;
+        bool eneg = false;
+        c = peek(&s);
+        if (c == '+' || c == '-') {
+            eneg = c == '-';
+            s.p++;
+        }
+        while ((c = peek(&s)) >= '0' && c <= '9') {
+            if (exp10 < 100000)
+                exp10 = exp10 * 10 + (c - '0');
+            s.p++;
+        }
+        if (eneg)
+            exp10 = -exp10;
+    }
+
+    /* Type suffix directly after the number */
+    bool is_int = false, sng_suffix = false;
+    if (s.p < s.end) {
+        c = (unsigned char)*s.p;
+        if (c == '%') {
+            is_int = true;
+            s.p++;
+        } else if (c == '!') {
+            is_sng = sng_suffix = true;
+            s.p++;
+        } else if (c == '#') {
+            is_dbl = true;
+            s.p++;
+        }
+    }
+
+    /* Value as a double */
+    double d;
+    int e = dexp + exp10;
+    if (mant == 0) {
+        d = 0.0;
+    } else if (ndig <= 15 && e >= -22 && e <= 22) {
+        /* Both operands exact, so one rounding: correctly rounded */
+        d = e < 0 ? (double)mant / pow10_dbl[-e] : (double)mant * pow10_dbl[e];
+    } else {
+        /* digits[] holds the leading significant digits; mant holds
+         * the first min(ndig, 19) of them, so rescale to the last kept */
+        char buf[SCAN_DIGITS_MAX + 16];
+        int len = kept;
+        memcpy(buf, digits, len);
+        int ke = e - (kept - (ndig < 19 ? ndig : 19));
+        buf[len++] = 'E';
+        int ev = ke < 0 ? -ke : ke;
+        char tmp[12];
+        int ti = 0;
+        do {
+            tmp[ti++] = (char)('0' + ev % 10);
+            ev /= 10;
+        } while (ev);
+        if (ke < 0)
+            buf[len++] = '-';
+        while (ti)
+            buf[len++] = tmp[--ti];
+        buf[len] = '\0';
+        d = strtod(buf, NULL);
+    }
+    if (neg)
+        d = -d;
+
+    if (is_int) {
+        out->type = VT_INT;
+        out->ival = gw_cint(d);
+        return s.p;
+    }
+
+    if (!dot && !is_sng && !is_dbl && d >= -32768.0 && d <= 32767.0) {
+        out->type = VT_INT;
+        out->ival = (int16_t)d;
+        return s.p;
+    }
+
+    if (!is_dbl && !is_sng && ndig > 7)
+        is_dbl = true;
+    if (dbl && !sng_suffix)
+        is_dbl = true;
+    if (!is_dbl && (d > FLT_MAX || d < -FLT_MAX))
+        is_dbl = true;
+    if (is_dbl) {
+        if (d - d != 0.0)
+            gw_error(ERR_OV);
+        out->type = VT_DBL;
+        out->dval = d;
+    } else {
+        out->type = VT_SNG;
+        out->fval = (float)d;
+    }
+    return s.p;
+}
@@ -65,6 +65,20 @@ void gw_print_newline(void)
     print_char('\n');
 }
 
+/* Move to the next 14-column print zone, as a comma in PRINT does */
+void gw_print_zone(void)
+{
+    int screen_width = gw_hal ? gw_hal->screen_width : 80;
+    int zone_width = 14;
+    int target = ((print_col / zone_width) + 1) * zone_width;
+    if (target >= screen_width) {
+        gw_print_newline();
+    } else {
+        while (print_col < target)
+            print_char(' ');
+    }
+}
+
 void gw_print_value(gw_value_t *v)
 {
     if (v->type == VT_STR) {
@@ -109,9 +123,6 @@ void gw_stmt_print(void)
     }
 
     int need_newline = 1;
-    int screen_width = 80;
-    if (gw_hal)
-        screen_width = gw_hal->screen_width;
 
     for (;;) {
         gw_skip_spaces();
@@ -128,14 +139,7 @@ void gw_stmt_print(void)
 
         if (tok == ',') {
             gw_chrget();
-            int zone_width = 14;
-            int target = ((print_col / zone_width) + 1) * zone_width;
-            if (target >= screen_width) {
-                gw_print_newline();
-            } else {
-                while (print_col < target)
-                    print_char(' ');
-            }
+            gw_print_zone();
             need_newline = 0;
             continue;
         }
@@ -294,7 +298,8 @@ void gw_stmt_llist(void)
     program_line_t *p = gw.prog_head;
     while (p) {
         if (p->num >= start && p->num <= end) {
-            gw_list_line(p->tokens, p->len, listbuf, sizeof(listbuf));
+            gw_list_line(gw_line_text(p), p->len, listbuf,
+                         sizeof(listbuf));
             fprintf(fp, "%u %s\n", p->num, listbuf);
         }
         if (p->num > end)
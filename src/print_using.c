@@ -24,89 +24,112 @@
  *   \ \     Fixed width (count chars between backslashes inclusive)
  *
  * _       Literal escape: next char printed as-is
+ *
+ * A format string is compiled once into a list of ops (literal runs with
+ * escapes resolved, and fields with their flags already parsed) and kept
+ * in a small cache keyed by the string's contents, so a PRINT USING in a
+ * loop does not re-scan its format for every value.  Each statement's
+ * output is collected in one buffer and written out at the end.
  */
 
-/* Output helpers */
-static void pu_putch(FILE *fp, int ch)
+/* ================================================================
+ * Compiled format programs
+ * ================================================================ */
+
+enum {
+    PU_LIT,         /* literal run: text + lit, len bytes */
+    PU_NUM,         /* numeric field */
+    PU_FIRST,       /* ! */
+    PU_ALL,         /* & */
+    PU_WIDTH        /* \  \ : len characters, space padded */
+};
+
+typedef struct {
+    bool leading_plus, trailing_plus, trailing_minus;
+    bool dollar, asterisk_fill, use_commas, scientific, has_decimal;
+    int total_digits;       /* total # positions */
+    int decimal_digits;     /* -1 = no decimal point */
+} num_spec_t;
+
+typedef struct {
+    uint8_t kind;
+    int start;              /* offset of the op in the format string */
+    int lit;                /* PU_LIT: offset into the literal text */
+    int len;                /* PU_LIT: byte count; PU_WIDTH: field width */
+    num_spec_t num;
+} pu_op_t;
+
+typedef struct {
+    char *fmt;              /* format string contents (the cache key) */
+    int fmtlen;
+    uint32_t hash;
+    char *text;             /* literal runs, escapes resolved */
+    pu_op_t *ops;
+    int nops;
+    bool has_field;
+    unsigned stamp;         /* last use, for LRU replacement */
+} pu_prog_t;
+
+#define PU_CACHE_SIZE 8
+
+static pu_prog_t pu_cache[PU_CACHE_SIZE];
+static unsigned pu_clock;
+
+/* Parse a numeric field spec (fmt points at its first character) */
+static void parse_num_spec(const char *fmt, int fmtlen, num_spec_t *ns)
 {
-    if (fp) {
-        fputc(ch, fp);
-    } else if (gw_hal) {
-        gw_hal->putch(ch);
-    } else {
-        putchar(ch);
-    }
-}
-
-static void pu_puts(FILE *fp, const char *s)
-{
-    while (*s)
-        pu_putch(fp, *s++);
-}
-
-/* Format a numeric value according to the format spec */
-static void format_number(FILE *fp, const char *fmt, int fmtlen, double val)
-{
-    /* Parse the format spec */
-    bool leading_plus = false, trailing_plus = false;
-    bool trailing_minus = false;
-    bool dollar = false;
-    bool asterisk_fill = false;
-    bool use_commas = false;
-    bool scientific = false;
-    int total_digits = 0;  /* total # positions */
-    int decimal_digits = -1;  /* -1 = no decimal point */
-    bool has_decimal = false;
+    memset(ns, 0, sizeof(*ns));
+    ns->decimal_digits = -1;
 
     int i = 0;
 
     /* Check leading + */
     if (i < fmtlen && fmt[i] == '+') {
-        leading_plus = true;
+        ns->leading_plus = true;
         i++;
     }
 
     /* Check ** or **$ or $$ */
     if (i + 1 < fmtlen && fmt[i] == '*' && fmt[i + 1] == '*') {
-        asterisk_fill = true;
-        total_digits += 2;
+        ns->asterisk_fill = true;
+        ns->total_digits += 2;
         i += 2;
         if (i < fmtlen && fmt[i] == '$') {
-            dollar = true;
+            ns->dollar = true;
             i++;
-            total_digits++;
+            ns->total_digits++;
         }
     } else if (i + 1 < fmtlen && fmt[i] == '$' && fmt[i + 1] == '$') {
-        dollar = true;
-        total_digits += 2;
+        ns->dollar = true;
+        ns->total_digits += 2;
         i += 2;
     }
 
     /* Count # before decimal */
     while (i < fmtlen && fmt[i] == '#') {
-        total_digits++;
+        ns->total_digits++;
         i++;
     }
 
     /* Check for comma */
     if (i < fmtlen && fmt[i] == ',') {
-        use_commas = true;
+        ns->use_commas = true;
         i++;
     }
 
     /* More # after comma but before decimal */
     while (i < fmtlen && fmt[i] == '#') {
-        total_digits++;
+        ns->total_digits++;
         i++;
     }
 
     /* Decimal point */
     if (i < fmtlen && fmt[i] == '.') {
-        has_decimal = true;
-        decimal_digits = 0;
+        ns->has_decimal = true;
+        ns->decimal_digits = 0;
         i++;
         while (i < fmtlen && fmt[i] == '#') {
-            decimal_digits++;
+            ns->decimal_digits++;
             i++;
         }
     }
@@ -118,30 +141,241 @@ static void format_number(FILE *fp, const char *fmt, int fmtlen, double val)
         i++;
     }
     if (caret_count >= 4)
-        scientific = true;
+        ns->scientific = true;
 
     /* Trailing sign */
-    if (i < fmtlen && fmt[i] == '+') {
-        trailing_plus = true;
-        i++;
-    } else if (i < fmtlen && fmt[i] == '-') {
-        trailing_minus = true;
-        i++;
+    if (i < fmtlen && fmt[i] == '+')
+        ns->trailing_plus = true;
+    else if (i < fmtlen && fmt[i] == '-')
+        ns->trailing_minus = true;
+}
+
+/* Length of the numeric field starting at fmt[fi] */
+static int num_field_end(const char *fmt, int fmtlen, int fi)
+{
+    /* Leading + */
+    if (fi < fmtlen && fmt[fi] == '+') fi++;
+
+    /* ** or **$ or $$ */
+    if (fi + 1 < fmtlen && fmt[fi] == '*' && fmt[fi + 1] == '*') {
+        fi += 2;
+        if (fi < fmtlen && fmt[fi] == '$') fi++;
+    } else if (fi + 1 < fmtlen && fmt[fi] == '$' && fmt[fi + 1] == '$') {
+        fi += 2;
+    }
+
+    /* # digits and commas */
+    while (fi < fmtlen && (fmt[fi] == '#' || fmt[fi] == ','))
+        fi++;
+
+    /* Decimal point and fraction digits */
+    if (fi < fmtlen && fmt[fi] == '.') {
+        fi++;
+        while (fi < fmtlen && fmt[fi] == '#')
+            fi++;
+    }
+
+    /* Carets for scientific notation */
+    while (fi < fmtlen && fmt[fi] == '^')
+        fi++;
+
+    /* Trailing sign */
+    if (fi < fmtlen && (fmt[fi] == '+' || fmt[fi] == '-'))
+        fi++;
+
+    return fi;
+}
+
+static bool is_field_start(const char *fmt, int fmtlen, int fi)
+{
+    char ch = fmt[fi];
+
+    /* Numeric format start */
+    if (ch == '#' || ch == '+' || ch == '.' ||
+        (ch == '*' && fi + 1 < fmtlen && fmt[fi + 1] == '*') ||
+        (ch == '$' && fi + 1 < fmtlen && fmt[fi + 1] == '$'))
+        return true;
+
+    /* String format start */
+    return ch == '!' || ch == '&' || ch == '\\';
+}
+
+/* Split a format string into literal runs and fields.  The op sequence
+ * is exactly the order in which the statement loop visits them, so
+ * running the program reproduces a character-by-character scan. */
+static void compile_format(pu_prog_t *p, const char *fmt, int fmtlen)
+{
+    int fi = 0, ti = 0;
+
+    /* At most one op per format character */
+    p->ops = malloc(sizeof(pu_op_t) * (fmtlen > 0 ? fmtlen : 1));
+    p->text = malloc(fmtlen > 0 ? fmtlen : 1);
+    if (!p->ops || !p->text)
+        gw_error(ERR_OM);
+    p->nops = 0;
+    p->has_field = false;
+
+    while (fi < fmtlen) {
+        pu_op_t *op = &p->ops[p->nops++];
+        op->start = fi;
+
+        if (!is_field_start(fmt, fmtlen, fi)) {
+            /* Literal run up to the next field */
+            op->kind = PU_LIT;
+            op->lit = ti;
+            while (fi < fmtlen) {
+                if (fmt[fi] == '_') {
+                    fi++;
+                    if (fi < fmtlen)
+                        p->text[ti++] = fmt[fi++];
+                    continue;
+                }
+                if (is_field_start(fmt, fmtlen, fi))
+                    break;
+                p->text[ti++] = fmt[fi++];
+            }
+            op->len = ti - op->lit;
+            continue;
+        }
+
+        p->has_field = true;
+        char ch = fmt[fi];
+        if (ch == '!') {
+            op->kind = PU_FIRST;
+            fi++;
+        } else if (ch == '&') {
+            op->kind = PU_ALL;
+            fi++;
+        } else if (ch == '\\') {
+            /* Count to closing backslash */
+            fi++;
+            while (fi < fmtlen && fmt[fi] != '\\')
+                fi++;
+            if (fi < fmtlen) fi++;  /* skip closing backslash */
+            op->kind = PU_WIDTH;
+            op->len = fi - op->start;
+        } else {
+            op->kind = PU_NUM;
+            fi = num_field_end(fmt, fmtlen, fi);
+            parse_num_spec(fmt + op->start, fi - op->start, &op->num);
+        }
     }
+}
+
+static uint32_t format_hash(const char *s, int len)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++)
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+/* Return the compiled program for a format string, compiling it into
+ * the least recently used cache slot on a miss */
+static pu_prog_t *format_lookup(const char *fmt, int fmtlen)
+{
+    uint32_t h = format_hash(fmt, fmtlen);
+    pu_prog_t *victim = &pu_cache[0];
+
+    for (int i = 0; i < PU_CACHE_SIZE; i++) {
+        pu_prog_t *p = &pu_cache[i];
+        if (p->fmt && p->hash == h && p->fmtlen == fmtlen &&
+            memcmp(p->fmt, fmt, fmtlen) == 0) {
+            p->stamp = ++pu_clock;
+            return p;
+        }
+        if (!p->fmt || (victim->fmt && p->stamp < victim->stamp))
+            victim = p;
+    }
+
+    free(victim->fmt);
+    free(victim->text);
+    free(victim->ops);
+    memset(victim, 0, sizeof(*victim));
+
+    /* The key goes in last so a failed compile never leaves a slot
+     * that can be hit */
+    compile_format(victim, fmt, fmtlen);
+    char *key = malloc(fmtlen > 0 ? fmtlen : 1);
+    if (!key)
+        gw_error(ERR_OM);
+    memcpy(key, fmt, fmtlen);
+    victim->fmt = key;
+    victim->fmtlen = fmtlen;
+    victim->hash = h;
+    victim->stamp = ++pu_clock;
+    return victim;
+}
+
+/* ================================================================
+ * Statement output buffer
+ * ================================================================ */
+
+static char *pu_out;
+static int pu_len, pu_cap;
+
+static void pu_reserve(int n)
+{
+    if (pu_len + n <= pu_cap)
+        return;
+    int cap = pu_cap ? pu_cap : 256;
+    while (cap < pu_len + n)
+        cap *= 2;
+    char *p = realloc(pu_out, cap);
+    if (!p)
+        gw_error(ERR_OM);
+    pu_out = p;
+    pu_cap = cap;
+}
+
+static void pu_putch(int ch)
+{
+    pu_reserve(1);
+    pu_out[pu_len++] = (char)ch;
+}
+
+static void pu_write(const char *s, int n)
+{
+    pu_reserve(n);
+    memcpy(pu_out + pu_len, s, n);
+    pu_len += n;
+}
+
+/* Send the statement's output to fp, or to the screen when fp is NULL */
+static void pu_flush(FILE *fp)
+{
+    if (fp) {
+        fwrite(pu_out, 1, pu_len, fp);
+    } else if (gw_hal) {
+        for (int i = 0; i < pu_len; i++)
+            gw_hal->putch(pu_out[i]);
+    } else {
+        fwrite(pu_out, 1, pu_len, stdout);
+    }
+    pu_len = 0;
+}
+
+/* ================================================================
+ * Field formatting
+ * ================================================================ */
+
+/* Format a numeric value according to the format spec */
+static void format_number(const num_spec_t *ns, double val)
+{
+    bool leading_plus = ns->leading_plus, trailing_plus = ns->trailing_plus;
+    bool trailing_minus = ns->trailing_minus;
+    bool dollar = ns->dollar;
+    bool asterisk_fill = ns->asterisk_fill;
+    bool has_decimal = ns->has_decimal;
+    int total_digits = ns->total_digits;
+    int decimal_digits = ns->decimal_digits;
 
     /* Format the number */
     bool negative = val < 0;
     double absval = fabs(val);
 
-    if (scientific) {
+    if (ns->scientific) {
         int dec = decimal_digits >= 0 ? decimal_digits : 0;
-        char numbuf[64];
-        snprintf(numbuf, sizeof(numbuf), "%+.*E", dec, val);
-
-        /* Reformat to match GW-BASIC: sign, digits, E+nn */
-        int field_width = total_digits + (has_decimal ? 1 : 0) + 5; /* E+nn + sign */
-        if (leading_plus || trailing_plus || trailing_minus)
-            field_width++;
 
         char outbuf[64];
         int oi = 0;
@@ -178,9 +412,8 @@ static void format_number(FILE *fp, const char *fmt, int fmtlen, double val)
             outbuf[oi++] = negative ? '-' : '+';
         else if (trailing_minus)
             outbuf[oi++] = negative ? '-' : ' ';
-        outbuf[oi] = '\0';
 
-        pu_puts(fp, outbuf);
+        pu_write(outbuf, oi);
         return;
     }
 
@@ -204,7 +437,7 @@ static void format_number(FILE *fp, const char *fmt, int fmtlen, double val)
 
     /* Handle commas */
     char int_with_commas[80];
-    if (use_commas) {
+    if (ns->use_commas) {
         int ilen = strlen(intpart);
         int oi = 0;
         for (int j = 0; j < ilen; j++) {
@@ -249,15 +482,15 @@ static void format_number(FILE *fp, const char *fmt, int fmtlen, double val)
 
     if (numlen > total_field) {
         /* Overflow: print % followed by the number */
-        pu_putch(fp, '%');
+        pu_putch('%');
         if (!sign_placed && !trailing_plus && !trailing_minus) {
-            if (negative) pu_putch(fp, '-');
+            if (negative) pu_putch('-');
         }
-        pu_puts(fp, numstr);
+        pu_write(numstr, numlen);
         if (trailing_plus)
-            pu_putch(fp, negative ? '-' : '+');
+            pu_putch(negative ? '-' : '+');
         else if (trailing_minus)
-            pu_putch(fp, negative ? '-' : ' ');
+            pu_putch(negative ? '-' : ' ');
         return;
     }
 
@@ -316,33 +549,31 @@ static void format_number(FILE *fp, const char *fmt, int fmtlen, double val)
         result[ri++] = negative ? '-' : '+';
     else if (trailing_minus)
         result[ri++] = negative ? '-' : ' ';
-    result[ri] = '\0';
 
-    pu_puts(fp, result);
+    pu_write(result, ri);
 }
 
 /* Format a string value */
-static void format_string(FILE *fp, const char *fmt, int fmtlen, gw_string_t *s)
+static void format_string(const pu_op_t *op, gw_string_t *s)
 {
-    if (fmtlen == 1 && fmt[0] == '!') {
+    switch (op->kind) {
+    case PU_FIRST:
         /* First character only */
-        if (s->len > 0)
-            pu_putch(fp, s->data[0]);
-        else
-            pu_putch(fp, ' ');
-    } else if (fmtlen == 1 && fmt[0] == '&') {
+        pu_putch(s->len > 0 ? s->data[0] : ' ');
+        break;
+    case PU_ALL:
         /* Entire string */
-        for (int i = 0; i < s->len; i++)
-            pu_putch(fp, s->data[i]);
-    } else if (fmt[0] == '\\') {
+        pu_write(s->data, s->len);
+        break;
+    case PU_WIDTH: {
         /* Fixed width: count chars between backslashes, inclusive */
-        int width = fmtlen;  /* includes both backslashes */
-        for (int i = 0; i < width; i++) {
-            if (i < s->len)
-                pu_putch(fp, s->data[i]);
-            else
-                pu_putch(fp, ' ');
-        }
+        int n = s->len < op->len ? s->len : op->len;
+        pu_write(s->data, n);
+        pu_reserve(op->len - n);
+        memset(pu_out + pu_len, ' ', op->len - n);
+        pu_len += op->len - n;
+        break;
+    }
     }
 }
 
@@ -355,16 +586,16 @@ void gw_print_using(FILE *fp)
 {
     gw_skip_spaces();
     gw_value_t fmt_val = gw_eval_str();
-    char *fmt = gw_str_to_cstr(&fmt_val.sval);
-    int fmtlen = fmt_val.sval.len;
+    pu_prog_t *prog = format_lookup(fmt_val.sval.data, fmt_val.sval.len);
     gw_str_free(&fmt_val.sval);
 
     gw_skip_spaces();
     if (gw_chrgot() == ';')
         gw_chrget();
 
-    int fi = 0;  /* format index */
+    int pc = 0;  /* op index */
     bool had_semicolon = false;
+    pu_len = 0;
 
     for (;;) {
         gw_skip_spaces();
@@ -373,109 +604,32 @@ void gw_print_using(FILE *fp)
             break;
 
         /* Reset format position if we've gone past the end */
-        if (fi >= fmtlen)
-            fi = 0;
-
-        /* Output literal characters until we hit a format spec */
-        while (fi < fmtlen) {
-            char ch = fmt[fi];
-
-            /* Literal escape */
-            if (ch == '_') {
-                fi++;
-                if (fi < fmtlen)
-                    pu_putch(fp, fmt[fi++]);
-                continue;
-            }
-
-            /* Numeric format start */
-            if (ch == '#' || ch == '+' || ch == '.' ||
-                (ch == '*' && fi + 1 < fmtlen && fmt[fi + 1] == '*') ||
-                (ch == '$' && fi + 1 < fmtlen && fmt[fi + 1] == '$'))
-                break;
+        if (pc >= prog->nops)
+            pc = 0;
 
-            /* String format start */
-            if (ch == '!' || ch == '&' || ch == '\\')
-                break;
-
-            /* Regular character - output as literal */
-            pu_putch(fp, ch);
-            fi++;
+        /* Output literal runs until we hit a format spec */
+        while (pc < prog->nops && prog->ops[pc].kind == PU_LIT) {
+            pu_write(prog->text + prog->ops[pc].lit, prog->ops[pc].len);
+            pc++;
         }
 
-        if (fi >= fmtlen) {
-            /* Check if there are more values to format */
-            gw_skip_spaces();
-            tok = gw_chrgot();
-            if (tok == 0 || tok == ':' || tok == TOK_ELSE)
-                break;
+        if (pc >= prog->nops) {
+            /* A format with no fields can never consume a value */
+            if (!prog->has_field)
+                gw_error(ERR_FC);
             /* More values: reset format and re-enter the loop */
-            fi = 0;
+            pc = 0;
             continue;
         }
 
-        /* Determine format spec type and length */
-        char ch = fmt[fi];
-
-        /* String formats */
-        if (ch == '!') {
-            gw_value_t v = gw_eval_str();
-            format_string(fp, "!", 1, &v.sval);
-            gw_str_free(&v.sval);
-            fi++;
-        } else if (ch == '&') {
-            gw_value_t v = gw_eval_str();
-            format_string(fp, "&", 1, &v.sval);
-            gw_str_free(&v.sval);
-            fi++;
-        } else if (ch == '\\') {
-            /* Count to closing backslash */
-            int start = fi;
-            fi++;
-            while (fi < fmtlen && fmt[fi] != '\\')
-                fi++;
-            if (fi < fmtlen) fi++;  /* skip closing backslash */
-            int width = fi - start;
+        const pu_op_t *op = &prog->ops[pc++];
+        if (op->kind == PU_NUM) {
+            gw_value_t v = gw_eval_num();
+            format_number(&op->num, gw_to_dbl(&v));
+        } else {
             gw_value_t v = gw_eval_str();
-            format_string(fp, fmt + start, width, &v.sval);
+            format_string(op, &v.sval);
             gw_str_free(&v.sval);
-        } else {
-            /* Numeric format - collect the entire spec */
-            int start = fi;
-
-            /* Leading + */
-            if (fi < fmtlen && fmt[fi] == '+') fi++;
-
-            /* ** or **$ or $$ */
-            if (fi + 1 < fmtlen && fmt[fi] == '*' && fmt[fi + 1] == '*') {
-                fi += 2;
-                if (fi < fmtlen && fmt[fi] == '$') fi++;
-            } else if (fi + 1 < fmtlen && fmt[fi] == '$' && fmt[fi + 1] == '$') {
-                fi += 2;
-            }
-
-            /* # digits and commas */
-            while (fi < fmtlen && (fmt[fi] == '#' || fmt[fi] == ','))
-                fi++;
-
-            /* Decimal point and fraction digits */
-            if (fi < fmtlen && fmt[fi] == '.') {
-                fi++;
-                while (fi < fmtlen && fmt[fi] == '#')
-                    fi++;
-            }
-
-            /* Carets for scientific notation */
-            while (fi < fmtlen && fmt[fi] == '^')
-                fi++;
-
-            /* Trailing sign */
-            if (fi < fmtlen && (fmt[fi] == '+' || fmt[fi] == '-'))
-                fi++;
-
-            gw_value_t v = gw_eval_num();
-            double dv = gw_to_dbl(&v);
-            format_number(fp, fmt + start, fi - start, dv);
         }
 
         /* Check for separator */
@@ -493,22 +647,22 @@ void gw_print_using(FILE *fp)
             break;
     }
 
-    /* Output remaining literal chars from format */
+    /* Output remaining format chars as literals */
+    const char *fmt = prog->fmt;
+    int fmtlen = prog->fmtlen;
+    int fi = pc < prog->nops ? prog->ops[pc].start : fmtlen;
     while (fi < fmtlen) {
         if (fmt[fi] == '_') {
             fi++;
             if (fi < fmtlen)
-                pu_putch(fp, fmt[fi++]);
+                pu_putch(fmt[fi++]);
         } else {
-            pu_putch(fp, fmt[fi++]);
+            pu_putch(fmt[fi++]);
         }
     }
 
     if (!had_semicolon)
-        pu_putch(fp, '\n');
-
-    if (fp)
-        fflush(fp);
+        pu_putch('\n');
 
-    free(fmt);
+    pu_flush(fp);
 }
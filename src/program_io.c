@@ -31,7 +31,8 @@ void gw_stmt_save(void)
     char listbuf[512];
     program_line_t *p = gw.prog_head;
     while (p) {
-        gw_list_line(p->tokens, p->len, listbuf, sizeof(listbuf));
+        gw_list_line(gw_line_text(p), p->len, listbuf,
+                     sizeof(listbuf));
         fprintf(fp, "%u %s\n", p->num, listbuf);
         p = p->next;
     }
@@ -1,8 +1,16 @@
 #include "sound.h"
 #include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
 
 #ifdef HAVE_PULSEAUDIO
 #include <pulse/simple.h>
@@ -11,12 +19,40 @@
 
 #define SAMPLE_RATE 44100
 #define FADE_SAMPLES 220  /* ~5ms at 44100 Hz */
+#define TICK_RATE 18.2    /* timer ticks per second, the unit of SOUND */
+#define RENDER_BLOCK 1024 /* samples synthesized per write */
 
 /* MML parser state (persists across PLAY calls, reset by snd_reset) */
 static int mml_octave;
 static int mml_length;   /* default note length (quarter = 4) */
 static int mml_tempo;    /* BPM */
 static int mml_artic;    /* articulation: 7 = normal, 8 = legato, 3 = staccato (n/8) */
+static bool mml_background;  /* MB: PLAY and SOUND return without waiting */
+
+/*
+ * Notes are played by an audio thread. PLAY, SOUND and BEEP append to a
+ * single-producer, single-consumer ring: the interpreter advances
+ * note_head after filling an entry, and the audio thread advances
+ * note_tail once the note has gone to the device, so head - tail notes
+ * are still to play and neither side takes a lock. In the foreground
+ * (MF) a statement waits for the ring to drain; in the background (MB)
+ * it returns at once, waiting only while the ring is full.
+ */
+#define NOTE_QUEUE 32
+
+typedef struct {
+    int freq;               /* Hz; below 37 is a rest */
+    uint32_t on, off;       /* samples sounding, then silent */
+    bool background;
+} snd_note_t;
+
+static snd_note_t note_queue[NOTE_QUEUE];
+static atomic_uint note_head, note_tail;
+static sem_t note_ready;            /* one post per note, one to stop */
+static pthread_t audio_thread;
+static bool audio_running;
+static atomic_int play_threshold;   /* ON PLAY(n), 0 when not set */
+static atomic_bool play_event;      /* background queue fell below it */
 
 #ifdef HAVE_PULSEAUDIO
 static pa_simple *pa_conn = NULL;
@@ -30,8 +66,16 @@ static void pa_open(void)
         .rate = SAMPLE_RATE,
         .channels = 1
     };
+    /* A short server buffer keeps PLAY(n) close to what is heard */
+    pa_buffer_attr ba = {
+        .maxlength = (uint32_t)-1,
+        .tlength = SAMPLE_RATE / 10 * sizeof(int16_t),
+        .prebuf = (uint32_t)-1,
+        .minreq = (uint32_t)-1,
+        .fragsize = (uint32_t)-1
+    };
     pa_conn = pa_simple_new(NULL, "gwbasic", PA_STREAM_PLAYBACK,
-                            NULL, "sound", &ss, NULL, NULL, NULL);
+                            NULL, "sound", &ss, NULL, &ba, NULL);
 }
 
 static void pa_write_samples(int16_t *buf, int count)
@@ -48,90 +92,443 @@ static void pa_drain(void)
 }
 #endif /* HAVE_PULSEAUDIO */
 
-void snd_init(void)
+static void pause_ms(int ms)
 {
-    snd_reset();
+    struct timespec ts = { 0, ms * 1000000L };
+    nanosleep(&ts, NULL);
 }
 
-void snd_shutdown(void)
+/*
+ * File output (--snd-out): samples go to a WAV file, or as raw 16-bit
+ * little-endian mono PCM to any other file, a FIFO or "-" for stdout,
+ * in place of the audio device. With "-" the sound keeps the original
+ * standard output and the program's text goes to standard error. The file holds just the notes played,
+ * back to back, so the same program always renders the same bytes. It
+ * is written as fast as notes are synthesized unless --snd-realtime
+ * paces it like a device, keeping PLAY and SOUND timing.
+ */
+#define PACE_LEAD 0.1   /* seconds a paced file runs ahead, as a device buffer */
+
+static const char *out_path;
+static int out_stdout = -1;         /* original stdout, for "-" */
+static FILE *out_file;
+static bool out_wav, out_failed;
+static bool out_realtime;
+static uint32_t out_samples;        /* written, for the WAV sizes */
+static uint64_t pace_samples;       /* written since pacing restarted */
+static struct timespec pace_start;
+
+void snd_set_output(const char *path)
 {
-#ifdef HAVE_PULSEAUDIO
-    if (pa_conn) {
-        pa_simple_drain(pa_conn, NULL);
-        pa_simple_free(pa_conn);
-        pa_conn = NULL;
+    out_path = path;
+    if (strcmp(path, "-") == 0 && out_stdout < 0) {
+        fflush(stdout);
+        out_stdout = dup(STDOUT_FILENO);
+        if (out_stdout >= 0)
+            dup2(STDERR_FILENO, STDOUT_FILENO);
     }
-#endif
 }
 
-void snd_reset(void)
+void snd_set_realtime(bool on)
 {
-    mml_octave = 4;
-    mml_length = 4;
-    mml_tempo = 120;
-    mml_artic = 7;
+    out_realtime = on;
+}
+
+static void put16le(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32le(uint8_t *p, uint32_t v)
+{
+    put16le(p, v & 0xFFFF);
+    put16le(p + 2, v >> 16);
+}
+
+/* RIFF header for data_bytes of PCM; 0xFFFFFFFF while the size is
+ * unknown, which players read as "to the end of the stream" */
+static void wav_header(uint8_t *h, uint32_t data_bytes)
+{
+    memcpy(h, "RIFF", 4);
+    put32le(h + 4, data_bytes == 0xFFFFFFFF ? data_bytes : data_bytes + 36);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32le(h + 16, 16);
+    put16le(h + 20, 1);                         /* PCM */
+    put16le(h + 22, 1);                         /* mono */
+    put32le(h + 24, SAMPLE_RATE);
+    put32le(h + 28, SAMPLE_RATE * 2);
+    put16le(h + 32, 2);
+    put16le(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    put32le(h + 40, data_bytes);
+}
+
+static bool out_open(void)
+{
+    if (out_file)
+        return true;
+    if (out_failed)
+        return false;
+    const char *ext = strrchr(out_path, '.');
+    out_wav = ext && (ext[1] == 'w' || ext[1] == 'W')
+                  && (ext[2] == 'a' || ext[2] == 'A')
+                  && (ext[3] == 'v' || ext[3] == 'V') && !ext[4];
+    out_file = out_stdout >= 0 ? fdopen(out_stdout, "wb") : fopen(out_path, "wb");
+    if (!out_file) {
+        fprintf(stderr, "Cannot write sound to %s\n", out_path);
+        out_failed = true;
+        return false;
+    }
+    if (out_wav) {
+        uint8_t h[44];
+        wav_header(h, 0xFFFFFFFF);
+        fwrite(h, 1, sizeof(h), out_file);
+    }
+    out_samples = 0;
+    return true;
+}
+
+static double since(const struct timespec *t0)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t0->tv_sec) + (now.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/* Sleep until the samples written are no more than lead seconds ahead
+ * of the clock */
+static void pace(double lead)
+{
+    double ahead = (double)pace_samples / SAMPLE_RATE - since(&pace_start) - lead;
+    if (ahead > 0) {
+        struct timespec ts = { (time_t)ahead, (long)((ahead - (time_t)ahead) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void out_write(const int16_t *buf, int count)
+{
+    uint8_t bytes[RENDER_BLOCK * 2];
+    for (int i = 0; i < count; i++)
+        put16le(bytes + 2 * i, (uint16_t)buf[i]);
+    fwrite(bytes, 2, count, out_file);
+    out_samples += count;
+    if (out_realtime) {
+        if (pace_samples == 0)
+            clock_gettime(CLOCK_MONOTONIC, &pace_start);
+        pace_samples += count;
+        pace(PACE_LEAD);
+    }
+}
+
+/* Queue ran dry: let a paced file catch up with the clock */
+static void out_drain(void)
+{
+    fflush(out_file);
+    if (out_realtime && pace_samples) {
+        pace(0);
+        pace_samples = 0;
+    }
 }
 
-void snd_tone(int freq_hz, int duration_ticks)
+/* Fill in the WAV sizes where the file can seek back to them */
+static void out_close(void)
 {
-    if (duration_ticks <= 0)
+    if (!out_file)
         return;
+    if (out_wav && fseek(out_file, 0, SEEK_SET) == 0) {
+        uint8_t h[44];
+        wav_header(h, out_samples * 2);
+        fwrite(h, 1, sizeof(h), out_file);
+    }
+    fclose(out_file);
+    out_file = NULL;
+    /* The original standard output is gone with it */
+    if (out_stdout >= 0) {
+        out_stdout = -1;
+        out_failed = true;
+    }
+}
 
+/* Open the output; false when there is nowhere to play */
+static bool sink_open(void)
+{
+    if (out_path)
+        return out_open();
 #ifdef HAVE_PULSEAUDIO
     pa_open();
-    if (!pa_conn)
+    return pa_conn != NULL;
+#else
+    return false;
+#endif
+}
+
+static void sink_write(int16_t *buf, int count)
+{
+    if (out_file) {
+        out_write(buf, count);
         return;
+    }
+#ifdef HAVE_PULSEAUDIO
+    pa_write_samples(buf, count);
+#endif
+}
 
-    double seconds = duration_ticks / 18.2;
-    int total = (int)(seconds * SAMPLE_RATE);
-    if (total <= 0)
+static void sink_drain(void)
+{
+    if (out_file) {
+        out_drain();
         return;
+    }
+#ifdef HAVE_PULSEAUDIO
+    pa_drain();
+#endif
+}
+
+
+/*
+ * Synthesis: one cycle of a sine in a table, stepped through by a 32-bit
+ * phase accumulator whose top WAVE_BITS bits index the table. The phase
+ * and the envelope level carry over from one note to the next, so a
+ * change of pitch continues the waveform where it was instead of
+ * restarting it; the level only ramps, over FADE_SAMPLES, when sound
+ * starts or stops. Samples are rendered a block at a time into one
+ * static buffer, so a note of any length costs a table lookup and a
+ * multiply per sample and no memory. Only the thread playing notes
+ * touches this state.
+ */
+#define WAVE_BITS 10
+#define WAVE_SIZE (1 << WAVE_BITS)
+#define AMPLITUDE 24000
+#define FADE_STEP (AMPLITUDE / FADE_SAMPLES + 1)
+
+static int16_t wavetable[WAVE_SIZE];
+static int16_t render_buf[RENDER_BLOCK];
+static uint32_t synth_phase;        /* fraction of a cycle, 2^32 = one */
+static uint32_t synth_inc;          /* phase step of the last tone */
+static int synth_level;             /* envelope, 0 to AMPLITUDE */
+
+static void synth_init(void)
+{
+    for (int i = 0; i < WAVE_SIZE; i++)
+        wavetable[i] = (int16_t)lrint(32767.0 * sin(2.0 * M_PI * i / WAVE_SIZE));
+}
+
+static uint32_t to_samples(double seconds)
+{
+    return seconds > 0 ? (uint32_t)(seconds * SAMPLE_RATE + 0.5) : 0;
+}
 
-    /* Allocate buffer (or use stack for short tones) */
-    int16_t stack_buf[8192];
-    int16_t *buf = (total <= 8192) ? stack_buf : malloc(total * sizeof(int16_t));
-    if (!buf)
+/* Render a note to the device. During a rest the last tone keeps
+ * running while its level falls to zero. */
+static void synth_note(const snd_note_t *n)
+{
+    if (!sink_open())
         return;
 
-    if (freq_hz < 37) {
-        /* Rest / silence */
-        memset(buf, 0, total * sizeof(int16_t));
-    } else {
-        double phase_inc = 2.0 * M_PI * freq_hz / SAMPLE_RATE;
-        int fade = (FADE_SAMPLES < total / 2) ? FADE_SAMPLES : total / 2;
-        for (int i = 0; i < total; i++) {
-            double sample = sin(phase_inc * i) * 24000.0;
-            /* Fade in */
-            if (i < fade)
-                sample *= (double)i / fade;
-            /* Fade out */
-            if (i >= total - fade)
-                sample *= (double)(total - 1 - i) / fade;
-            buf[i] = (int16_t)sample;
+    /* Tones above the Nyquist frequency are inaudible here anyway */
+    bool tone = n->freq >= 37 && n->freq < SAMPLE_RATE / 2;
+    if (tone)
+        synth_inc = (uint32_t)(((uint64_t)n->freq << 32) / SAMPLE_RATE);
+
+    uint32_t total = n->on + n->off;
+    for (uint32_t done = 0; done < total; ) {
+        uint32_t len = total - done;
+        if (len > RENDER_BLOCK)
+            len = RENDER_BLOCK;
+        for (uint32_t i = 0; i < len; i++) {
+            int target = tone && done + i < n->on ? AMPLITUDE : 0;
+            if (synth_level < target)
+                synth_level = synth_level + FADE_STEP < target
+                            ? synth_level + FADE_STEP : target;
+            else if (synth_level > target)
+                synth_level = synth_level - FADE_STEP > target
+                            ? synth_level - FADE_STEP : target;
+            render_buf[i] = (int16_t)
+                ((wavetable[synth_phase >> (32 - WAVE_BITS)] * synth_level) >> 15);
+            synth_phase += synth_inc;
         }
+        sink_write(render_buf, (int)len);
+        done += len;
     }
+}
 
-    pa_write_samples(buf, total);
+/* Fade out a tone left sounding when the queue runs dry */
+static void synth_settle(void)
+{
+    if (synth_level > 0) {
+        snd_note_t rest = { 0, 0, FADE_SAMPLES, false };
+        synth_note(&rest);
+    }
+}
 
-    if (buf != stack_buf)
-        free(buf);
-#else
-    (void)freq_hz;
-    (void)duration_ticks;
-#endif
+/* Wait up to ms for the next note to be posted; false on timeout */
+static bool wait_note(int ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += ms * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    int r;
+    while ((r = sem_timedwait(&note_ready, &ts)) != 0 && errno == EINTR)
+        ;
+    return r == 0;
+}
+
+/*
+ * Once the queue runs dry the thread gives the program SETTLE_MS to
+ * queue another note, which then follows on without a break: a SOUND
+ * sweep in the foreground is a stream of one-note queues. Only if
+ * nothing comes does the tone fade out and the device drain. An
+ * unpaced file has no clock to wait on, so its notes always follow on
+ * and the tone fades out once, at the end.
+ */
+#define SETTLE_MS 20
+
+static void *audio_main(void *arg)
+{
+    bool sounding = false;
+    for (;;) {
+        if (!sounding || (out_file && !out_realtime)) {
+            while (sem_wait(&note_ready) != 0 && errno == EINTR)
+                ;
+        } else if (!wait_note(SETTLE_MS)) {
+            synth_settle();
+            sink_drain();
+            sounding = false;
+            continue;
+        }
+        unsigned tail = atomic_load(&note_tail);
+        if (tail == atomic_load(&note_head))
+            break;                      /* snd_shutdown */
+        snd_note_t n = note_queue[tail % NOTE_QUEUE];
+        synth_note(&n);
+        sounding = true;
+        /* Flag ON PLAY before the note leaves the queue, so a program
+         * that sees PLAY(0) fall also sees the event */
+        int left = (int)(atomic_load(&note_head) - (tail + 1));
+        if (n.background && left == atomic_load(&play_threshold) - 1)
+            atomic_store(&play_event, true);
+        atomic_store(&note_tail, tail + 1);
+    }
+    if (sounding) {
+        synth_settle();
+        sink_drain();
+    }
+    return NULL;
+}
+
+static void audio_start(void)
+{
+    if (audio_running)
+        return;
+    if (sem_init(&note_ready, 0, 0) != 0)
+        return;
+    if (pthread_create(&audio_thread, NULL, audio_main, NULL) != 0) {
+        sem_destroy(&note_ready);
+        return;
+    }
+    audio_running = true;
+}
+
+static void wait_drain(void)
+{
+    while (atomic_load(&note_tail) != atomic_load(&note_head))
+        pause_ms(1);
+}
+
+/* Append a note sounding for on seconds and silent for off, waiting
+ * for room; without a thread, play it here */
+static void queue_note(int freq_hz, double on, double off, bool background)
+{
+    snd_note_t n = { freq_hz, to_samples(on), to_samples(off), background };
+    if (n.on + n.off == 0)
+        return;
+    audio_start();
+    if (!audio_running) {
+        synth_note(&n);
+        synth_settle();
+        return;
+    }
+    unsigned head = atomic_load(&note_head);
+    while (head - atomic_load(&note_tail) >= NOTE_QUEUE)
+        pause_ms(1);
+    note_queue[head % NOTE_QUEUE] = n;
+    atomic_store(&note_head, head + 1);
+    sem_post(&note_ready);
+}
+
+void snd_init(void)
+{
+    synth_init();
+    snd_reset();
 }
 
-void snd_tone_sync(int freq_hz, int duration_ticks)
+/* Let background music finish, then stop the audio thread */
+void snd_shutdown(void)
 {
-    snd_tone(freq_hz, duration_ticks);
+    if (audio_running) {
+        wait_drain();
+        sem_post(&note_ready);
+        pthread_join(audio_thread, NULL);
+        sem_destroy(&note_ready);
+        audio_running = false;
+    }
 #ifdef HAVE_PULSEAUDIO
-    pa_drain();
+    if (pa_conn) {
+        pa_simple_drain(pa_conn, NULL);
+        pa_simple_free(pa_conn);
+        pa_conn = NULL;
+    }
 #endif
+    out_close();
+}
+
+void snd_reset(void)
+{
+    mml_octave = 4;
+    mml_length = 4;
+    mml_tempo = 120;
+    mml_artic = 7;
+    mml_background = false;
+}
+
+/* Notes not yet played (PLAY(n)) */
+int snd_queued(void)
+{
+    return (int)(atomic_load(&note_head) - atomic_load(&note_tail));
+}
+
+/* ON PLAY(n): flag an event when background music drops to n - 1
+ * notes; 0 turns it off */
+void snd_set_play_trap(int n)
+{
+    atomic_store(&play_threshold, n);
+    atomic_store(&play_event, false);
+}
+
+/* Whether the ON PLAY threshold was crossed since the last call */
+bool snd_play_event(void)
+{
+    return atomic_exchange(&play_event, false);
+}
+
+/* SOUND: queued like a PLAY note, in the current MF/MB mode */
+void snd_tone(int freq_hz, double duration_ticks)
+{
+    queue_note(freq_hz, duration_ticks / TICK_RATE, 0, mml_background);
+    if (!mml_background)
+        wait_drain();
 }
 
 void snd_beep(void)
 {
-    snd_tone_sync(800, 4);  /* ~220ms beep at 800 Hz */
+    queue_note(800, 4 / TICK_RATE, 0, false);  /* ~220ms beep at 800 Hz */
+    wait_drain();
 }
 
 /* --- MML Parser --- */
@@ -200,8 +597,7 @@ void snd_play(const char *mml)
             int dots = 0;
             while (*p == '.') { dots++; p++; }
 
-            /* Duration in ticks: whole note = 4 beats, at tempo BPM */
-            /* ticks = (whole_note_seconds / len) * 18.2 */
+            /* Duration: whole note = 4 beats, at tempo BPM */
             double whole = 240.0 / mml_tempo;  /* seconds for whole note */
             double dur = whole / len;
             /* Each dot adds half the previous duration */
@@ -211,14 +607,10 @@ void snd_play(const char *mml)
                 extra /= 2.0;
             }
 
-            double ticks = dur * 18.2;
-            double play_ticks = ticks * mml_artic / 8.0;
-            double rest_ticks = ticks - play_ticks;
-
+            /* Articulation silences the last (8 - n)/8 of the note */
+            double play = dur * mml_artic / 8.0;
             int freq = (int)(note_freq(oct, semi) + 0.5);
-            snd_tone(freq, (int)(play_ticks + 0.5));
-            if (rest_ticks > 0.5)
-                snd_tone(0, (int)(rest_ticks + 0.5));
+            queue_note(freq, play, dur - play, mml_background);
             continue;
         }
 
@@ -228,18 +620,15 @@ void snd_play(const char *mml)
             if (n == 0) {
                 /* Rest: one quarter note */
                 double whole = 240.0 / mml_tempo;
-                snd_tone(0, (int)(whole / mml_length * 18.2 + 0.5));
+                queue_note(0, 0, whole / mml_length, mml_background);
             } else if (n >= 1 && n <= 84) {
                 int oct = (n - 1) / 12;
                 int semi = (n - 1) % 12;
                 int freq = (int)(note_freq(oct, semi) + 0.5);
                 double whole = 240.0 / mml_tempo;
-                double dur = whole / mml_length * 18.2;
+                double dur = whole / mml_length;
                 double play = dur * mml_artic / 8.0;
-                double rest = dur - play;
-                snd_tone(freq, (int)(play + 0.5));
-                if (rest > 0.5)
-                    snd_tone(0, (int)(rest + 0.5));
+                queue_note(freq, play, dur - play, mml_background);
             }
             continue;
         }
@@ -287,7 +676,7 @@ void snd_play(const char *mml)
                 dur += extra;
                 extra /= 2.0;
             }
-            snd_tone(0, (int)(dur * 18.2 + 0.5));
+            queue_note(0, 0, dur, mml_background);
             continue;
         }
 
@@ -297,15 +686,14 @@ void snd_play(const char *mml)
             if (mode == 'N') { mml_artic = 7; p++; }
             else if (mode == 'L') { mml_artic = 8; p++; }
             else if (mode == 'S') { mml_artic = 3; p++; }
-            else if (mode == 'F') { p++; }  /* foreground, already default */
-            else if (mode == 'B') { p++; }  /* background, accepted but ignored */
+            else if (mode == 'F') { mml_background = false; p++; }
+            else if (mode == 'B') { mml_background = true; p++; }
             continue;
         }
 
         /* Semicolons and other separators: skip */
     }
 
-#ifdef HAVE_PULSEAUDIO
-    pa_drain();
-#endif
+    if (!mml_background)
+        wait_drain();
 }
@@ -130,21 +130,9 @@ gw_value_t gw_fn_asc(gw_value_t *s)
 gw_value_t gw_fn_val(gw_value_t *s)
 {
     if (s->type != VT_STR) gw_error(ERR_TM);
-    char *cs = gw_str_to_cstr(&s->sval);
-    gw_str_free(&s->sval);
-
-    /* Skip leading spaces */
-    char *p = cs;
-    while (*p == ' ') p++;
-
-    char *end;
-    double d = strtod(p, &end);
-    free(cs);
-
-    /* Check for &H hex and &O octal prefix */
     gw_value_t r;
-    r.type = VT_DBL;
-    r.dval = d;
+    gw_scan_number(s->sval.data, s->sval.data + s->sval.len, true, false, &r);
+    gw_str_free(&s->sval);
     return r;
 }
 
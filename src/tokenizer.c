@@ -276,6 +276,22 @@ int gw_crunch(const char *text, uint8_t *out, int outsize)
     return op;
 }
 
+/* Length of the token at p, including embedded constant data bytes */
+int gw_token_len(const uint8_t *p)
+{
+    switch (*p) {
+    case TOK_INT1:       return 2;
+    case TOK_INT2:
+    case TOK_CONST_FOLD: return 3;
+    case TOK_CONST_SNG:  return 5;
+    case TOK_CONST_DBL:  return 9;
+    case TOK_PREFIX_FD:
+    case TOK_PREFIX_FE:
+    case TOK_PREFIX_FF:  return 2;
+    default:             return 1;
+    }
+}
+
 /*
  * LIST: convert tokens back to text.
  * Reimplements the LIST subroutine from IBMRES.ASM.
@@ -189,6 +189,7 @@ const keyword_entry_t gw_keywords[] = {
     { "PALETTE",   XSTMT_PALETTE, TOK_PREFIX_FE },
     { "LCOPY",     XSTMT_LCOPY,   TOK_PREFIX_FE },
     { "CALLS",     XSTMT_CALLS,   TOK_PREFIX_FE },
+    { "MAT",       XSTMT_MAT,     TOK_PREFIX_FE },
 
     /* Extended functions (prefix 0xFD) */
     { "CVI",       XFUNC_CVI,     TOK_PREFIX_FD },
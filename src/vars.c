@@ -93,6 +93,7 @@ void gw_vars_clear(void)
             gw_str_free(&gw.vars[i].val.sval);
     }
     gw.var_count = 0;
+    gw_eval_invalidate();
 }
 
 void gw_stmt_deftype(gw_valtype_t type)
@@ -119,6 +120,7 @@ void gw_stmt_deftype(gw_valtype_t type)
 
         for (int i = first; i <= last; i++)
             gw.def_type[i] = type;
+        gw_eval_invalidate();
 
         gw_skip_spaces();
         if (gw_chrgot() != ',')
@@ -0,0 +1,314 @@
+/*
+ * Equivalence test: gw_format_number() must produce exactly the text of
+ * the original snprintf-based formatter for every INTEGER and for a
+ * large sample of SINGLE and DOUBLE values (random bit patterns, values
+ * around powers of ten and the fixed/scientific boundaries, halves and
+ * short decimals, NaN and infinities).
+ *
+ *   format_test              sampled run (CTest)
+ *   format_test exhaustive   additionally every SINGLE bit pattern
+ */
+#include "gwbasic.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Link stubs for the parts of math_float.c this test does not use */
+void gw_error(int errnum)
+{
+    fprintf(stderr, "unexpected gw_error(%d)\n", errnum);
+    exit(2);
+}
+
+float gw_to_sng(gw_value_t *v)
+{
+    return v->type == VT_DBL ? (float)v->dval : v->fval;
+}
+
+double gw_to_dbl(gw_value_t *v)
+{
+    return v->type == VT_DBL ? v->dval : v->fval;
+}
+
+/* Reference: the original snprintf-based gw_format_number, kept here
+ * verbatim as the definition of the expected text */
+static void ref_format_number(gw_value_t *v, char *buf, int bufsize)
+{
+    switch (v->type) {
+    case VT_INT:
+        snprintf(buf, bufsize, "% d", v->ival);
+        break;
+    case VT_SNG: {
+        /* GW-BASIC prints up to 7 significant digits for single */
+        double d = v->fval;
+        if (d == 0.0) {
+            snprintf(buf, bufsize, " 0");
+            break;
+        }
+        double ad = fabs(d);
+        if (ad >= 0.01 && ad < 1e7) {
+            /* Try fixed notation */
+            char tmp[32];
+            for (int prec = 7; prec >= 0; prec--) {
+                snprintf(tmp, sizeof(tmp), "%.*f", prec, d);
+                /* Count significant digits */
+                int sig = 0;
+                for (char *p = tmp; *p; p++) {
+                    if (*p == '-' || *p == ' ') continue;
+                    if (*p == '.') continue;
+                    if (sig == 0 && *p == '0') continue;
+                    sig++;
+                }
+                if (sig <= 7) {
+                    /* Remove trailing zeros after decimal point */
+                    char *dot = strchr(tmp, '.');
+                    if (dot) {
+                        char *end = tmp + strlen(tmp) - 1;
+                        while (end > dot && *end == '0') *end-- = '\0';
+                        if (end == dot) *end = '\0';
+                    }
+                    if (d >= 0)
+                        snprintf(buf, bufsize, " %s", tmp);
+                    else
+                        snprintf(buf, bufsize, "%s", tmp);
+                    return;
+                }
+            }
+        }
+        /* Scientific notation - GW-BASIC uses format like 1.234E+10 */
+        {
+            char tmp[32];
+            snprintf(tmp, sizeof(tmp), "%.6E", fabs(d));
+            /* Strip trailing zeros before E: 1.000000E+10 -> 1E+10 */
+            char *e = strchr(tmp, 'E');
+            if (e) {
+                char *p = e - 1;
+                while (p > tmp && *p == '0') p--;
+                if (*p == '.') p--;  /* remove dot if no fractional part */
+                memmove(p + 1, e, strlen(e) + 1);
+                e = strchr(tmp, 'E');
+            }
+            /* Convert 3-digit exponent to 2-digit: E+010 -> E+10 */
+            if (e && strlen(e) >= 5 && e[2] == '0') {
+                memmove(e + 2, e + 3, strlen(e + 3) + 1);
+            }
+            if (d < 0)
+                snprintf(buf, bufsize, "-%s", tmp);
+            else
+                snprintf(buf, bufsize, " %s", tmp);
+        }
+        break;
+    }
+    case VT_DBL: {
+        double d = v->dval;
+        if (d == 0.0) {
+            snprintf(buf, bufsize, " 0");
+            break;
+        }
+        double ad = fabs(d);
+        if (ad >= 0.01 && ad < 1e16) {
+            char tmp[32];
+            for (int prec = 16; prec >= 0; prec--) {
+                snprintf(tmp, sizeof(tmp), "%.*f", prec, d);
+                int sig = 0;
+                for (char *p = tmp; *p; p++) {
+                    if (*p == '-' || *p == ' ') continue;
+                    if (*p == '.') continue;
+                    if (sig == 0 && *p == '0') continue;
+                    sig++;
+                }
+                if (sig <= 16) {
+                    char *dot = strchr(tmp, '.');
+                    if (dot) {
+                        char *end = tmp + strlen(tmp) - 1;
+                        while (end > dot && *end == '0') *end-- = '\0';
+                        if (end == dot) *end = '\0';
+                    }
+                    if (d >= 0)
+                        snprintf(buf, bufsize, " %s", tmp);
+                    else
+                        snprintf(buf, bufsize, "%s", tmp);
+                    return;
+                }
+            }
+        }
+        /* Scientific with D exponent for double precision */
+        {
+            char tmp[32];
+            snprintf(tmp, sizeof(tmp), "%.15E", fabs(d));
+            /* Strip trailing zeros before E: 1.000000000000000E+10 -> 1E+10 */
+            char *e = strchr(tmp, 'E');
+            if (e) {
+                char *p = e - 1;
+                while (p > tmp && *p == '0') p--;
+                if (*p == '.') p--;
+                memmove(p + 1, e, strlen(e) + 1);
+                e = strchr(tmp, 'E');
+            }
+            if (e) *e = 'D';  /* GW-BASIC uses D for double */
+            /* Convert 3-digit exponent to 2-digit: D+010 -> D+10 */
+            if (e && strlen(e) >= 5 && e[2] == '0') {
+                memmove(e + 2, e + 3, strlen(e + 3) + 1);
+            }
+            if (d < 0)
+                snprintf(buf, bufsize, "-%s", tmp);
+            else
+                snprintf(buf, bufsize, " %s", tmp);
+        }
+        break;
+    }
+    default:
+        snprintf(buf, bufsize, "?");
+    }
+}
+
+static unsigned long checked, failed;
+
+static void check(gw_value_t *v)
+{
+    char want[64], got[GW_NUM_TEXT_MAX];
+    ref_format_number(v, want, sizeof(want));
+    gw_format_number(v, got, sizeof(got));
+    checked++;
+    if (strcmp(want, got) != 0) {
+        if (failed++ < 20) {
+            double d = v->type == VT_SNG ? v->fval : v->dval;
+            fprintf(stderr, "type %d value %.17g: want \"%s\" got \"%s\"\n",
+                    v->type, d, want, got);
+        }
+    }
+}
+
+static void check_sng(float f)
+{
+    gw_value_t v;
+    v.type = VT_SNG;
+    v.fval = f;
+    check(&v);
+}
+
+static void check_dbl(double d)
+{
+    gw_value_t v;
+    v.type = VT_DBL;
+    v.dval = d;
+    check(&v);
+}
+
+static void check_both(double d)
+{
+    check_sng((float)d);
+    check_sng((float)-d);
+    check_dbl(d);
+    check_dbl(-d);
+}
+
+/* xorshift64*, fixed seed so failures reproduce */
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+int main(int argc, char **argv)
+{
+    gw_value_t v;
+
+    /* Every INTEGER */
+    v.type = VT_INT;
+    for (int i = -32768; i <= 32767; i++) {
+        v.ival = (int16_t)i;
+        check(&v);
+    }
+
+    /* Random SINGLE and DOUBLE bit patterns */
+    for (int i = 0; i < 150000; i++) {
+        uint32_t b32 = (uint32_t)rng();
+        float f;
+        memcpy(&f, &b32, 4);
+        check_sng(f);
+        uint64_t b64 = rng();
+        double d;
+        memcpy(&d, &b64, 8);
+        check_dbl(d);
+    }
+
+    /* Random values in the fixed-notation ranges */
+    for (int i = 0; i < 150000; i++) {
+        double u = (double)(rng() >> 11) / 9007199254740992.0;
+        check_sng((float)(0.01 * pow(10.0, u * 9.0)));
+        check_dbl(0.01 * pow(10.0, u * 18.0));
+    }
+
+    /* Neighbourhoods of powers of ten, including the 0.01, 10^7 and
+     * 10^16 switch-over points */
+    for (int e = -45; e <= 38; e++) {
+        float f = (float)pow(10.0, e);
+        float lo = f, hi = f;
+        for (int k = 0; k < 300; k++) {
+            check_sng(lo);
+            check_sng(hi);
+            lo = nextafterf(lo, 0.0f);
+            hi = nextafterf(hi, INFINITY);
+        }
+    }
+    for (int e = -320; e <= 308; e++) {
+        double d = pow(10.0, e);
+        double lo = d, hi = d;
+        for (int k = 0; k < 100; k++) {
+            check_dbl(lo);
+            check_dbl(hi);
+            lo = nextafter(lo, 0.0);
+            hi = nextafter(hi, INFINITY);
+        }
+    }
+
+    /* Values that round up into the next digit: 9.9999995, 99999.995... */
+    for (int e = -3; e <= 16; e++) {
+        for (int k = 1; k <= 17; k++) {
+            double d = (pow(10.0, k) - 0.5) * pow(10.0, e - k);
+            check_both(d);
+            check_both(nextafter(d, 0.0));
+            check_both(nextafter(d, INFINITY));
+        }
+    }
+
+    /* Integers, halves (ties) and short decimals */
+    for (int i = 0; i <= 50000; i++) {
+        check_both(i);
+        check_both(i + 0.5);
+        check_both(i / 100.0);
+        check_both(i / 1000000.0);
+        check_both(i * 1000.0 + 0.25);
+    }
+
+    /* Subnormals and extremes */
+    check_both(5e-324);
+    check_both(2.2250738585072014e-308);
+    check_both(1.7976931348623157e308);
+    check_sng(1e-45f);
+    check_sng(3.4028235e38f);
+    check_sng(NAN);
+    check_sng(INFINITY);
+    check_sng(-INFINITY);
+    check_dbl(NAN);
+    check_dbl(INFINITY);
+    check_dbl(-INFINITY);
+
+    if (argc > 1 && strcmp(argv[1], "exhaustive") == 0) {
+        uint32_t b = 0;
+        do {
+            float f;
+            memcpy(&f, &b, 4);
+            check_sng(f);
+        } while (++b != 0);
+    }
+
+    printf("format_test: %lu values, %lu mismatches\n", checked, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# With --mmap a random file is grown on disk while it is mapped. A
+# program that ENDs or stops on an error without CLOSE must still leave
+# the file at its logical size, as LOF sees it on the next run.
+set -eu
+
+GWBASIC="$1"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+cat > end.bas <<'BAS'
+10 OPEN "R",#1,"M.DAT",16
+20 FIELD #1,16 AS A$
+30 LSET A$="X":PUT #1,1
+40 END
+BAS
+cat > err.bas <<'BAS'
+10 OPEN "R",#1,"E.DAT",16
+20 FIELD #1,16 AS A$
+30 LSET A$="Y":PUT #1,2
+40 ERROR 5
+BAS
+cat > check.bas <<'BAS'
+10 OPEN "R",#1,"M.DAT",16:PRINT LOF(1):CLOSE
+20 OPEN "R",#1,"E.DAT",16:PRINT LOF(1):CLOSE
+BAS
+
+"$GWBASIC" --mmap end.bas
+"$GWBASIC" --mmap err.bas >/dev/null 2>&1 || true
+got=$("$GWBASIC" check.bas | tr -s ' \n' ' ')
+if [ "$got" != " 16 32 " ]; then
+    echo "LOF after --mmap run: expected ' 16 32 ', got '$got'"
+    exit 1
+fi
@@ -0,0 +1,16 @@
+10 REM Arithmetic by operand type, overflow and division errors
+20 A% = 300: B% = -7: C! = 2.5: D# = 1 / 3#
+30 PRINT A% + B%; A% - B%; A% * B%; A% / B%; A% \ B%; A% MOD B%
+40 PRINT C! + C!; C! * 3; C! / 4; C! ^ 2; C! = 2.5; C! < 1
+50 PRINT D# + D#; D# * 3; D# - 1; D# > D#
+60 PRINT A% + C!; C! + D#; A% * D#; A% AND 255; C! OR 1
+70 ON ERROR GOTO 200
+80 PRINT 32767% + 1%
+90 PRINT -32768% \ -1%
+100 PRINT -32768% MOD -1%
+110 PRINT 1E38 * 10
+120 PRINT 1D308 * 10#
+130 PRINT 5 \ 0
+140 PRINT 2.5 / 0
+150 END
+200 PRINT "Error"; ERR; "in"; ERL: RESUME NEXT
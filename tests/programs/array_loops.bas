@@ -0,0 +1,21 @@
+10 REM FOR loops over arrays that run as native kernels
+20 DIM A(10), B(10), C%(10), N$(4)
+30 FOR I = 0 TO 10: A(I) = 1.5: NEXT I
+40 FOR I = 0 TO 10: B(I) = A(I): NEXT
+50 FOR I = 0 TO 10: B(I) = B(I) + 2 * A(I): NEXT
+60 S = 0: FOR I = 0 TO 10: S = S + B(I): NEXT: PRINT "Sum"; S; "I ="; I
+70 FOR I = 0 TO 10 STEP 2: C%(I) = I * 3: NEXT
+80 M = -1: FOR I = 10 TO 0 STEP -1: IF C%(I) > M THEN M = C%(I)
+90 NEXT I: PRINT "Max"; M; "I ="; I
+100 FOR I = 0 TO 4: N$(I) = "ab": NEXT: FOR I = 1 TO 4: N$(I) = N$(I - 1) + "c": NEXT
+110 FOR I = 0 TO 4: M$(I) = N$(I): NEXT: PRINT M$(1); " "; M$(4); " "; M$(10); "|"
+120 REM Rounding and conversion follow the statement: 2.5 stores as 2
+130 FOR I = 0 TO 10: C%(I) = 2.5: NEXT: T% = 0: FOR I = 0 TO 10: T% = T% + C%(I): NEXT: PRINT T%
+140 REM Errors stop the kernel at the failing iteration
+150 ON ERROR GOTO 300
+160 FOR I = 5 TO 12: A(I) = 0: NEXT: PRINT "Fill done, I ="; I
+170 FOR I = 0 TO 10: C%(I) = 20000: NEXT: T% = 0
+180 FOR I = 0 TO 10: T% = T% + C%(I): NEXT: PRINT "T% ="; T%; "I ="; I
+190 FOR I = 0 TO 3: N$(I) = 1: NEXT: PRINT "Mismatch done"
+200 END
+300 PRINT "Error"; ERR; "in"; ERL; "at I ="; I: RESUME NEXT
@@ -0,0 +1,11 @@
+10 REM CIRCLE ellipses, arcs and sectors
+20 SCREEN 1
+30 CIRCLE (160,100),60,3,-.5,-2: PAINT (160,70),1,3
+40 CIRCLE (60,100),40,2,,,2: CIRCLE (260,100),30,1,5,1
+50 A = POINT(160,70): B = POINT(160,130): C = POINT(220,100): D = POINT(160,50)
+60 E = POINT(80,100): F = POINT(60,60): G = POINT(100,100)
+70 H = POINT(290,100): I = POINT(230,100): J = POINT(260,75)
+80 SCREEN 0
+90 PRINT A; B; C; D
+100 PRINT E; F; G
+110 PRINT H; I; J
@@ -0,0 +1,20 @@
+10 REM Constant expressions folded when the line is stored
+20 PI2 = 2 * 3.14159: PRINT PI2
+30 PRINT (1 + 2) * 3; -2 ^ 2; 2 ^ -1; 10 - 4 - 3; 2 * (3 + 4) - 1
+40 PRINT 7 \ 2; 7 MOD 3; -5 AND 255; NOT 0 + 1; 1 + 2 = 3
+50 X = 5: PRINT X * 2 + 3; 3 + 4 * X; 1 / 3; 1# / 3
+60 PRINT 100 + 31; 200 * 2 / 4; 1E38 * 10#
+70 READ A, B: PRINT A; B
+80 DATA 6, 7
+90 ON ERROR GOTO 200
+100 PRINT 1 / 0
+110 PRINT 32767 + 1
+120 PRINT "Resumed"
+130 OPEN "O", #1, "FOLDTEST.TMP": CLOSE #1
+140 SAVE "FOLDTEST.TMP"
+150 OPEN "I", #1, "FOLDTEST.TMP"
+160 FOR I = 1 TO 3: LINE INPUT #1, L$: NEXT
+170 PRINT L$
+180 CLOSE #1: KILL "FOLDTEST.TMP"
+190 END
+200 PRINT "Error"; ERR; "in"; ERL: RESUME NEXT
@@ -0,0 +1,18 @@
+10 REM Expressions compiled on first use and reused from the line cache
+20 DIM A(5): FOR I = 0 TO 5: A(I) = I * I: NEXT I
+30 FOR K = 1 TO 3
+40 PRINT K; A(K) + A(K - 1); K * 2.5; SQR(A(K)); LEFT$("ABCDEF", K); -K ^ 2
+50 S$ = S$ + CHR$(64 + K): PRINT S$; LEN(S$); MID$(S$, K); S$ < "ABB"
+60 NEXT K
+70 REM DEFINT changes which variable B names
+80 FOR K = 1 TO 2: B = 7 / 2: PRINT B: DEFINT B: NEXT K
+90 REM ERASE and CLEAR move arrays and variables
+100 X = 1: DIM C(3): C(2) = 9
+110 FOR K = 1 TO 2: PRINT X + C(2): ERASE C: DIM C(3): C(2) = 4: X = 2: NEXT K
+120 CLEAR: PRINT X; S$; "|"
+130 REM Errors inside a cached expression, then RESUME NEXT
+140 ON ERROR GOTO 200
+150 FOR K = 1 TO 3: PRINT 10 / (K - 2); "after": NEXT K
+160 FOR K = 1 TO 2: PRINT A(K * 20): NEXT K
+170 END
+200 PRINT "Error"; ERR; "in"; ERL: RESUME NEXT
@@ -0,0 +1,15 @@
+10 REM Operator precedence, unary operators and nesting
+20 A = 2: B = 3: C$ = "AB"
+30 PRINT -A ^ 2; A ^ -B; -A * B + 1; A + B * A ^ 2 / B
+40 PRINT NOT A + 1; NOT A AND 1; A * NOT 0 + 1; - NOT A
+50 PRINT A < B; A <> B; A <= B; A >= B; A => B; A =< B
+60 PRINT C$ + "C" = "ABC"; C$ < "B"; LEN(C$ + C$) * 2
+70 PRINT 10 - A - B; 64 / A / B; 2 ^ 3 ^ 2; 17 MOD 5 \ 2
+80 PRINT ((((((((((A + 1) * 2) - 1) * 2) - 1) * 2) - 1) * 2) - 1) * 2)
+90 PRINT ABS(-(A - B * (A + (B - (A * (B + 1))))))
+100 ON ERROR GOTO 200
+110 PRINT (A + B
+120 PRINT A +
+130 PRINT "X" + A
+140 END
+200 PRINT "Error"; ERR; "in"; ERL: RESUME NEXT
@@ -0,0 +1,22 @@
+10 REM DEF FN calls in cached expressions
+20 DEF FN SQ(X) = X * X
+40 DEF FN P(X) = X + FN Q(1)
+50 DEF FN Q(Y) = X * 10
+60 DEF FN J$(S$) = S$ + "-" + S$
+70 X = 7: S$ = "keep"
+80 FOR K = 1 TO 3
+90 PRINT FN SQ(K); FN SQ(K + 0.5); FN P(K); FN J$(CHR$(64 + K)); X; S$
+100 NEXT K
+110 REM Redefining a function while its callers stay cached
+120 FOR K = 1 TO 2
+130 PRINT FN SQ(3)
+140 DEF FN SQ(Z) = Z * Z * Z
+150 NEXT K
+160 ON ERROR GOTO 300
+170 PRINT FN UN(1 / 0)
+180 DEF FN R(X) = X + FN R(X - 1)
+190 PRINT FN R(5)
+200 PRINT FN SQ("A")
+210 DEF FN L(X)=X+X+X+X+X+X+X+X+X+X+X+X+X+X+X+X+X+X+X+X: Y=FN L(1)+1: PRINT Y
+220 END
+300 PRINT "Error"; ERR; "in"; ERL: IF ERL = 190 THEN RESUME 200 ELSE RESUME NEXT
@@ -0,0 +1,22 @@
+10 REM Graphics GET/PUT: capture a block into an array and blit it back
+20 SCREEN 1
+30 DIM S%(100), T#(40), R$(4)
+40 LINE (10,10)-(17,14),3,BF: PSET (10,10),1: PSET (17,14),2
+50 GET (10,10)-(17,14), S%
+60 PUT (100,100), S%, PSET
+70 GET (17,14)-(10,10), T#(2)
+80 PUT (200,50), T#(2), PSET: PUT (200,50), T#(2)
+90 PUT (100,120), S%: PUT (100,120), S%, OR: PUT (100,120), S%, AND
+100 PUT (50,50), S%, PRESET
+110 FOR K = 1 TO 4: READ N$, X, Y: R$(K) = N$
+120 FOR R = 0 TO 4: R$(K) = R$(K) + " "
+130 FOR C = 0 TO 7: R$(K) = R$(K) + CHR$(48 + POINT(X + C, Y + R)): NEXT C, R, K
+140 ON ERROR GOTO 300
+150 PUT (315,100), S%
+160 GET (0,0)-(100,100), S%
+170 SCREEN 0
+180 PRINT "Header"; S%(0); S%(1)
+190 FOR K = 1 TO 4: PRINT R$(K): NEXT
+200 END
+210 DATA "PSET  ",100,100, "XOR   ",200,50, "AND/OR",100,120, "PRESET",50,50
+300 PRINT "Error"; ERR; "in"; ERL: RESUME NEXT
@@ -0,0 +1,11 @@
+10 REM LINE clipping: boxes, axis lines and diagonals partly off screen
+20 SCREEN 1
+30 LINE (-50,-50)-(40,30),1,BF
+40 LINE (300,-10)-(300,500),2
+50 LINE (-32768,100)-(32767,100),3
+60 LINE (-1000,-600)-(1000,600),2
+70 LINE (400,0)-(500,199),3
+80 DIM N(3)
+90 FOR Y = 0 TO 199: FOR X = 0 TO 319: C = POINT(X,Y): N(C) = N(C) + 1: NEXT X, Y
+100 SCREEN 0
+110 FOR C = 0 TO 3: PRINT "Color"; C; N(C): NEXT
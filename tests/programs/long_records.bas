@@ -0,0 +1,16 @@
+10 REM INPUT#/LINE INPUT# with records longer than 255 characters
+20 OPEN "gwbasic_lr_test.txt" FOR OUTPUT AS #1
+30 A$ = STRING$(200, "A"): B$ = STRING$(200, "B")
+40 WRITE #1, A$, B$, 42
+50 PRINT #1, A$; B$
+60 CLOSE #1
+70 OPEN "gwbasic_lr_test.txt" FOR INPUT AS #1
+80 INPUT #1, P$, Q$, N
+90 PRINT LEN(P$); LEN(Q$); N; P$ = A$; Q$ = B$
+100 LINE INPUT #1, L$
+110 PRINT LEN(L$); RIGHT$(L$, 3)
+120 LINE INPUT #1, L$
+130 PRINT LEN(L$); L$ = STRING$(145, "B")
+140 PRINT EOF(1)
+150 CLOSE #1
+160 KILL "gwbasic_lr_test.txt"
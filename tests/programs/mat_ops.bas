@@ -0,0 +1,18 @@
+10 REM MAT statements: whole-array arithmetic
+20 DIM A(2,2), B(2,2), V(2)
+30 FOR I = 0 TO 2: FOR J = 0 TO 2: A(I,J) = I*3+J+1: B(I,J) = 9-(I*3+J): NEXT J,I
+40 PRINT "A * B": MAT C = A * B: MAT PRINT C;
+50 PRINT "TRN(A)": MAT T = TRN(A): MAT PRINT T,
+60 PRINT "A + B, A - B": MAT S = A + B: MAT D = A - B: MAT PRINT S; D;
+70 PRINT "(2.5) * A": MAT K = (2.5) * A: MAT PRINT K;
+80 PRINT "IDN, CON(1,3), ZER": MAT I = IDN(2,2): MAT U = CON(1,3): MAT Z = ZER(1): MAT PRINT I; U; Z;
+90 PRINT "A * V": V(0) = 1: V(1) = 2: V(2) = 3: MAT W = A * V: MAT PRINT W;
+100 PRINT "A = A * B": MAT A = A * B: MAT PRINT A;
+110 REM INTEGER targets round once on store
+120 MAT N% = (2.5) * U: MAT PRINT N%;
+130 ON ERROR GOTO 200
+140 MAT X = A * U
+150 MAT N% = (40000) * U: MAT PRINT N%;
+160 MAT Q = N$
+170 END
+200 PRINT "Error"; ERR; "in"; ERL: RESUME NEXT
@@ -0,0 +1,14 @@
+10 REM PAINT fills the whole bordered region, including pockets
+20 REM that open backwards from the seed row
+30 SCREEN 1
+40 LINE (10,10)-(110,90),3,B
+50 PSET (20,11),3: DRAW "C3 D59 BU59 BR10 D59 BU59 BR10 D59 BU59 BR10 D59 BU59 BR10 D59 BU59 BR10 D59 BU59 BR10 D59 BU59 BR10 D59 BU59 BR10 D59 BU59"
+60 PSET (25,89),3: DRAW "C3 U59 BD59 BR10 U59 BD59 BR10 U59 BD59 BR10 U59 BD59 BR10 U59 BD59 BR10 U59 BD59 BR10 U59 BD59 BR10 U59 BD59"
+70 PAINT (15,85),2,3
+80 N = 0: M = 0
+90 FOR Y = 10 TO 90: FOR X = 10 TO 110
+100 IF POINT(X,Y) = 2 THEN N = N + 1
+110 IF POINT(X,Y) = 0 THEN M = M + 1
+120 NEXT X, Y
+130 SCREEN 0
+140 PRINT "Filled"; N; "unfilled"; M
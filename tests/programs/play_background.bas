@@ -0,0 +1,15 @@
+10 REM PLAY MB background music, PLAY(n) and ON PLAY(n)
+20 ON PLAY(1) GOSUB 200
+30 PLAY ON
+40 PLAY "MB T120 L16 CDEFGABC"
+50 PRINT "Queued"; PLAY(0) <= 8
+60 IF PLAY(0) > 0 THEN 60
+70 FOR I = 1 TO 200: J = J + 1: NEXT
+80 PRINT "Trapped"; F > 0
+90 PLAY OFF: F = 0
+100 PLAY "L16 EDC": SOUND 440, 2
+110 FOR I = 1 TO 200: J = J + 1: NEXT
+120 PRINT "Off"; F
+130 PLAY "MF": SOUND 880, 1: PRINT "Done"; PLAY(0)
+140 END
+200 F = F + 1: RETURN
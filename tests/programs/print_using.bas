@@ -5,3 +5,9 @@
 50 PRINT USING "!"; "Hello"
 60 PRINT USING "\   \"; "Hello World"
 70 PRINT USING "$$###.##"; 1234.56
+80 FOR I = 1 TO 3: PRINT USING "Row ##: **$#,###.## &"; I; I * 1234.5; "ok": NEXT
+90 PRINT USING "## "; 1; 2; 3
+100 ON ERROR GOTO 130
+110 PRINT USING "no fields"; 1
+120 END
+130 PRINT "Error"; ERR: RESUME 120
@@ -0,0 +1,11 @@
+10 REM EGA/VGA graphics modes: extents, colors and defaults
+20 FOR K = 1 TO 5: READ M, W, H
+30 SCREEN M
+40 PSET (W-1,H-1): LINE (0,0)-(W-1,0),12: P = POINT(W-1,H-1): Q = POINT(W/2,0): R = POINT(W,H)
+50 SCREEN 0: PRINT "SCREEN"; M; P; Q; R
+60 NEXT
+70 DATA 7,320,200, 8,640,200, 9,640,350, 12,640,480, 13,320,200
+80 SCREEN 13
+90 LINE (0,0)-(255,0),200: FOR X = 0 TO 255 STEP 51: PSET (X,1),X: NEXT
+100 S = 0: FOR X = 0 TO 255: S = S + POINT(X,0) + POINT(X,1): NEXT
+110 SCREEN 0: PRINT "Sum"; S
@@ -0,0 +1,20 @@
+10 REM Number scanning: VAL, READ, INPUT#
+20 PRINT VAL("12"); VAL(" -3.5"); VAL("1 2 3"); VAL("12abc"); VAL("")
+30 PRINT VAL("&H1F"); VAL("&HFFFF"); VAL("&O17"); VAL("&777")
+40 PRINT VAL("1E3"); VAL("1D3"); VAL("2.5e-2"); VAL("1.23456789")
+50 PRINT VAL("0.1") * 3; VAL("40000"); VAL("123456789")
+60 READ A, B#, C$, D%, E, F#
+70 PRINT A; B#; C$; D%; E; F#
+80 DATA 3.5 , 1.1234567890123, " hi ", 42, &H10, 1.1
+90 OPEN "O", #1, "VALTEST.TMP"
+100 PRINT #1, "1.5 , 2  3,-4E2, 2.2"
+110 CLOSE #1
+120 OPEN "I", #1, "VALTEST.TMP"
+130 INPUT #1, X, Y, Z, W, V#
+140 PRINT X; Y; Z; W; V#
+150 CLOSE #1
+160 KILL "VALTEST.TMP"
+170 ON ERROR GOTO 200
+180 PRINT VAL("&H10000")
+190 END
+200 PRINT "Error"; ERR: RESUME 190
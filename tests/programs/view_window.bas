@@ -0,0 +1,19 @@
+10 REM VIEW viewports and WINDOW world coordinates
+20 SCREEN 1
+30 VIEW (100,50)-(200,150),,3
+40 WINDOW (-1,-1)-(1,1)
+50 LINE (-2,-2)-(2,2),2: CIRCLE (0,0),.5,1
+60 A = POINT(0,0): B = POINT(-1,-1): C = POINT(1,1): D = POINT(2,2): E = POINT(.5,0)
+70 PRINT A; B; C; D; E
+80 PRINT PMAP(0,0); PMAP(0,1); PMAP(150,2); PMAP(0,3); PMAP(-1,1)
+90 WINDOW SCREEN (0,0)-(10,10): PRINT PMAP(0,1); PMAP(10,1); POINT(10,0)
+100 WINDOW: VIEW (10,10)-(19,19): PSET (0,0),3: LINE (1,1)-(30,1),1
+110 VIEW SCREEN (0,0)-(319,199)
+120 PRINT POINT(10,10); POINT(11,11); POINT(19,11); POINT(20,11); PMAP(10,0)
+130 REM Huge world coordinates clip; huge pixel coordinates overflow
+140 ON ERROR GOTO 190
+150 WINDOW (0,0)-(1,1): PSET (40000,5): PRINT POINT(1E+06,0)
+160 WINDOW: PSET (40000,5)
+170 SCREEN 0
+180 END
+190 PRINT "Error"; ERR; "in"; ERL: RESUME NEXT
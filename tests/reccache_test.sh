@@ -0,0 +1,54 @@
+#!/bin/sh
+# The write-back record cache must not change what a random file holds
+# or what GET reads back. Scattered PUT/GET on one file is run with the
+# cache off, at its default size and with two records, so the small
+# cache evicts and rewrites dirty records all the time; CLOSE, RESET
+# and the end of the program must flush whatever is still dirty.
+set -eu
+
+GWBASIC="$1"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+cat > rc.bas <<'BAS'
+10 OPEN "R",#1,"RC.DAT",8
+20 FIELD #1,2 AS K$,6 AS V$
+30 FOR I=1 TO 200: R=1+(I*37) MOD 61: LSET K$=MKI$(I): LSET V$=STR$(R): PUT #1,R: NEXT
+40 S=0: FOR I=1 TO 100: R=1+(I*13) MOD 61: GET #1,R: S=S+CVI(K$)*R: NEXT: PRINT S
+50 RESET
+60 OPEN "R",#1,"RC.DAT",8: FIELD #1,2 AS K$,6 AS V$
+70 PRINT LOF(1): GET #1,1
+80 FOR R=2 TO 61: GET #1: PRINT CVI(K$);: NEXT: PRINT
+90 FOR I=1 TO 30: R=1+(I*7) MOD 70: LSET K$=MKI$(-I): PUT #1,R: GET #1,1+(I*11) MOD 61: PRINT CVI(K$);: NEXT: PRINT
+100 CLOSE
+110 OPEN "R",#1,"RC.DAT",8: FIELD #1,2 AS K$,6 AS V$
+120 PRINT LOF(1): FOR R=1 TO 70: GET #1,R: PRINT CVI(K$);: NEXT: PRINT
+130 FOR R=75 TO 65 STEP -2: LSET K$=MKI$(R): LSET V$="end": PUT #1,R: NEXT
+140 END
+BAS
+
+for n in 0 default 2; do
+    if [ "$n" = default ]; then
+        "$GWBASIC" rc.bas > "out.$n"
+    else
+        "$GWBASIC" --reccache "$n" rc.bas > "out.$n"
+    fi
+    mv RC.DAT "RC.$n"
+done
+
+for n in default 2; do
+    if ! cmp -s out.0 "out.$n"; then
+        echo "--reccache $n: GET results differ from the uncached run"
+        diff out.0 "out.$n" || true
+        exit 1
+    fi
+    if ! cmp -s RC.0 "RC.$n"; then
+        echo "--reccache $n: file contents differ from the uncached run"
+        exit 1
+    fi
+done
+if [ "$(wc -c < RC.0 | tr -d ' ')" -ne 600 ]; then
+    echo "expected a 75-record file"
+    exit 1
+fi
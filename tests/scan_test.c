@@ -0,0 +1,151 @@
+/*
+ * Equivalence test: the decimal values gw_scan_number() produces must be
+ * the correctly rounded doubles strtod() gives for the same text, on
+ * both its exact fast path and its slow path (long mantissas, large
+ * exponents, subnormals), and the result types must follow the
+ * constant typing rules.
+ */
+#include "gwbasic.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Link stubs for the parts of the interpreter this test does not use */
+void gw_error(int errnum)
+{
+    fprintf(stderr, "unexpected gw_error(%d)\n", errnum);
+    exit(2);
+}
+
+int16_t gw_cint(double x)
+{
+    return (int16_t)rint(x);
+}
+
+static unsigned long checked, failed;
+
+static void fail(const char *text, const char *why)
+{
+    if (failed++ < 20)
+        fprintf(stderr, "\"%s\": %s\n", text, why);
+}
+
+/* text must parse completely to the value strtod gives */
+static void check(const char *text)
+{
+    gw_value_t v;
+    size_t n = strlen(text);
+    const char *end = gw_scan_number(text, text + n, false, false, &v);
+    checked++;
+    if (end != text + n) {
+        fail(text, "not fully consumed");
+        return;
+    }
+
+    char buf[1024];
+    strcpy(buf, text);
+    for (char *p = buf; *p; p++)
+        if (*p == 'D' || *p == 'd') *p = 'E';
+    double want = strtod(buf, NULL);
+
+    switch (v.type) {
+    case VT_INT:
+        if (v.ival != want) fail(text, "INTEGER value");
+        break;
+    case VT_SNG:
+        if (v.fval != (float)want) fail(text, "SINGLE value");
+        break;
+    case VT_DBL:
+        if (memcmp(&v.dval, &want, 8) != 0) fail(text, "DOUBLE value");
+        break;
+    default:
+        fail(text, "type");
+    }
+
+    /* For a DOUBLE variable every non-INTEGER keeps full precision */
+    if (v.type != VT_INT) {
+        gw_scan_number(text, text + n, false, true, &v);
+        if (v.type != VT_DBL || memcmp(&v.dval, &want, 8) != 0)
+            fail(text, "DOUBLE target");
+    }
+}
+
+static void check_type(const char *text, gw_valtype_t type)
+{
+    gw_value_t v;
+    gw_scan_number(text, text + strlen(text), true, false, &v);
+    checked++;
+    if (v.type != type)
+        fail(text, "result type");
+}
+
+/* xorshift64*, fixed seed so failures reproduce */
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+int main(void)
+{
+    char text[1024];
+
+    /* Random mantissas of 1-25 digits with a point and a D exponent */
+    for (int i = 0; i < 300000; i++) {
+        int nd = 1 + (int)(rng() % 25);
+        int dot = (int)(rng() % (nd + 1));
+        int n = 0;
+        if (rng() & 1) text[n++] = '-';
+        for (int k = 0; k < nd; k++) {
+            if (k == dot) text[n++] = '.';
+            text[n++] = (char)('0' + rng() % 10);
+        }
+        int e = (int)(rng() % 600) - 330;    /* stays below DOUBLE overflow */
+        n += sprintf(text + n, "D%d", e);
+        check(text);
+    }
+
+    /* Every double printed with 17 digits reads back exactly */
+    for (int i = 0; i < 200000; i++) {
+        uint64_t b = rng() & 0x7FEFFFFFFFFFFFFFULL;
+        double d;
+        memcpy(&d, &b, 8);
+        sprintf(text, "%.16E", d);
+        *strchr(text, 'E') = 'D';
+        check(text);
+    }
+
+    /* Very long mantissas */
+    for (int i = 0; i < 200; i++) {
+        int n = sprintf(text, "0.");
+        for (int k = 0; k < 900; k++)
+            text[n++] = (char)('0' + rng() % 10);
+        sprintf(text + n, "D%d", (int)(rng() % 40) - 20);
+        check(text);
+    }
+
+    /* Typing rules */
+    check_type("12", VT_INT);
+    check_type("-32768", VT_INT);
+    check_type("32768", VT_SNG);
+    check_type("1.5", VT_SNG);
+    check_type("1E3", VT_SNG);
+    check_type("12345678", VT_DBL);
+    check_type("1.234567", VT_SNG);
+    check_type("1.2345678", VT_DBL);
+    check_type("1D3", VT_DBL);
+    check_type("7#", VT_DBL);
+    check_type("7!", VT_SNG);
+    check_type("7.6%", VT_INT);
+    check_type("1E39", VT_DBL);
+    check_type("&HFFFF", VT_INT);
+    check_type("1 2 3", VT_INT);
+
+    printf("scan_test: %lu values, %lu mismatches\n", checked, failed);
+    return failed ? 1 : 0;
+}
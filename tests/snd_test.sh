@@ -0,0 +1,70 @@
+#!/bin/sh
+# --snd-out renders sound at full speed, so a program must give the
+# same WAV bytes on every run, with the RIFF sizes filled in and one
+# frame per sample of each note.
+set -eu
+
+GWBASIC="$1"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+cat > tune.bas <<'BAS'
+10 SOUND 440,.5
+20 PLAY "L64CDEF"
+30 BEEP
+40 PRINT "done"
+BAS
+
+"$GWBASIC" --snd-out a.wav tune.bas >/dev/null
+"$GWBASIC" --snd-out b.wav tune.bas >/dev/null
+if ! cmp -s a.wav b.wav; then
+    echo "two renders of tune.bas differ"
+    exit 1
+fi
+
+u32() { od -An -tu4 -j"$2" -N4 "$1" | tr -d ' '; }
+size=$(wc -c < a.wav | tr -d ' ')
+riff=$(u32 a.wav 4)
+data=$(u32 a.wav 40)
+if [ "$riff" -ne $((size - 8)) ] || [ "$data" -ne $((size - 44)) ]; then
+    echo "WAV sizes: file $size, RIFF $riff, data $data"
+    exit 1
+fi
+
+# SOUND 440,.5: 1212; four L64 notes: 4 x (1206 + 172); BEEP: 9692;
+# the final fade-out: 220
+frames=$((data / 2))
+if [ "$frames" -ne 16636 ]; then
+    echo "expected 16636 frames, got $frames"
+    exit 1
+fi
+
+# Each note is rounded to whole samples on its own; a tone still
+# sounding when the program ends fades out over 220 more
+frames_of() {
+    printf '10 %s\n' "$1" > one.bas
+    "$GWBASIC" --snd-out one.wav one.bas >/dev/null
+    echo $(( ($(wc -c < one.wav) - 44) / 2 ))
+}
+check_frames() {
+    got=$(frames_of "$1")
+    if [ "$got" -ne "$2" ]; then
+        echo "$1: expected $2 frames, got $got"
+        exit 1
+    fi
+}
+check_frames 'SOUND 440,.5' $((1212 + 220))
+check_frames 'SOUND 440,.25' $((606 + 220))
+# L64 at T120 is 1/32 s: 1206 on and 172 off at articulation 7/8; the
+# off part is too short to finish the fade
+check_frames 'PLAY "L64CCCCCCCC"' $((8 * (1206 + 172) + 220))
+# Legato notes are 1378 samples each with no rest between them
+check_frames 'PLAY "MLL64CDEF"' $((4 * 1378 + 220))
+
+# With "-" the PCM has standard output to itself
+"$GWBASIC" --snd-out - tune.bas > raw.pcm 2>text.txt
+if ! tail -c +45 a.wav | cmp -s - raw.pcm || ! grep -q done text.txt; then
+    echo "--snd-out - mixed text into the PCM stream"
+    exit 1
+fi